@@ -0,0 +1,104 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+/**
+ * Poll-then-sleep policy for the reader of a ringbuffer, shared by the host
+ * and the guest which each provide their own way to sleep.
+ *
+ * After the last message the reader keeps polling for a spin window, then
+ * sleeps for intervals growing exponentially up to a cap. The spin window is
+ * calibrated on the gaps between messages. It grows when a message arrives
+ * shortly after the reader started sleeping, so that a loaded queue keeps the
+ * latency of polling, and shrinks when the queue stays idle for much longer,
+ * so that an idle reader stops burning its core.
+ */
+class AdaptivePoller
+{
+public:
+  using clock = std::chrono::steady_clock;
+  using duration = std::chrono::nanoseconds;
+
+  static constexpr duration MIN_SPIN = std::chrono::microseconds(2);
+  static constexpr duration MAX_SPIN = std::chrono::microseconds(500);
+  static constexpr duration MIN_SLEEP = std::chrono::microseconds(20);
+  static constexpr duration MAX_SLEEP = std::chrono::milliseconds(1);
+
+  /**
+   * Gaps longer than this many spin windows shrink the window.
+   */
+  static constexpr int SHRINK_FACTOR = 16;
+
+private:
+  duration spin = std::chrono::microseconds(50);
+  duration sleep = MIN_SLEEP;
+  clock::time_point idle_since{};
+  bool idle = false;
+
+  void progress(clock::time_point now)
+  {
+    if (idle)
+    {
+      auto gap = now - idle_since;
+      if (gap > spin && gap <= 2 * spin)
+      {
+        spin = std::min(2 * spin, MAX_SPIN);
+      }
+      else if (gap > SHRINK_FACTOR * spin)
+      {
+        spin = std::max(spin / 2, MIN_SPIN);
+      }
+      idle = false;
+    }
+    sleep = MIN_SLEEP;
+  }
+
+  duration idle_for(clock::time_point now)
+  {
+    if (!idle)
+    {
+      idle = true;
+      idle_since = now;
+    }
+    if (now - idle_since < spin)
+    {
+      return duration::zero();
+    }
+    auto result = sleep;
+    sleep = std::min(2 * sleep, MAX_SLEEP);
+    return result;
+  }
+
+public:
+  /**
+   * Account for a poll which read count messages. If the reader has now been
+   * idle for longer than the spin window, sleep by calling wait with the
+   * longest time to sleep for. Returns count.
+   */
+  template<typename Wait>
+  size_t after_poll(size_t count, Wait&& wait)
+  {
+    auto now = clock::now();
+    if (count > 0)
+    {
+      progress(now);
+      return count;
+    }
+    auto timeout = idle_for(now);
+    if (timeout != duration::zero())
+    {
+      wait(timeout);
+    }
+    return count;
+  }
+
+  duration spin_window() const
+  {
+    return spin;
+  }
+};
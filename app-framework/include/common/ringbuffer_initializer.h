@@ -5,13 +5,18 @@
 
 #include <cstdlib>
 #include <ds/ring_buffer.h>
+#include <shared_buffer_pool.h>
 
 /**
- * Minimal initializer struct from host to guest for using ringbuffers.
- * Uses addresses valid within the shared memory as seen by the guest instead of
- * pointers.
+ * Maximum number of queue pairs between the host and a guest.
  */
-struct RingbufferInitializer
+constexpr size_t RINGBUFFER_MAX_QUEUES = 64;
+
+/**
+ * Location of the pair of ringbuffers forming one queue between the host and
+ * the guest.
+ */
+struct RingbufferQueueInitializer
 {
   volatile uintptr_t to_guest_buffer_start;
   volatile size_t to_guest_buffer_size;
@@ -20,3 +25,17 @@ struct RingbufferInitializer
   volatile size_t from_guest_buffer_size;
   volatile uintptr_t from_guest_buffer_offsets;
 };
+
+/**
+ * Minimal initializer struct from host to guest for using ringbuffers.
+ * Uses addresses valid within the shared memory as seen by the guest instead of
+ * pointers. Only the first queue_count entries of queues are used.
+ */
+struct RingbufferInitializer
+{
+  volatile size_t queue_count;
+  RingbufferQueueInitializer queues[RINGBUFFER_MAX_QUEUES];
+  // Pools for large payloads, unused if their slot_count is zero.
+  SharedBufferPoolInitializer to_guest_pool;
+  SharedBufferPoolInitializer from_guest_pool;
+};
@@ -0,0 +1,358 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <span>
+
+/**
+ * Granularity of the slots of a shared buffer pool.
+ */
+constexpr size_t SHARED_BUFFER_ALIGNMENT = 4096;
+
+/**
+ * Shared state of a slot of a buffer pool, kept apart from the data so that
+ * the peer cannot confuse the two. Each slot is on its own cache line. Each
+ * field is written by one side only, and neither side trusts what the other
+ * writes.
+ */
+struct alignas(64) SharedBufferSlot
+{
+  // Written by the owner of the pool each time it allocates the slot.
+  std::atomic<uint64_t> generation;
+  // Written by the peer with the generation it last released.
+  std::atomic<uint64_t> released;
+};
+
+static_assert(sizeof(SharedBufferSlot) == 64);
+
+/**
+ * Reference to a buffer of a pool, passed through the ringbuffer instead of
+ * its contents. The offset is relative to the start of the data of the pool.
+ */
+struct SharedBufferDescriptor
+{
+  uint64_t offset;
+  uint64_t length;
+  uint64_t generation;
+};
+
+/**
+ * Location of a pool in the shared memory, as seen by the guest.
+ */
+struct SharedBufferPoolInitializer
+{
+  volatile uintptr_t slots_start;
+  volatile uintptr_t data_start;
+  volatile size_t slot_size;
+  volatile size_t slot_count;
+};
+
+/**
+ * Pool of fixed-size buffers in shared memory, used to move large payloads
+ * between the host and the guest without copying them through a ringbuffer.
+ *
+ * Each pool has a single owner, which allocates buffers, fills them in and
+ * passes their descriptors to the peer in ringbuffer messages. The peer
+ * acquires the buffer from the descriptor and releases it once done, after
+ * which the slot can be allocated again. There is one pool in each direction.
+ *
+ * Neither side trusts the other. The owner tracks which slots it handed out
+ * in private memory, so the peer cannot make it allocate a slot twice, only
+ * hold on to slots or release them early. Releasing a slot early only
+ * exposes the peer to the owner reusing it. Descriptors are bounds checked
+ * against the pool, and the contents of a buffer may change at any time
+ * while the peer holds it. A slot reused by the owner is detected through
+ * its generation, which copy_to checks after taking a copy. This does not
+ * protect against an owner which modifies the contents without reallocating
+ * the slot, so unsafe_data is only for consumers robust to concurrent
+ * modification, and the contents are never more trustworthy than the owner.
+ */
+class SharedBufferPool
+{
+  /**
+   * State of a slot only visible to the owner of the pool. generation and
+   * shared are only written while holding busy.
+   */
+  struct OwnerSlot
+  {
+    std::atomic<bool> busy{false};
+    // Last generation allocated.
+    std::atomic<uint64_t> generation{0};
+    // Whether the last allocation was shared with the peer, which needs to
+    // release it before the slot can be allocated again.
+    std::atomic<bool> shared{false};
+  };
+
+  std::span<SharedBufferSlot> slots;
+  std::span<uint8_t> data;
+  size_t slot_size;
+  std::unique_ptr<OwnerSlot[]> owner_slots;
+  std::atomic<size_t> next_slot = 0;
+
+  std::span<uint8_t> slot_data(size_t slot) const
+  {
+    return data.subspan(slot * slot_size, slot_size);
+  }
+
+  /**
+   * Whether the owner can allocate the slot again. Must be called while
+   * holding busy.
+   */
+  bool reusable(size_t slot) const
+  {
+    auto& state = owner_slots[slot];
+    return !state.shared.load(std::memory_order_relaxed) ||
+      slots[slot].released.load(std::memory_order_acquire) ==
+      state.generation.load(std::memory_order_relaxed);
+  }
+
+  void free(size_t slot, bool shared)
+  {
+    owner_slots[slot].shared.store(shared, std::memory_order_relaxed);
+    owner_slots[slot].busy.store(false, std::memory_order_release);
+  }
+
+  void release(size_t slot, uint64_t generation)
+  {
+    slots[slot].released.store(generation, std::memory_order_release);
+  }
+
+public:
+  /**
+   * Buffer allocated by the owner of the pool. Frees the slot on destruction
+   * unless it was shared with the peer, in which case the peer frees it.
+   */
+  class Buffer
+  {
+    SharedBufferPool* pool;
+    size_t slot;
+    uint64_t generation;
+
+    friend class SharedBufferPool;
+
+    Buffer(SharedBufferPool* pool, size_t slot, uint64_t generation)
+    : pool(pool), slot(slot), generation(generation)
+    {}
+
+  public:
+    Buffer(Buffer&& other)
+    : pool(other.pool), slot(other.slot), generation(other.generation)
+    {
+      other.pool = nullptr;
+    }
+
+    Buffer& operator=(Buffer&&) = delete;
+
+    ~Buffer()
+    {
+      if (pool != nullptr)
+      {
+        pool->free(slot, false);
+      }
+    }
+
+    std::span<uint8_t> data() const
+    {
+      return pool->slot_data(slot);
+    }
+
+    /**
+     * Hand the first length bytes over to the peer, returning the descriptor
+     * to send it. The buffer can no longer be used afterwards.
+     */
+    SharedBufferDescriptor share(size_t length)
+    {
+      if (length > pool->slot_size)
+      {
+        abort();
+      }
+      SharedBufferDescriptor descriptor{
+        slot * pool->slot_size, length, generation};
+      pool->free(slot, true);
+      pool = nullptr;
+      return descriptor;
+    }
+  };
+
+  /**
+   * Buffer acquired by the peer from a descriptor. Frees the slot on
+   * destruction.
+   */
+  class Lease
+  {
+    SharedBufferPool* pool;
+    size_t slot;
+    size_t length;
+    uint64_t generation;
+
+    friend class SharedBufferPool;
+
+    Lease(
+      SharedBufferPool* pool, size_t slot, size_t length, uint64_t generation)
+    : pool(pool), slot(slot), length(length), generation(generation)
+    {}
+
+  public:
+    Lease(Lease&& other)
+    : pool(other.pool),
+      slot(other.slot),
+      length(other.length),
+      generation(other.generation)
+    {
+      other.pool = nullptr;
+    }
+
+    Lease& operator=(Lease&&) = delete;
+
+    ~Lease()
+    {
+      if (pool != nullptr)
+      {
+        pool->release(slot, generation);
+      }
+    }
+
+    size_t size() const
+    {
+      return length;
+    }
+
+    /**
+     * Copy the contents into private memory of at least size() bytes.
+     * Returns false if the owner reallocated the slot during the copy, in
+     * which case the copy must be discarded.
+     */
+    bool copy_to(std::span<uint8_t> destination) const
+    {
+      if (destination.size() < length)
+      {
+        return false;
+      }
+      std::memcpy(destination.data(), pool->slot_data(slot).data(), length);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return pool->slots[slot].generation.load(std::memory_order_relaxed) ==
+        generation;
+    }
+
+    /**
+     * Contents in place, which the owner may modify at any time.
+     */
+    std::span<const uint8_t> unsafe_data() const
+    {
+      return pool->slot_data(slot).first(length);
+    }
+  };
+
+  /**
+   * Pool over slot_count slots of slot_size bytes. slots and data must have
+   * been validated to lie in the shared memory.
+   */
+  SharedBufferPool(
+    std::span<SharedBufferSlot> slots,
+    std::span<uint8_t> data,
+    size_t slot_size)
+  : slots(slots),
+    data(data),
+    slot_size(slot_size),
+    owner_slots(std::make_unique<OwnerSlot[]>(slots.size()))
+  {
+    if (
+      slot_size == 0 || slot_size % SHARED_BUFFER_ALIGNMENT != 0 ||
+      data.size() / slot_size < slots.size())
+    {
+      abort();
+    }
+  }
+
+  SharedBufferPool(const SharedBufferPool&) = delete;
+  SharedBufferPool& operator=(const SharedBufferPool&) = delete;
+
+  size_t buffer_size() const
+  {
+    return slot_size;
+  }
+
+  /**
+   * Allocate a free buffer, for use by the owner of the pool only. Returns
+   * nothing if all the slots are in use.
+   */
+  std::optional<Buffer> allocate()
+  {
+    auto start = next_slot.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = 0; i < slots.size(); ++i)
+    {
+      auto slot = (start + i) % slots.size();
+      auto& state = owner_slots[slot];
+      bool expected = false;
+      if (!state.busy.compare_exchange_strong(
+            expected, true, std::memory_order_acquire))
+      {
+        continue;
+      }
+      if (!reusable(slot))
+      {
+        state.busy.store(false, std::memory_order_release);
+        continue;
+      }
+      auto generation = state.generation.load(std::memory_order_relaxed) + 1;
+      state.generation.store(generation, std::memory_order_relaxed);
+      slots[slot].generation.store(generation, std::memory_order_release);
+      return Buffer(this, slot, generation);
+    }
+    return std::nullopt;
+  }
+
+  /**
+   * Acquire the buffer of a descriptor received from the owner of the pool,
+   * at most once per descriptor as the lease releases it. Returns nothing if
+   * the descriptor is out of bounds or stale.
+   */
+  std::optional<Lease> acquire(const SharedBufferDescriptor& descriptor)
+  {
+    // The descriptor may still be in shared memory, so read each field once.
+    auto offset =
+      *reinterpret_cast<const volatile uint64_t*>(&descriptor.offset);
+    auto length =
+      *reinterpret_cast<const volatile uint64_t*>(&descriptor.length);
+    auto generation =
+      *reinterpret_cast<const volatile uint64_t*>(&descriptor.generation);
+
+    auto slot = offset / slot_size;
+    if (
+      offset % slot_size != 0 || slot >= slots.size() || length > slot_size ||
+      slots[slot].generation.load(std::memory_order_acquire) != generation)
+    {
+      return std::nullopt;
+    }
+    return Lease(this, slot, length, generation);
+  }
+
+  /**
+   * Slots the owner of the pool could allocate, for statistics only as the
+   * peer releases slots concurrently.
+   */
+  size_t available() const
+  {
+    size_t count = 0;
+    for (size_t slot = 0; slot < slots.size(); ++slot)
+    {
+      auto& state = owner_slots[slot];
+      if (
+        !state.busy.load(std::memory_order_relaxed) &&
+        (!state.shared.load(std::memory_order_relaxed) ||
+         slots[slot].released.load(std::memory_order_relaxed) ==
+           state.generation.load(std::memory_order_relaxed)))
+      {
+        ++count;
+      }
+    }
+    return count;
+  }
+};
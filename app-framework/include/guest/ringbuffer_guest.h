@@ -3,15 +3,96 @@
 
 #pragma once
 
+#include <adaptive_poller.h>
 #include <address.h>
+#include <ds/messaging.h>
 #include <ds/ring_buffer.h>
+#include <launch.h>
+#include <memory>
 #include <ringbuffer_initializer.h>
 #include <shared.h>
+#include <shared_buffer_pool.h>
 #include <snmalloc.h>
+#include <span>
+#include <thread.h>
+#include <vector>
 
+/**
+ * One queue from the host, to be drained by a single guest core.
+ */
+struct RingbufferQueue
+{
+  std::unique_ptr<ringbuffer::Circuit> circuit;
+  std::unique_ptr<ringbuffer::AbstractWriterFactory> writer_factory;
+  ringbuffer::Offsets* to_guest_offsets = nullptr;
+  AdaptivePoller poller;
+  // Pools for large payloads shared by all the queues, null if the host set
+  // up none. Buffers from the host are acquired from to_guest_pool and
+  // buffers for the host are allocated from from_guest_pool.
+  SharedBufferPool* to_guest_pool = nullptr;
+  SharedBufferPool* from_guest_pool = nullptr;
+
+  ringbuffer::Reader& reader()
+  {
+    return circuit->read_from_outside();
+  }
+
+  /**
+   * Read the pending messages with bp. Once the queue has been idle for
+   * longer than the calibrated spin window the core sleeps until the host
+   * writes to the ring or the sleep interval passes, instead of spinning.
+   * Returns the number of messages read.
+   */
+  size_t poll(messaging::BufferProcessor& bp)
+  {
+    // Snapshot the tail before reading so that a message written after the
+    // read is not slept through.
+    auto tail = reinterpret_cast<const volatile uint64_t*>(
+      &(to_guest_offsets->tail));
+    uint64_t last_tail = *tail;
+    return poller.after_poll(
+      bp.read_all(reader()), [tail, last_tail](auto timeout) {
+        monza::wait_for_write(tail, last_tail, timeout.count());
+      });
+  }
+};
+
+/**
+ * Entry points of the guest application, exactly one of which must be
+ * defined. app_main is given the first queue only, app_main_queues is given
+ * all the queues set up by the host, typically to drain each of them from a
+ * different core.
+ */
 extern int app_main(
   std::unique_ptr<ringbuffer::AbstractWriterFactory> writer_factory,
-  ringbuffer::Reader& reader);
+  ringbuffer::Reader& reader) __attribute__((weak));
+extern int app_main_queues(std::span<RingbufferQueue> queues)
+  __attribute__((weak));
+
+/**
+ * Optional initialization of the guest application which does not depend on
+ * the host, run before the queues are set up. The host can boot the guest
+ * ahead of time or snapshot it once app_init has returned, so that launches
+ * skip it. Returns non-zero to exit with that status.
+ */
+extern int app_init() __attribute__((weak));
+
+/**
+ * Optional hook run before the entry point when the guest was restored from
+ * a snapshot, to draw again the randomness drawn by app_init, such as keys or
+ * identifiers, which is otherwise shared by all the guests restored from the
+ * snapshot.
+ */
+extern void app_restore() __attribute__((weak));
+
+/**
+ * The framework holds in main() once app_init has returned, rather than
+ * the runtime before main().
+ */
+bool monza::defer_launch()
+{
+  return true;
+}
 
 /**
  * Validate an array of objects based on the unsafe address and size.
@@ -54,36 +135,108 @@ T& validate_object(
     shared_memory_range.data(), base_address - valid_address_range.start));
 }
 
+/**
+ * Validate a buffer pool based on the unsafe initializer.
+ * Return the pool if the inputs are valid or if there is no pool, exit
+ * otherwise.
+ */
+std::unique_ptr<SharedBufferPool> validate_pool(
+  const std::span<uint8_t> shared_memory_range,
+  volatile SharedBufferPoolInitializer& entry)
+{
+  size_t slot_count = entry.slot_count;
+  size_t slot_size = entry.slot_size;
+  uintptr_t slots_start = entry.slots_start;
+  uintptr_t data_start = entry.data_start;
+  if (slot_count == 0)
+  {
+    return nullptr;
+  }
+  if (
+    slot_size == 0 || slot_size % SHARED_BUFFER_ALIGNMENT != 0 ||
+    slot_count > SIZE_MAX / slot_size ||
+    slots_start % alignof(SharedBufferSlot) != 0)
+  {
+    exit(-1);
+  }
+  auto slots = validate_array<SharedBufferSlot>(
+    shared_memory_range, slots_start, slot_count);
+  auto data = validate_array<uint8_t>(
+    shared_memory_range, data_start, slot_count * slot_size);
+  return std::make_unique<SharedBufferPool>(slots, data, slot_size);
+}
+
 int main()
 {
+  if (app_init != nullptr)
+  {
+    int ret = app_init();
+    if (ret != 0)
+    {
+      return ret;
+    }
+  }
+  if (monza::wait_for_launch() && app_restore != nullptr)
+  {
+    app_restore();
+  }
+
   auto shared_memory_range = monza::get_io_shared_range();
 
   // Volatile read into protected guest memory.
   volatile auto initializer =
     *reinterpret_cast<RingbufferInitializer*>(shared_memory_range.data());
 
+  size_t queue_count = initializer.queue_count;
+  if (queue_count == 0 || queue_count > RINGBUFFER_MAX_QUEUES)
+  {
+    exit(-1);
+  }
+
   // Validate unsafe inputs and map them to guest objects if valid.
-  auto to_guest_buffer = validate_array<uint8_t>(
-    shared_memory_range,
-    initializer.to_guest_buffer_start,
-    initializer.to_guest_buffer_size);
-  auto& to_guest_buffer_offsets = validate_object<ringbuffer::Offsets>(
-    shared_memory_range, initializer.to_guest_buffer_offsets);
-  auto from_guest_buffer = validate_array<uint8_t>(
-    shared_memory_range,
-    initializer.from_guest_buffer_start,
-    initializer.from_guest_buffer_size);
-  auto& from_guest_buffer_offsets = validate_object<ringbuffer::Offsets>(
-    shared_memory_range, initializer.from_guest_buffer_offsets);
-
-  ringbuffer::Circuit circuit(
-    ringbuffer::BufferDef{
-      to_guest_buffer.data(), to_guest_buffer.size(), &to_guest_buffer_offsets},
-    ringbuffer::BufferDef{from_guest_buffer.data(),
-                          from_guest_buffer.size(),
-                          &from_guest_buffer_offsets});
-  auto basic_writer_factory =
-    std::make_unique<ringbuffer::WriterFactory>(circuit);
-
-  return app_main(std::move(basic_writer_factory), circuit.read_from_outside());
-}
\ No newline at end of file
+  auto to_guest_pool =
+    validate_pool(shared_memory_range, initializer.to_guest_pool);
+  auto from_guest_pool =
+    validate_pool(shared_memory_range, initializer.from_guest_pool);
+
+  std::vector<RingbufferQueue> queues(queue_count);
+  for (size_t i = 0; i < queue_count; ++i)
+  {
+    volatile auto& entry = initializer.queues[i];
+    auto to_guest_buffer = validate_array<uint8_t>(
+      shared_memory_range,
+      entry.to_guest_buffer_start,
+      entry.to_guest_buffer_size);
+    auto& to_guest_buffer_offsets = validate_object<ringbuffer::Offsets>(
+      shared_memory_range, entry.to_guest_buffer_offsets);
+    auto from_guest_buffer = validate_array<uint8_t>(
+      shared_memory_range,
+      entry.from_guest_buffer_start,
+      entry.from_guest_buffer_size);
+    auto& from_guest_buffer_offsets = validate_object<ringbuffer::Offsets>(
+      shared_memory_range, entry.from_guest_buffer_offsets);
+
+    queues[i].circuit = std::make_unique<ringbuffer::Circuit>(
+      ringbuffer::BufferDef{to_guest_buffer.data(),
+                            to_guest_buffer.size(),
+                            &to_guest_buffer_offsets},
+      ringbuffer::BufferDef{from_guest_buffer.data(),
+                            from_guest_buffer.size(),
+                            &from_guest_buffer_offsets});
+    queues[i].writer_factory =
+      std::make_unique<ringbuffer::WriterFactory>(*queues[i].circuit);
+    queues[i].to_guest_offsets = &to_guest_buffer_offsets;
+    queues[i].to_guest_pool = to_guest_pool.get();
+    queues[i].from_guest_pool = from_guest_pool.get();
+  }
+
+  if (app_main_queues != nullptr)
+  {
+    return app_main_queues(queues);
+  }
+  if (app_main == nullptr || queue_count != 1)
+  {
+    exit(-1);
+  }
+  return app_main(std::move(queues[0].writer_factory), queues[0].reader());
+}
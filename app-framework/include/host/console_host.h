@@ -0,0 +1,128 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <console_abi.h>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <thread>
+
+namespace monza::host
+{
+  /**
+   * Host side of the console channel at the end of the shared memory of a
+   * guest. Advertises the channel to the guest on construction and drains it
+   * to stdout from a background thread until stopped.
+   *
+   * There is no interrupt from the guest when it writes, so the thread polls
+   * the write position, backing off while the console stays empty.
+   */
+  class ConsoleDrain
+  {
+    static constexpr auto MAX_POLL_INTERVAL = std::chrono::milliseconds(10);
+
+    abi::ConsoleHeader& header;
+    const uint8_t* data;
+    std::atomic<bool> stopping = false;
+    bool valid = true;
+    std::thread drain_thread;
+
+    /**
+     * Write out everything published by the guest. Returns whether there was
+     * anything to write. The write position is written by the guest, so a
+     * value inconsistent with the read position stops the draining.
+     */
+    bool drain()
+    {
+      auto read_position = header.read_position.load(std::memory_order_relaxed);
+      auto write_position =
+        header.write_position.load(std::memory_order_acquire);
+      auto available = write_position - read_position;
+      if (!valid || available == 0)
+      {
+        return false;
+      }
+      if (available > abi::CONSOLE_CAPACITY)
+      {
+        valid = false;
+        return false;
+      }
+
+      while (read_position != write_position)
+      {
+        auto offset = read_position % abi::CONSOLE_CAPACITY;
+        auto length = std::min(
+          write_position - read_position, abi::CONSOLE_CAPACITY - offset);
+        fwrite(data + offset, 1, length, stdout);
+        read_position += length;
+      }
+      fflush(stdout);
+      header.read_position.store(read_position, std::memory_order_release);
+      return true;
+    }
+
+    void run()
+    {
+      auto interval = std::chrono::microseconds(1);
+      while (!stopping.load(std::memory_order_acquire))
+      {
+        if (drain())
+        {
+          interval = std::chrono::microseconds(1);
+        }
+        else
+        {
+          std::this_thread::sleep_for(interval);
+          interval = std::min<std::chrono::microseconds>(
+            interval * 2, MAX_POLL_INTERVAL);
+        }
+      }
+    }
+
+  public:
+    /**
+     * The shared memory must be mapped at the same size as in the guest, with
+     * the console region unused by the host otherwise.
+     */
+    ConsoleDrain(std::span<uint8_t> shared_memory)
+    : header(*reinterpret_cast<abi::ConsoleHeader*>(
+        shared_memory.data() + abi::console_offset(shared_memory.size()))),
+      data(
+        shared_memory.data() + abi::console_offset(shared_memory.size()) +
+        abi::CONSOLE_HEADER_SIZE)
+    {
+      header.write_position.store(0, std::memory_order_relaxed);
+      header.read_position.store(0, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      header.magic = abi::CONSOLE_MAGIC;
+      drain_thread = std::thread([this]() { run(); });
+    }
+
+    ConsoleDrain(const ConsoleDrain&) = delete;
+    ConsoleDrain& operator=(const ConsoleDrain&) = delete;
+
+    /**
+     * Stop the background thread and write out what is left. To be called
+     * once the guest stopped running.
+     */
+    void stop()
+    {
+      if (drain_thread.joinable())
+      {
+        stopping.store(true, std::memory_order_release);
+        drain_thread.join();
+        drain();
+      }
+    }
+
+    ~ConsoleDrain()
+    {
+      stop();
+    }
+  };
+}
@@ -9,14 +9,21 @@
  */
 
 #include <chrono>
+#include <console_host.h>
 #include <filesystem>
+#include <launch_abi.h>
 #include <list>
 #include <memory>
+#include <metrics_host.h>
 #include <new>
+#include <optional>
+#include <profile_host.h>
 #include <span>
+#include <trace_host.h>
 
 #ifdef MONZA_HOST_SUPPORTS_QEMU
 #  include <fcntl.h>
+#  include <qmp_client.h>
 #  include <random>
 #  include <signal.h>
 #  include <spawn.h>
@@ -24,6 +31,7 @@
 #  include <sys/mman.h>
 #  include <sys/wait.h>
 #  include <unistd.h>
+#  include <vector>
 #endif
 
 #ifdef MONZA_HOST_SUPPORTS_HCS
@@ -58,6 +66,7 @@ namespace monza::host
   {
   protected:
     size_t num_threads;
+    std::optional<MetricsReader> metrics;
 
     EnclavePlatform(size_t num_threads) : num_threads(num_threads) {}
 
@@ -80,6 +89,18 @@ namespace monza::host
     static std::unique_ptr<EnclavePlatform>
     create(EnclaveType type, const std::string& path, size_t num_threads);
 
+    /**
+     * Factory method to create an EnclavePlatform instance of a given type
+     * from a snapshot taken with the same image and number of threads. The
+     * guest is held where the snapshot was taken, so that async_run only
+     * needs to resume it.
+     */
+    static std::unique_ptr<EnclavePlatform> restore(
+      EnclaveType type,
+      const std::string& path,
+      size_t num_threads,
+      const std::filesystem::path& snapshot);
+
     /**
      * Returns non-owning reference to typed shared memory constructed with
      * arguments. Range will be unmapped on destruction of EnclavePlatform
@@ -112,6 +133,41 @@ namespace monza::host
         allocation_tuple.second};
     }
 
+    /**
+     * Current runtime metrics of the guest in the Prometheus text format.
+     * Empty until the guest has published them. Safe to call while the guest
+     * runs.
+     */
+    std::string metrics_prometheus() const
+    {
+      return metrics ? metrics->prometheus() : std::string();
+    }
+
+    size_t core_count() const
+    {
+      return num_threads;
+    }
+
+    /**
+     * Boot and initialize the guest up to monza::wait_for_launch and pause it
+     * there, so that async_run only needs to resume it. Guests hold before
+     * main unless their framework defers the hold past its initialization.
+     * Must be called before initialize.
+     * Does nothing on platforms which cannot pause the guest, where the guest
+     * boots in async_run instead.
+     */
+    virtual void boot_ahead() {}
+
+    /**
+     * Save the memory and device state of a guest held by boot_ahead to file,
+     * for restore to create new instances from. The shared memory is not
+     * saved. The guest stays held and can still be run afterwards.
+     */
+    virtual void snapshot(const std::filesystem::path& file)
+    {
+      throw std::logic_error("Snapshots are not supported on this platform.");
+    }
+
     virtual void initialize(InitializerTuple initArgs) = 0;
     virtual void async_run() = 0;
     virtual void join() = 0;
@@ -124,39 +180,134 @@ namespace monza::host
   {
     static constexpr size_t SHMEM_SIZE = 64 * 1024 * 1024;
     static constexpr size_t SHMEM_START = (1ULL << 40) - SHMEM_SIZE;
+    static constexpr auto BOOT_TIMEOUT = std::chrono::seconds(30);
 
-    static inline std::default_random_engine id_generator;
-    static inline std::uniform_int_distribution<uint64_t> id_distribution;
+    /**
+     * Random identifier naming the files of an instance. Drawn from a
+     * random_device local to the call, as instances are constructed
+     * concurrently and by separate host processes sharing the same /tmp.
+     */
+    static uint64_t generate_instance_id()
+    {
+      std::random_device random;
+      return (static_cast<uint64_t>(random()) << 32) | random();
+    }
 
     uint64_t instance_id;
     std::string shmem_file;
-    std::string monitor_file;
+    std::string qmp_file;
     pid_t qemu_pid = 0;
+    std::optional<QmpClient> qmp;
 
     int shmem_file_id = 0;
     uint8_t* shmem_base;
     size_t shmem_offset;
 
+    std::optional<ConsoleDrain> console;
+    std::optional<TraceExport> trace;
+    std::optional<ProfileExport> profile;
+
+    // Set once the guest has booted ahead and holds for its launch.
+    bool held = false;
+    bool restored = false;
+    bool started = false;
     bool joined = false;
 
+    abi::LaunchHeader& launch_header()
+    {
+      return *reinterpret_cast<abi::LaunchHeader*>(
+        shmem_base + abi::launch_offset(SHMEM_SIZE));
+    }
+
+    /**
+     * URI of a migration to or from file through the shell. Quoting is kept
+     * simple, so paths which need escaping are rejected.
+     */
+    static std::string
+    exec_uri(const std::string& command, const std::filesystem::path& file)
+    {
+      if (file.native().find_first_of("'\"\\\n") != std::string::npos)
+      {
+        throw std::invalid_argument("Unsupported snapshot path.");
+      }
+      return "\"exec:" + command + " '" + file.native() + "'\"";
+    }
+
+    /**
+     * Leave the shared memory out of migrations, on both sides. It is owned
+     * by the host and set up anew for each instance.
+     */
+    void ignore_shared_memory()
+    {
+      qmp->execute(
+        "migrate-set-capabilities",
+        "{\"capabilities\": [{\"capability\": \"x-ignore-shared\", "
+        "\"state\": true}]}");
+    }
+
+    void wait_for_migration()
+    {
+      auto deadline = std::chrono::steady_clock::now() + BOOT_TIMEOUT;
+      while (true)
+      {
+        auto reply = qmp->execute("query-migrate");
+        if (reply.find("\"status\": \"completed\"") != std::string::npos)
+        {
+          return;
+        }
+        if (
+          reply.find("\"status\": \"failed\"") != std::string::npos ||
+          reply.find("\"status\": \"cancelled\"") != std::string::npos)
+        {
+          throw std::runtime_error("Guest migration failed: " + reply);
+        }
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+          throw std::runtime_error("Timed out waiting for guest migration.");
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+
+    /**
+     * Load the snapshot into the paused guest and hold it there, as if it had
+     * booted ahead into this shared memory.
+     */
+    void restore_snapshot(const std::filesystem::path& snapshot)
+    {
+      ignore_shared_memory();
+      qmp->execute(
+        "migrate-incoming", "{\"uri\": " + exec_uri("cat", snapshot) + "}");
+      wait_for_migration();
+
+      auto& header = launch_header();
+      header.magic = abi::LAUNCH_MAGIC;
+      header.state.store(abi::LaunchReady, std::memory_order_release);
+      held = true;
+      restored = true;
+    }
+
   protected:
     QemuEnclavePlatform(
-      EnclaveType type, const std::string& path, size_t num_threads)
+      EnclaveType type,
+      const std::string& path,
+      size_t num_threads,
+      const std::optional<std::filesystem::path>& snapshot = std::nullopt)
     : EnclavePlatform<InitializerTuple>(num_threads),
-      instance_id(id_distribution(id_generator))
+      instance_id(generate_instance_id())
     {
       std::stringstream shmem_file_stream;
       shmem_file_stream << "monza-qemu-shmem-" << instance_id;
       shmem_file = shmem_file_stream.str();
 
-      std::stringstream monitor_file_stream;
-      monitor_file_stream << "/tmp/monza-qemu-socket-" << instance_id;
-      monitor_file = monitor_file_stream.str();
+      std::stringstream qmp_file_stream;
+      qmp_file_stream << "/tmp/monza-qemu-socket-" << instance_id;
+      qmp_file = qmp_file_stream.str();
 
-      // Remove the shmem or monitor files left over from a previous run.
-      if (std::filesystem::exists(monitor_file))
+      // Remove the QMP socket left over from a previous run.
+      if (std::filesystem::exists(qmp_file))
       {
-        std::filesystem::remove(monitor_file);
+        std::filesystem::remove(qmp_file);
       }
 
       // Spawn QEMU process.
@@ -173,27 +324,43 @@ namespace monza::host
       shmem_device_argument_builder << "pc-dimm,memdev=shmem,addr="
                                     << SHMEM_START;
       auto shmem_device_argument = shmem_device_argument_builder.str();
-      std::stringstream monitor_file_argument_builder;
-      monitor_file_argument_builder << "unix:" << monitor_file
-                                    << ",server,nowait";
-      auto monitor_file_argument = monitor_file_argument_builder.str();
-      const char* args[] = {binary,       "-enable-kvm",
-                            "-cpu",       "host,+invtsc",
-                            "-no-reboot", "-nographic",
-                            "-smp",       cores_argument.c_str(),
-                            "-m",         "1G,slots=2,maxmem=1T",
-                            "-object",    shmem_file_argument.c_str(),
-                            "-device",    shmem_device_argument.c_str(),
-                            "-monitor",   monitor_file_argument.c_str(),
-                            "-S",         "-kernel",
-                            path.c_str(), nullptr};
+      std::stringstream qmp_file_argument_builder;
+      qmp_file_argument_builder << "unix:" << qmp_file << ",server,nowait";
+      auto qmp_file_argument = qmp_file_argument_builder.str();
+      std::vector<const char*> args = {
+        binary,       "-enable-kvm",
+        "-cpu",       "host,+invtsc",
+        "-no-reboot", "-nographic",
+        "-smp",       cores_argument.c_str(),
+        "-m",         "1G,slots=2,maxmem=1T",
+        "-object",    shmem_file_argument.c_str(),
+        "-device",    shmem_device_argument.c_str(),
+        "-qmp",       qmp_file_argument.c_str(),
+        "-S",         "-kernel",
+        path.c_str()};
+      if (snapshot)
+      {
+        // The machine must be set up as for the snapshot before loading it.
+        args.insert(args.end(), {"-incoming", "defer"});
+      }
+      args.push_back(nullptr);
       posix_spawn(
-        &qemu_pid, binary, nullptr, nullptr, const_cast<char**>(args), nullptr);
-
-      // Wait for QEMU to create the shmem and monitor files.
-      while (!std::filesystem::exists(monitor_file))
+        &qemu_pid,
+        binary,
+        nullptr,
+        nullptr,
+        const_cast<char**>(args.data()),
+        nullptr);
+
+      // QEMU has created the shmem file once it answers on the QMP socket.
+      try
       {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        qmp.emplace(qmp_file);
+      }
+      catch (...)
+      {
+        cleanup();
+        throw;
       }
 
       // Map shared memory into host process.
@@ -225,6 +392,26 @@ namespace monza::host
         throw std::runtime_error(
           "No enough enclave shared memoy for initialization arguments.");
       }
+
+      console.emplace(std::span(shmem_base, SHMEM_SIZE));
+      trace = TraceExport::create(std::span(shmem_base, SHMEM_SIZE));
+      profile = ProfileExport::create(std::span(shmem_base, SHMEM_SIZE));
+      this->metrics.emplace(std::span(shmem_base, SHMEM_SIZE));
+
+      if (snapshot)
+      {
+        try
+        {
+          restore_snapshot(*snapshot);
+        }
+        catch (...)
+        {
+          console->stop();
+          munmap(shmem_base, SHMEM_SIZE);
+          cleanup();
+          throw;
+        }
+      }
     }
 
     void cleanup()
@@ -239,7 +426,7 @@ namespace monza::host
         close(shmem_file_id);
       }
 
-      std::filesystem::remove(monitor_file);
+      std::filesystem::remove(qmp_file);
     }
 
   public:
@@ -247,6 +434,11 @@ namespace monza::host
     {
       if (!joined)
       {
+        // A guest which never ran would never exit by itself.
+        if (!started)
+        {
+          kill(qemu_pid, SIGTERM);
+        }
         join();
       }
 
@@ -261,13 +453,50 @@ namespace monza::host
       *reinterpret_cast<InitializerTuple*>(shmem_base) = initArgs;
     }
 
+    void boot_ahead() override
+    {
+      auto& header = launch_header();
+      header.magic = abi::LAUNCH_MAGIC;
+      header.state.store(abi::LaunchHold, std::memory_order_release);
+      qmp->execute("cont");
+
+      auto deadline = std::chrono::steady_clock::now() + BOOT_TIMEOUT;
+      while (header.state.load(std::memory_order_acquire) != abi::LaunchReady)
+      {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+          throw std::runtime_error("Timed out waiting for the guest to boot.");
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      qmp->execute("stop");
+      held = true;
+    }
+
+    void snapshot(const std::filesystem::path& file) override
+    {
+      if (!held || started)
+      {
+        throw std::logic_error(
+          "Only guests held by boot_ahead can be snapshotted.");
+      }
+      ignore_shared_memory();
+      qmp->execute("migrate", "{\"uri\": " + exec_uri("cat >", file) + "}");
+      wait_for_migration();
+    }
+
     void async_run() override
     {
-      std::stringstream socat_command_builder;
-      socat_command_builder << "echo \"cont\" | socat - unix-connect:"
-                            << monitor_file;
-      auto socat_command = socat_command_builder.str();
-      std::system(socat_command.c_str());
+      if (held)
+      {
+        auto& header = launch_header();
+        header.instance_id = generate_instance_id();
+        header.state.store(
+          restored ? abi::LaunchRestored : abi::LaunchGo,
+          std::memory_order_release);
+      }
+      qmp->execute("cont");
+      started = true;
     }
 
     void join() override
@@ -276,6 +505,15 @@ namespace monza::host
       {
         int status;
         waitpid(qemu_pid, &status, 0);
+        console->stop();
+        if (trace)
+        {
+          trace->write();
+        }
+        if (profile)
+        {
+          profile->write();
+        }
       }
       joined = true;
     }
@@ -289,7 +527,7 @@ namespace monza::host
       if (
         aligned_shmem_offset >= shmem_offset &&
         aligned_shmem_offset + size > aligned_shmem_offset &&
-        aligned_shmem_offset + size < SHMEM_SIZE)
+        aligned_shmem_offset + size < abi::launch_offset(SHMEM_SIZE))
       {
         memset(shmem_base + aligned_shmem_offset, 0, size);
         auto result = std::make_pair(
@@ -323,6 +561,10 @@ namespace monza::host
     uint8_t* shmem_base;
     size_t shmem_offset;
 
+    std::optional<ConsoleDrain> console;
+    std::optional<TraceExport> trace;
+    std::optional<ProfileExport> profile;
+
     bool joined;
 
   protected:
@@ -349,6 +591,11 @@ namespace monza::host
         throw std::runtime_error(
           "Not enough enclave shared memory for initialization arguments.");
       }
+
+      console.emplace(instance->shared_memory());
+      trace = TraceExport::create(instance->shared_memory());
+      profile = ProfileExport::create(instance->shared_memory());
+      this->metrics.emplace(instance->shared_memory());
     }
 
     void cleanup() {}
@@ -378,6 +625,15 @@ namespace monza::host
       if (!joined)
       {
         instance->join();
+        console->stop();
+        if (trace)
+        {
+          trace->write();
+        }
+        if (profile)
+        {
+          profile->write();
+        }
       }
       joined = true;
     }
@@ -391,7 +647,7 @@ namespace monza::host
       if (
         aligned_shmem_offset >= shmem_offset &&
         aligned_shmem_offset + size > aligned_shmem_offset &&
-        aligned_shmem_offset + size < SHMEM_SIZE)
+        aligned_shmem_offset + size < abi::launch_offset(SHMEM_SIZE))
       {
         memset(shmem_base + aligned_shmem_offset, 0, size);
         auto result = std::make_pair(
@@ -448,4 +704,37 @@ namespace monza::host
 #endif // MONZA_HOST_SUPPORTS_HCS
     }
   }
+
+  template<typename T>
+  std::unique_ptr<EnclavePlatform<T>> EnclavePlatform<T>::restore(
+    EnclaveType type,
+    const std::string& path,
+    size_t num_threads,
+    const std::filesystem::path& snapshot)
+  {
+    if (!std::filesystem::exists(path))
+    {
+      throw std::logic_error(fmt::format("No enclave file found at {}", path));
+    }
+    if (!std::filesystem::exists(snapshot))
+    {
+      throw std::logic_error(
+        fmt::format("No snapshot found at {}", snapshot.string()));
+    }
+    switch (type)
+    {
+      case EnclaveType::QEMU:
+#ifdef MONZA_HOST_SUPPORTS_QEMU
+        return std::unique_ptr<EnclavePlatform<T>>(
+          new QemuEnclavePlatform<T>(type, path, num_threads, snapshot));
+#else
+        throw std::logic_error(
+          "QEMU Monza enclaves are not supported in current build");
+#endif // MONZA_HOST_SUPPORTS_QEMU
+      case EnclaveType::HCS:
+      case EnclaveType::HCS_ISOLATED:
+        throw std::logic_error(
+          "HCS Monza enclaves cannot be restored from snapshots");
+    }
+  }
 }
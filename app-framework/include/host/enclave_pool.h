@@ -0,0 +1,108 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <deque>
+#include <enclave_platform.h>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+namespace monza::host
+{
+  /**
+   * Pool of guests of the same image booted ahead of time, so that handing
+   * one out leaves only the resume to the caller. Each guest handed out is
+   * replaced by a new one booted in the background, or restored from a
+   * snapshot if the pool was given one.
+   */
+  template<typename InitializerTuple>
+  class EnclavePool
+  {
+    using Instance = std::unique_ptr<EnclavePlatform<InitializerTuple>>;
+
+    EnclaveType type;
+    std::string path;
+    size_t num_threads;
+    std::optional<std::filesystem::path> snapshot;
+
+    std::mutex lock;
+    std::deque<std::future<Instance>> instances;
+
+    static Instance launch(
+      EnclaveType type,
+      const std::string& path,
+      size_t num_threads,
+      const std::optional<std::filesystem::path>& snapshot)
+    {
+      if (snapshot)
+      {
+        return EnclavePlatform<InitializerTuple>::restore(
+          type, path, num_threads, *snapshot);
+      }
+      auto instance =
+        EnclavePlatform<InitializerTuple>::create(type, path, num_threads);
+      instance->boot_ahead();
+      return instance;
+    }
+
+    void refill()
+    {
+      instances.push_back(std::async(
+        std::launch::async, launch, type, path, num_threads, snapshot));
+    }
+
+  public:
+    EnclavePool(
+      EnclaveType type,
+      const std::string& path,
+      size_t num_threads,
+      size_t size,
+      std::optional<std::filesystem::path> snapshot = std::nullopt)
+    : type(type), path(path), num_threads(num_threads), snapshot(snapshot)
+    {
+      if (size == 0)
+      {
+        throw std::invalid_argument("Pool size must be at least 1.");
+      }
+      for (size_t i = 0; i < size; ++i)
+      {
+        refill();
+      }
+    }
+
+    /**
+     * Wait for all the guests of the pool to finish booting.
+     */
+    void wait_ready()
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      for (auto& instance : instances)
+      {
+        instance.wait();
+      }
+    }
+
+    /**
+     * Hand out the guest which was booted first, waiting for it if it is
+     * still booting. The guest is to be initialized and run as usual.
+     * Rethrows the error if the guest failed to boot.
+     */
+    Instance acquire()
+    {
+      std::future<Instance> next;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        next = std::move(instances.front());
+        instances.pop_front();
+        refill();
+      }
+      return next.get();
+    }
+  };
+}
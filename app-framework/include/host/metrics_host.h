@@ -0,0 +1,137 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <metrics_abi.h>
+#include <span>
+#include <sstream>
+#include <string>
+
+namespace monza::host
+{
+  /**
+   * Host side of the runtime metrics page of a guest. Reads the counters
+   * published by the guest without synchronising with it, so that they can be
+   * sampled while the guest runs.
+   */
+  class MetricsReader
+  {
+    struct MetricDescription
+    {
+      const char* name;
+      const char* help;
+    };
+
+    /**
+     * Prometheus name and help text of each metric, in the order of
+     * abi::Metric.
+     */
+    static constexpr std::array<
+      MetricDescription,
+      static_cast<size_t>(abi::Metric::Count)>
+      DESCRIPTIONS = {{
+        {"monza_ipi_sent_total", "Inter-processor interrupts sent."},
+        {"monza_ipi_received_total", "Inter-processor interrupts received."},
+        {"monza_semaphore_sleeps_total", "Waits on a core semaphore."},
+        {"monza_semaphore_wakes_total",
+         "Wakeups of a core waiting on a semaphore."},
+        {"monza_thread_submissions_total", "Threads submitted to the core."},
+        {"monza_compartment_enters_total", "Compartment invocations."},
+        {"monza_compartment_aborts_total",
+         "Compartment invocations which failed."},
+        {"monza_page_faults_stack_total",
+         "Page faults on the stack of a compartment."},
+        {"monza_page_faults_owned_total",
+         "Page faults on memory owned by a compartment."},
+        {"monza_page_faults_shared_total",
+         "Page faults reading memory owned by Monza core."},
+        {"monza_forwarded_alloc_chunk_total",
+         "Chunk allocations forwarded by compartments."},
+        {"monza_forwarded_lease_chunks_total",
+         "Chunk leases forwarded by compartments."},
+        {"monza_log_bytes_total", "Bytes written to the guest output."},
+        {"monza_log_dropped_total",
+         "Writes to the guest output dropped as the log ring was full."},
+      }};
+
+    const abi::MetricsHeader& header;
+    const abi::MetricsCore* cores;
+
+  public:
+    MetricsReader(std::span<const uint8_t> shared_memory)
+    : header(*reinterpret_cast<const abi::MetricsHeader*>(
+        shared_memory.data() + abi::metrics_offset(shared_memory.size()))),
+      cores(reinterpret_cast<const abi::MetricsCore*>(
+        shared_memory.data() + abi::metrics_offset(shared_memory.size()) +
+        abi::METRICS_HEADER_SIZE))
+    {}
+
+    /**
+     * Whether the guest has published a metrics page which this host
+     * understands.
+     */
+    bool available() const
+    {
+      return header.ready.load(std::memory_order_acquire) != 0 &&
+        header.magic == abi::METRICS_MAGIC &&
+        header.version == abi::METRICS_VERSION;
+    }
+
+    /**
+     * Number of cores with counters, zero until available.
+     */
+    size_t core_count() const
+    {
+      if (!available())
+      {
+        return 0;
+      }
+      return std::min<size_t>(header.core_count, abi::METRICS_MAX_CORES);
+    }
+
+    /**
+     * Current value of a counter of a core, zero if the guest does not count
+     * it.
+     */
+    uint64_t read(size_t core, abi::Metric metric) const
+    {
+      auto index = static_cast<size_t>(metric);
+      if (core >= core_count() || index >= header.counter_count)
+      {
+        return 0;
+      }
+      return cores[core].counters[index].load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Current counters of all cores in the Prometheus text exposition format,
+     * with the core as a label. Empty until available.
+     */
+    std::string prometheus() const
+    {
+      std::ostringstream output;
+      auto count = core_count();
+      if (count == 0)
+      {
+        return {};
+      }
+      for (size_t i = 0; i < DESCRIPTIONS.size(); ++i)
+      {
+        auto& description = DESCRIPTIONS[i];
+        output << "# HELP " << description.name << " " << description.help
+               << "\n# TYPE " << description.name << " counter\n";
+        for (size_t core = 0; core < count; ++core)
+        {
+          output << description.name << "{core=\"" << core << "\"} "
+                 << read(core, static_cast<abi::Metric>(i)) << "\n";
+        }
+      }
+      return output.str();
+    }
+  };
+}
@@ -0,0 +1,74 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <optional>
+#include <profile_abi.h>
+#include <span>
+#include <string>
+#include <utility>
+
+namespace monza::host
+{
+  /**
+   * Host side of the sampling profiler of a guest. Profiling is requested by
+   * setting MONZA_PROFILE_FILE in the environment of the host, to the file
+   * which receives the raw profile region once the guest stopped, and
+   * optionally MONZA_PROFILE_FREQUENCY to the samples per second of each core.
+   * Fold the samples into stacks with utils/profile_to_folded.py.
+   */
+  class ProfileExport
+  {
+    std::span<uint8_t> region;
+    std::string path;
+
+  public:
+    ProfileExport(
+      std::span<uint8_t> region, std::string path, uint64_t frequency)
+    : region(region), path(std::move(path))
+    {
+      auto& header = *reinterpret_cast<abi::ProfileHeader*>(region.data());
+      header.ready.store(0, std::memory_order_relaxed);
+      header.frequency = frequency;
+      std::atomic_thread_fence(std::memory_order_release);
+      header.magic = abi::PROFILE_MAGIC;
+    }
+
+    /**
+     * Request profiling from the guest if MONZA_PROFILE_FILE is set.
+     */
+    static std::optional<ProfileExport> create(std::span<uint8_t> shared_memory)
+    {
+      auto path = getenv("MONZA_PROFILE_FILE");
+      if (path == nullptr)
+      {
+        return std::nullopt;
+      }
+      auto frequency_string = getenv("MONZA_PROFILE_FREQUENCY");
+      uint64_t frequency = frequency_string == nullptr ?
+        0 :
+        std::strtoull(frequency_string, nullptr, 10);
+      return std::make_optional<ProfileExport>(
+        shared_memory.subspan(
+          abi::profile_offset(shared_memory.size()), abi::PROFILE_REGION_SIZE),
+        path,
+        frequency);
+    }
+
+    /**
+     * Write out the profile region. To be called once the guest stopped
+     * running.
+     */
+    void write() const
+    {
+      std::ofstream file(path, std::ios::binary | std::ios::trunc);
+      file.write(
+        reinterpret_cast<const char*>(region.data()),
+        static_cast<std::streamsize>(region.size()));
+    }
+  };
+}
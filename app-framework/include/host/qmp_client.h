@@ -0,0 +1,217 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace monza::host
+{
+  /**
+   * Minimal client for the QEMU Machine Protocol over a unix socket, enough
+   * to control the execution of a guest. Replies are matched by their first
+   * member only, as QMP sends one JSON object per line.
+   */
+  class QmpClient
+  {
+    using clock = std::chrono::steady_clock;
+
+    int socket_fd = -1;
+    std::string pending;
+    clock::duration timeout;
+
+    static int remaining_ms(clock::time_point deadline)
+    {
+      auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+        deadline - clock::now());
+      if (remaining.count() <= 0)
+      {
+        throw std::runtime_error("Timed out waiting for QEMU.");
+      }
+      return static_cast<int>(remaining.count());
+    }
+
+    /**
+     * Wait for path to be created, watching its directory rather than polling
+     * so that the wait ends as soon as QEMU creates the socket.
+     */
+    static void wait_for_file(
+      const std::filesystem::path& path, clock::time_point deadline)
+    {
+      int inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+      if (inotify_fd == -1)
+      {
+        throw std::runtime_error("Failed to watch for the QEMU socket.");
+      }
+      // Watch before checking, so that a creation in between is not missed.
+      if (
+        inotify_add_watch(
+          inotify_fd, path.parent_path().c_str(), IN_CREATE | IN_MOVED_TO) ==
+        -1)
+      {
+        close(inotify_fd);
+        throw std::runtime_error("Failed to watch for the QEMU socket.");
+      }
+      try
+      {
+        while (!std::filesystem::exists(path))
+        {
+          pollfd request{inotify_fd, POLLIN, 0};
+          poll(&request, 1, remaining_ms(deadline));
+          char events[4096];
+          while (read(inotify_fd, events, sizeof(events)) > 0)
+            ;
+        }
+      }
+      catch (...)
+      {
+        close(inotify_fd);
+        throw;
+      }
+      close(inotify_fd);
+    }
+
+    std::string read_line(clock::time_point deadline)
+    {
+      while (true)
+      {
+        auto end = pending.find('\n');
+        if (end != std::string::npos)
+        {
+          auto line = pending.substr(0, end);
+          pending.erase(0, end + 1);
+          return line;
+        }
+        pollfd request{socket_fd, POLLIN, 0};
+        poll(&request, 1, remaining_ms(deadline));
+        char data[4096];
+        auto count = recv(socket_fd, data, sizeof(data), MSG_DONTWAIT);
+        if (count == 0)
+        {
+          throw std::runtime_error("QEMU closed the QMP connection.");
+        }
+        if (count > 0)
+        {
+          pending.append(data, static_cast<size_t>(count));
+        }
+      }
+    }
+
+    /**
+     * Send a command and wait for its reply, skipping asynchronous events.
+     * Returns the reply.
+     */
+    std::string send(const std::string& message)
+    {
+      auto deadline = clock::now() + timeout;
+      auto line = message + "\n";
+      if (
+        ::send(socket_fd, line.data(), line.size(), MSG_NOSIGNAL) !=
+        static_cast<ssize_t>(line.size()))
+      {
+        throw std::runtime_error("Failed to send QMP command.");
+      }
+      while (true)
+      {
+        auto reply = read_line(deadline);
+        if (reply.starts_with("{\"return\""))
+        {
+          return reply;
+        }
+        if (reply.starts_with("{\"error\""))
+        {
+          throw std::runtime_error("QMP command failed: " + reply);
+        }
+      }
+    }
+
+  public:
+    /**
+     * Connect to the QMP socket at path once QEMU creates it, and negotiate
+     * the capabilities. QEMU has finished setting up the machine by the time
+     * this returns.
+     */
+    QmpClient(
+      const std::filesystem::path& path,
+      clock::duration timeout = std::chrono::seconds(10))
+    : timeout(timeout)
+    {
+      auto deadline = clock::now() + timeout;
+      sockaddr_un address{};
+      address.sun_family = AF_UNIX;
+      if (path.native().size() >= sizeof(address.sun_path))
+      {
+        throw std::invalid_argument("QMP socket path is too long.");
+      }
+      std::strcpy(address.sun_path, path.c_str());
+
+      wait_for_file(path, deadline);
+
+      socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (socket_fd == -1)
+      {
+        throw std::runtime_error("Failed to create the QMP socket.");
+      }
+      // The socket may exist shortly before QEMU listens on it.
+      while (connect(
+               socket_fd,
+               reinterpret_cast<sockaddr*>(&address),
+               sizeof(address)) == -1)
+      {
+        if (errno != ECONNREFUSED || clock::now() > deadline)
+        {
+          close(socket_fd);
+          throw std::runtime_error("Failed to connect to QEMU.");
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+
+      try
+      {
+        // Greeting, then leave capabilities negotiation mode.
+        read_line(deadline);
+        send("{\"execute\": \"qmp_capabilities\"}");
+      }
+      catch (...)
+      {
+        close(socket_fd);
+        throw;
+      }
+    }
+
+    QmpClient(const QmpClient&) = delete;
+    QmpClient& operator=(const QmpClient&) = delete;
+
+    ~QmpClient()
+    {
+      close(socket_fd);
+    }
+
+    /**
+     * Run a command, such as "cont" or "stop", and return its reply.
+     * arguments is the JSON object of the arguments of the command, if any.
+     */
+    std::string
+    execute(const std::string& command, const std::string& arguments = "")
+    {
+      if (arguments.empty())
+      {
+        return send("{\"execute\": \"" + command + "\"}");
+      }
+      return send(
+        "{\"execute\": \"" + command + "\", \"arguments\": " + arguments +
+        "}");
+    }
+  };
+}
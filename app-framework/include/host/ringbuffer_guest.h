@@ -3,71 +3,263 @@
 
 #pragma once
 
+#include <adaptive_poller.h>
+#include <atomic>
+#include <ds/messaging.h>
 #include <ds/ring_buffer.h>
 #include <enclave_platform.h>
+#include <memory>
 #include <ringbuffer_initializer.h>
+#include <shared_buffer_pool.h>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 namespace monza::host
 {
+  /**
+   * Size of the buffer pools set up in each direction between the host and
+   * the guest. No pools are set up by default.
+   */
+  struct SharedBufferPoolConfig
+  {
+    size_t buffer_size = 0;
+    size_t buffer_count = 0;
+  };
+
   /**
    * An instance of a guest with the ringbuffers set up to simplify the host
    * application.
+   *
+   * The guest can be given several queues, each a pair of ringbuffers, so
+   * that each can be drained by a different guest core. Messages are then
+   * distributed across the queues by the host, either per flow to keep the
+   * messages of a flow ordered, or round-robin.
    */
   template<size_t BUFFER_SIZE = 2 * 1024 * 1024>
   class RingbufferGuest
   {
+    /**
+     * One queue between the host and the guest. Not movable, as the circuit
+     * and the writer factory refer to the buffer definitions.
+     */
+    struct Queue
+    {
+      SharedMemoryArray<uint8_t> to_guest_ring;
+      SharedMemoryObject<ringbuffer::Offsets> to_guest_ring_offsets;
+      SharedMemoryArray<uint8_t> from_guest_ring;
+      SharedMemoryObject<ringbuffer::Offsets> from_guest_ring_offsets;
+
+      ringbuffer::BufferDef to_guest_def;
+      ringbuffer::BufferDef from_guest_def;
+      ringbuffer::Circuit circuit;
+
+      ringbuffer::WriterFactory base_factory;
+
+      AdaptivePoller poller;
+
+      Queue(EnclavePlatform<RingbufferInitializer>& vm_instance)
+      : to_guest_ring(vm_instance.allocate_shared_array<uint8_t>(BUFFER_SIZE)),
+        to_guest_ring_offsets(
+          vm_instance.allocate_shared<ringbuffer::Offsets>()),
+        from_guest_ring(
+          vm_instance.allocate_shared_array<uint8_t>(BUFFER_SIZE)),
+        from_guest_ring_offsets(
+          vm_instance.allocate_shared<ringbuffer::Offsets>()),
+        to_guest_def({to_guest_ring.host_span.data(),
+                      BUFFER_SIZE,
+                      &(to_guest_ring_offsets.host_object)}),
+        from_guest_def({from_guest_ring.host_span.data(),
+                        BUFFER_SIZE,
+                        &(from_guest_ring_offsets.host_object)}),
+        circuit(to_guest_def, from_guest_def),
+        base_factory(circuit)
+      {}
+
+      void describe(RingbufferQueueInitializer& entry) const
+      {
+        entry.to_guest_buffer_start = to_guest_ring.enclave_start_address;
+        entry.to_guest_buffer_size = BUFFER_SIZE;
+        entry.to_guest_buffer_offsets =
+          to_guest_ring_offsets.enclave_start_address;
+        entry.from_guest_buffer_start = from_guest_ring.enclave_start_address;
+        entry.from_guest_buffer_size = BUFFER_SIZE;
+        entry.from_guest_buffer_offsets =
+          from_guest_ring_offsets.enclave_start_address;
+      }
+    };
+
     std::unique_ptr<EnclavePlatform<RingbufferInitializer>> vm_instance;
 
-    SharedMemoryArray<uint8_t> to_guest_ring;
-    SharedMemoryObject<ringbuffer::Offsets> to_guest_ring_offsets;
-    SharedMemoryArray<uint8_t> from_guest_ring;
-    SharedMemoryObject<ringbuffer::Offsets> from_guest_ring_offsets;
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    /**
+     * Unit of allocation of the pool data, so that buffers are page aligned.
+     */
+    struct alignas(SHARED_BUFFER_ALIGNMENT) SharedBufferPage
+    {
+      uint8_t bytes[SHARED_BUFFER_ALIGNMENT];
+    };
+
+    std::unique_ptr<SharedBufferPool> to_guest_buffers;
+    std::unique_ptr<SharedBufferPool> from_guest_buffers;
 
-    RingbufferInitializer initializer;
+    RingbufferInitializer initializer{};
 
-    ringbuffer::BufferDef to_guest_def;
-    ringbuffer::BufferDef from_guest_def;
-    ringbuffer::Circuit circuit;
+    std::atomic<size_t> next_queue_index = 0;
 
-    ringbuffer::WriterFactory base_factory;
+    /**
+     * Shared buffer pool described to the guest through entry.
+     */
+    std::unique_ptr<SharedBufferPool> create_pool(
+      const SharedBufferPoolConfig& config, SharedBufferPoolInitializer& entry)
+    {
+      auto slots = vm_instance->allocate_shared_array<SharedBufferSlot>(
+        config.buffer_count);
+      auto pages = vm_instance->allocate_shared_array<SharedBufferPage>(
+        config.buffer_count * (config.buffer_size / SHARED_BUFFER_ALIGNMENT));
+      entry.slots_start = slots.enclave_start_address;
+      entry.data_start = pages.enclave_start_address;
+      entry.slot_size = config.buffer_size;
+      entry.slot_count = config.buffer_count;
+      return std::make_unique<SharedBufferPool>(
+        slots.host_span,
+        std::span(
+          reinterpret_cast<uint8_t*>(pages.host_span.data()),
+          pages.host_span.size_bytes()),
+        config.buffer_size);
+    }
 
   public:
+    /**
+     * Set up the rings of a guest with queue_count queues, at most one per
+     * guest core, and optionally a pool of buffers for large payloads in each
+     * direction. The instance may come from an EnclavePool.
+     */
     RingbufferGuest(
-      EnclaveType type, const std::string& path, size_t num_threads)
-    : vm_instance(EnclavePlatform<RingbufferInitializer>::create(
-        type, path, num_threads)),
-      to_guest_ring(vm_instance->allocate_shared_array<uint8_t>(BUFFER_SIZE)),
-      to_guest_ring_offsets(
-        vm_instance->allocate_shared<ringbuffer::Offsets>()),
-      from_guest_ring(vm_instance->allocate_shared_array<uint8_t>(BUFFER_SIZE)),
-      from_guest_ring_offsets(
-        vm_instance->allocate_shared<ringbuffer::Offsets>()),
-      initializer({to_guest_ring.enclave_start_address,
-                   BUFFER_SIZE,
-                   to_guest_ring_offsets.enclave_start_address,
-                   from_guest_ring.enclave_start_address,
-                   BUFFER_SIZE,
-                   from_guest_ring_offsets.enclave_start_address}),
-      to_guest_def({to_guest_ring.host_span.data(),
-                    BUFFER_SIZE,
-                    &(to_guest_ring_offsets.host_object)}),
-      from_guest_def({from_guest_ring.host_span.data(),
-                      BUFFER_SIZE,
-                      &(from_guest_ring_offsets.host_object)}),
-      circuit(to_guest_def, from_guest_def),
-      base_factory(circuit)
+      std::unique_ptr<EnclavePlatform<RingbufferInitializer>> instance,
+      size_t queue_count = 1,
+      SharedBufferPoolConfig pool = {})
+    : vm_instance(std::move(instance))
     {
+      if (
+        queue_count == 0 || queue_count > vm_instance->core_count() ||
+        queue_count > RINGBUFFER_MAX_QUEUES)
+      {
+        throw std::invalid_argument(
+          "Queue count must be between 1 and the number of guest cores.");
+      }
+
+      initializer.queue_count = queue_count;
+      for (size_t i = 0; i < queue_count; ++i)
+      {
+        queues.push_back(std::make_unique<Queue>(*vm_instance));
+        queues.back()->describe(initializer.queues[i]);
+      }
+
+      if (pool.buffer_count != 0)
+      {
+        if (
+          pool.buffer_size == 0 ||
+          pool.buffer_size % SHARED_BUFFER_ALIGNMENT != 0)
+        {
+          throw std::invalid_argument(
+            "Buffer size must be a non-zero multiple of the page size.");
+        }
+        to_guest_buffers = create_pool(pool, initializer.to_guest_pool);
+        from_guest_buffers = create_pool(pool, initializer.from_guest_pool);
+      }
+
       vm_instance->initialize(initializer);
     }
 
-    ringbuffer::WriterPtr writer()
+    /**
+     * Create a guest with num_threads cores and set up its rings.
+     */
+    RingbufferGuest(
+      EnclaveType type,
+      const std::string& path,
+      size_t num_threads,
+      size_t queue_count = 1,
+      SharedBufferPoolConfig pool = {})
+    : RingbufferGuest(
+        EnclavePlatform<RingbufferInitializer>::create(
+          type, path, num_threads),
+        queue_count,
+        pool)
+    {}
+
+    size_t queue_count() const
+    {
+      return queues.size();
+    }
+
+    /**
+     * Queue for the messages of a flow, so that they are handled in order by
+     * the same guest core.
+     */
+    size_t queue_for_flow(uint64_t flow_hash) const
+    {
+      return flow_hash % queues.size();
+    }
+
+    /**
+     * Next queue in round-robin order, for messages which can be handled in
+     * any order.
+     */
+    size_t next_queue()
+    {
+      return next_queue_index.fetch_add(1, std::memory_order_relaxed) %
+        queues.size();
+    }
+
+    ringbuffer::WriterPtr writer(size_t queue = 0)
+    {
+      return queues.at(queue)->base_factory.create_writer_to_inside();
+    }
+
+    ringbuffer::Reader& reader(size_t queue = 0)
+    {
+      return queues.at(queue)->circuit.read_from_inside();
+    }
+
+    /**
+     * Read the pending messages of a queue with bp. Once the queue has been
+     * idle for longer than the calibrated spin window the thread sleeps
+     * between polls instead of spinning. The guest cannot signal the host, so
+     * the sleep interval bounds the latency of an idle queue. Returns the
+     * number of messages read.
+     */
+    size_t poll(messaging::BufferProcessor& bp, size_t queue = 0)
     {
-      return base_factory.create_writer_to_inside();
+      auto& entry = *queues.at(queue);
+      return entry.poller.after_poll(
+        bp.read_all(entry.circuit.read_from_inside()),
+        [](auto timeout) { std::this_thread::sleep_for(timeout); });
     }
 
-    ringbuffer::Reader& reader()
+    /**
+     * Pool owned by the host, to allocate buffers passed to the guest.
+     */
+    SharedBufferPool& to_guest_pool()
     {
-      return circuit.read_from_inside();
+      if (!to_guest_buffers)
+      {
+        throw std::logic_error("Guest created without buffer pools.");
+      }
+      return *to_guest_buffers;
+    }
+
+    /**
+     * Pool owned by the guest, to acquire the buffers passed by the guest.
+     */
+    SharedBufferPool& from_guest_pool()
+    {
+      if (!from_guest_buffers)
+      {
+        throw std::logic_error("Guest created without buffer pools.");
+      }
+      return *from_guest_buffers;
     }
 
     void async_run()
@@ -79,5 +271,10 @@ namespace monza::host
     {
       vm_instance->join();
     }
+
+    std::string metrics_prometheus() const
+    {
+      return vm_instance->metrics_prometheus();
+    }
   };
 }
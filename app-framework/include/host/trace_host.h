@@ -0,0 +1,65 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <trace_abi.h>
+#include <utility>
+
+namespace monza::host
+{
+  /**
+   * Host side of the kernel trace buffers of a guest built with MONZA_TRACING.
+   * Tracing is requested by setting MONZA_TRACE_FILE in the environment of
+   * the host, to the file which receives the raw trace region once the guest
+   * stopped. Convert it with utils/trace_to_chrome.py.
+   */
+  class TraceExport
+  {
+    std::span<uint8_t> region;
+    std::string path;
+
+  public:
+    TraceExport(std::span<uint8_t> region, std::string path)
+    : region(region), path(std::move(path))
+    {
+      auto& header = *reinterpret_cast<abi::TraceHeader*>(region.data());
+      header.ready.store(0, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      header.magic = abi::TRACE_MAGIC;
+    }
+
+    /**
+     * Request tracing from the guest if MONZA_TRACE_FILE is set.
+     */
+    static std::optional<TraceExport> create(std::span<uint8_t> shared_memory)
+    {
+      auto path = getenv("MONZA_TRACE_FILE");
+      if (path == nullptr)
+      {
+        return std::nullopt;
+      }
+      return std::make_optional<TraceExport>(
+        shared_memory.subspan(
+          abi::trace_offset(shared_memory.size()), abi::TRACE_REGION_SIZE),
+        path);
+    }
+
+    /**
+     * Write out the trace region. To be called once the guest stopped running.
+     */
+    void write() const
+    {
+      std::ofstream file(path, std::ios::binary | std::ios::trunc);
+      file.write(
+        reinterpret_cast<const char*>(region.data()),
+        static_cast<std::streamsize>(region.size()));
+    }
+  };
+}
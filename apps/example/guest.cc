@@ -8,17 +8,16 @@
 
 bool success = false;
 
-int app_main(
-  std::unique_ptr<ringbuffer::AbstractWriterFactory> writer_factory,
-  ringbuffer::Reader& reader)
+int app_main_queues(std::span<RingbufferQueue> queues)
 {
+  auto& queue = queues[0];
   messaging::BufferProcessor bp("Guest");
 
   // Set up handler for ping to be used while polling.
   DISPATCHER_SET_MESSAGE_HANDLER(
     bp,
     example::ping,
-    [writer = writer_factory->create_writer_to_outside()](
+    [writer = queue.writer_factory->create_writer_to_outside()](
       const uint8_t* data, size_t size) {
       auto [response] = ringbuffer::read_message<example::ping>(data, size);
       std::cout << "Guest received: " << response << std::endl;
@@ -27,10 +26,10 @@ int app_main(
       success = true;
     });
 
-  // Poll for ping.
+  // Wait for ping, sleeping the core while the queue is idle.
   while (!success)
   {
-    bp.read_all(reader);
+    queue.poll(bp);
   }
 
   return 0;
@@ -62,12 +62,12 @@ int main(int argc, char** argv)
     guest.async_run();
     // Write ping to guest.
     RINGBUFFER_WRITE_MESSAGE(example::ping, guest.writer(), TEST_MESSAGE);
-    // Poll receive buffer until response received.
+    // Poll receive buffer until response received, sleeping while idle.
     auto poll_start = steady_clock::now();
     while (!success &&
            duration_cast<seconds>(steady_clock::now() - poll_start).count() < 1)
     {
-      bp.read_all(guest.reader());
+      guest.poll(bp);
     }
 
     // Clean terminate.
@@ -0,0 +1,112 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include "messages.h"
+
+#include <ds/messaging.h>
+#include <ringbuffer_guest.h>
+#include <thread.h>
+#include <vector>
+
+/**
+ * FNV-1a over the payload, repeated to give each request a fixed cost.
+ */
+static uint64_t hash_payload(const std::string& payload)
+{
+  uint64_t hash = 0xcbf29ce484222325;
+  for (size_t round = 0; round < bench::HASH_ROUNDS; ++round)
+  {
+    for (auto c : payload)
+    {
+      hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3;
+    }
+  }
+  return hash;
+}
+
+/**
+ * Answer the requests of a queue until the host stops it.
+ */
+static void drain_queue(RingbufferQueue& queue)
+{
+  messaging::BufferProcessor bp("Guest");
+  bool stopped = false;
+
+  DISPATCHER_SET_MESSAGE_HANDLER(
+    bp,
+    bench::request,
+    [writer = queue.writer_factory->create_writer_to_outside()](
+      const uint8_t* data, size_t size) {
+      auto [id, payload] = ringbuffer::read_message<bench::request>(data, size);
+      RINGBUFFER_WRITE_MESSAGE(
+        bench::response, writer, id, hash_payload(payload));
+    });
+  DISPATCHER_SET_MESSAGE_HANDLER(
+    bp, bench::stop, [&stopped](const uint8_t*, size_t) { stopped = true; });
+
+  // Echo large payloads through the buffer pools with a single copy. A
+  // response with a zero generation reports a rejected request.
+  DISPATCHER_SET_MESSAGE_HANDLER(
+    bp,
+    bench::bulk_request,
+    [&queue, writer = queue.writer_factory->create_writer_to_outside()](
+      const uint8_t* data, size_t size) {
+      auto [offset, length, generation] =
+        ringbuffer::read_message<bench::bulk_request>(data, size);
+      if (queue.to_guest_pool == nullptr || queue.from_guest_pool == nullptr)
+      {
+        RINGBUFFER_WRITE_MESSAGE(bench::bulk_response, writer, 0, 0, 0);
+        return;
+      }
+      auto request = queue.to_guest_pool->acquire({offset, length, generation});
+      auto response = queue.from_guest_pool->allocate();
+      if (!request || !response || !request->copy_to(response->data()))
+      {
+        RINGBUFFER_WRITE_MESSAGE(bench::bulk_response, writer, 0, 0, 0);
+        return;
+      }
+      auto descriptor = response->share(request->size());
+      RINGBUFFER_WRITE_MESSAGE(
+        bench::bulk_response,
+        writer,
+        descriptor.offset,
+        descriptor.length,
+        descriptor.generation);
+    });
+
+  while (!stopped)
+  {
+    queue.poll(bp);
+  }
+}
+
+int app_main_queues(std::span<RingbufferQueue> queues)
+{
+  size_t num_cores = monza::initialize_threads();
+  if (queues.size() > num_cores)
+  {
+    return -1;
+  }
+
+  // Each queue is drained by its own core, the first one by the main core.
+  std::vector<monza::monza_thread_t> threads;
+  for (size_t i = 1; i < queues.size(); ++i)
+  {
+    auto thread = monza::add_thread(
+      [](void* queue) { drain_queue(*static_cast<RingbufferQueue*>(queue)); },
+      &queues[i]);
+    if (thread == 0)
+    {
+      return -1;
+    }
+    threads.push_back(thread);
+  }
+
+  drain_queue(queues[0]);
+
+  for (auto thread : threads)
+  {
+    monza::join_thread(thread);
+  }
+  return 0;
+}
@@ -0,0 +1,305 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include "messages.h"
+
+#include <chrono>
+#include <cstring>
+#include <ds/messaging.h>
+#include <enclave_pool.h>
+#include <filesystem>
+#include <random>
+#include <ringbuffer_guest.h>
+#include <vector>
+
+using namespace std::chrono;
+
+/**
+ * Smaller rings than the default, so that the largest guests fit their queues
+ * in the shared memory.
+ */
+constexpr size_t BUFFER_SIZE = 256 * 1024;
+constexpr size_t MESSAGE_COUNT = 200000;
+constexpr size_t MAX_IN_FLIGHT = 1024;
+constexpr size_t PAYLOAD_SIZE = 256;
+constexpr auto TIMEOUT = seconds(60);
+
+/**
+ * Large payloads are passed through the buffer pools, which must fit in the
+ * shared memory next to the rings.
+ */
+constexpr size_t BULK_BUFFER_SIZE = 2 * 1024 * 1024;
+constexpr size_t BULK_BUFFER_COUNT = 4;
+constexpr size_t BULK_TRANSFERS = 1000;
+
+constexpr size_t LAUNCHES = 5;
+constexpr size_t LAUNCH_POOL_SIZE = 2;
+
+/**
+ * Send MESSAGE_COUNT requests spread round-robin across queue_count queues,
+ * each drained by its own guest core, and report the throughput.
+ */
+static void run(
+  monza::host::EnclaveType enclave_type,
+  const std::string& guest_path,
+  size_t queue_count)
+{
+  monza::host::RingbufferGuest<BUFFER_SIZE> guest(
+    enclave_type, guest_path, queue_count, queue_count);
+  messaging::BufferProcessor bp("Host");
+
+  size_t received = 0;
+  DISPATCHER_SET_MESSAGE_HANDLER(
+    bp, bench::response, [&received](const uint8_t*, size_t) { ++received; });
+
+  std::vector<ringbuffer::WriterPtr> writers;
+  for (size_t i = 0; i < queue_count; ++i)
+  {
+    writers.push_back(guest.writer(i));
+  }
+  const std::string payload(PAYLOAD_SIZE, 'x');
+
+  guest.async_run();
+
+  auto start = steady_clock::now();
+  size_t sent = 0;
+  while (received < MESSAGE_COUNT)
+  {
+    while (sent < MESSAGE_COUNT && sent - received < MAX_IN_FLIGHT)
+    {
+      RINGBUFFER_WRITE_MESSAGE(
+        bench::request, writers[guest.next_queue()], sent, payload);
+      ++sent;
+    }
+    for (size_t i = 0; i < queue_count; ++i)
+    {
+      bp.read_all(guest.reader(i));
+    }
+    if (steady_clock::now() - start > TIMEOUT)
+    {
+      throw std::runtime_error("Timed out waiting for responses.");
+    }
+  }
+  auto elapsed = duration<double>(steady_clock::now() - start).count();
+
+  for (auto& writer : writers)
+  {
+    RINGBUFFER_WRITE_MESSAGE(bench::stop, writer);
+  }
+  guest.join();
+
+  std::cout << queue_count << "," << MESSAGE_COUNT << "," << elapsed << ","
+            << MESSAGE_COUNT / elapsed << std::endl;
+}
+
+/**
+ * Send BULK_TRANSFERS payloads of BULK_BUFFER_SIZE bytes through the buffer
+ * pools, each echoed back by the guest, and report the throughput.
+ */
+static void run_bulk(
+  monza::host::EnclaveType enclave_type, const std::string& guest_path)
+{
+  monza::host::RingbufferGuest<BUFFER_SIZE> guest(
+    enclave_type, guest_path, 1, 1, {BULK_BUFFER_SIZE, BULK_BUFFER_COUNT});
+  messaging::BufferProcessor bp("Host");
+
+  std::vector<uint8_t> payload(BULK_BUFFER_SIZE);
+  std::independent_bits_engine<std::default_random_engine, 8, uint16_t>
+    generator;
+  for (auto& byte : payload)
+  {
+    byte = static_cast<uint8_t>(generator());
+  }
+
+  size_t received = 0;
+  DISPATCHER_SET_MESSAGE_HANDLER(
+    bp,
+    bench::bulk_response,
+    [&guest, &payload, &received](const uint8_t* data, size_t size) {
+      auto [offset, length, generation] =
+        ringbuffer::read_message<bench::bulk_response>(data, size);
+      auto response =
+        guest.from_guest_pool().acquire({offset, length, generation});
+      if (
+        !response || response->size() != payload.size() ||
+        std::memcmp(
+          response->unsafe_data().data(), payload.data(), payload.size()) != 0)
+      {
+        throw std::runtime_error("Guest returned an invalid payload.");
+      }
+      ++received;
+    });
+
+  auto writer = guest.writer();
+  guest.async_run();
+
+  auto start = steady_clock::now();
+  size_t sent = 0;
+  while (received < BULK_TRANSFERS)
+  {
+    while (sent < BULK_TRANSFERS)
+    {
+      auto request = guest.to_guest_pool().allocate();
+      if (!request)
+      {
+        break;
+      }
+      std::memcpy(request->data().data(), payload.data(), payload.size());
+      auto descriptor = request->share(payload.size());
+      RINGBUFFER_WRITE_MESSAGE(
+        bench::bulk_request,
+        writer,
+        descriptor.offset,
+        descriptor.length,
+        descriptor.generation);
+      ++sent;
+    }
+    bp.read_all(guest.reader());
+    if (steady_clock::now() - start > TIMEOUT)
+    {
+      throw std::runtime_error("Timed out waiting for responses.");
+    }
+  }
+  auto elapsed = duration<double>(steady_clock::now() - start).count();
+
+  RINGBUFFER_WRITE_MESSAGE(bench::stop, writer);
+  guest.join();
+
+  auto bytes = BULK_TRANSFERS * BULK_BUFFER_SIZE;
+  std::cout << BULK_TRANSFERS << "," << bytes << "," << elapsed << ","
+            << bytes / elapsed / (1024 * 1024) << std::endl;
+}
+
+/**
+ * Milliseconds from asking launch for a guest to the first response from it.
+ */
+template<typename Launch>
+static double launch_to_first_message(Launch&& launch)
+{
+  auto start = steady_clock::now();
+  monza::host::RingbufferGuest<BUFFER_SIZE> guest(launch());
+  messaging::BufferProcessor bp("Host");
+
+  bool received = false;
+  DISPATCHER_SET_MESSAGE_HANDLER(
+    bp, bench::response, [&received](const uint8_t*, size_t) {
+      received = true;
+    });
+
+  auto writer = guest.writer();
+  guest.async_run();
+  RINGBUFFER_WRITE_MESSAGE(bench::request, writer, 0, std::string());
+  while (!received)
+  {
+    bp.read_all(guest.reader());
+    if (steady_clock::now() - start > TIMEOUT)
+    {
+      throw std::runtime_error("Timed out waiting for the first response.");
+    }
+  }
+  auto elapsed = duration<double, std::milli>(steady_clock::now() - start);
+
+  RINGBUFFER_WRITE_MESSAGE(bench::stop, writer);
+  guest.join();
+  return elapsed.count();
+}
+
+/**
+ * Compare the time to the first message of guests launched on demand with
+ * guests handed out by a pool which booted them ahead of time, and with
+ * guests restored on demand from a snapshot where supported.
+ */
+static void run_launch(
+  monza::host::EnclaveType enclave_type, const std::string& guest_path)
+{
+  using Platform = monza::host::EnclavePlatform<RingbufferInitializer>;
+
+  for (size_t i = 0; i < LAUNCHES; ++i)
+  {
+    auto elapsed = launch_to_first_message(
+      [&]() { return Platform::create(enclave_type, guest_path, 1); });
+    std::cout << "cold," << elapsed << std::endl;
+  }
+
+  monza::host::EnclavePool<RingbufferInitializer> pool(
+    enclave_type, guest_path, 1, LAUNCH_POOL_SIZE);
+  for (size_t i = 0; i < LAUNCHES; ++i)
+  {
+    pool.wait_ready();
+    auto elapsed = launch_to_first_message([&]() { return pool.acquire(); });
+    std::cout << "pooled," << elapsed << std::endl;
+  }
+
+  if (enclave_type != monza::host::EnclaveType::QEMU)
+  {
+    return;
+  }
+  auto snapshot =
+    std::filesystem::temp_directory_path() / "monza-ringbuffer-bench.snapshot";
+  {
+    auto instance = Platform::create(enclave_type, guest_path, 1);
+    instance->boot_ahead();
+    instance->snapshot(snapshot);
+  }
+  for (size_t i = 0; i < LAUNCHES; ++i)
+  {
+    auto elapsed = launch_to_first_message([&]() {
+      return Platform::restore(enclave_type, guest_path, 1, snapshot);
+    });
+    std::cout << "restored," << elapsed << std::endl;
+  }
+  std::filesystem::remove(snapshot);
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 4)
+  {
+    std::cout << "Usage: apps-ringbuffer-bench-host TYPE PATH_TO_GUEST_IMAGE "
+                 "MAX_QUEUES."
+              << std::endl;
+    exit(-1);
+  }
+  auto enclave_type = monza::host::EnclaveType::QEMU;
+  if (std::string(argv[1]) == "HCS")
+  {
+    enclave_type = monza::host::EnclaveType::HCS;
+  }
+  else if (std::string(argv[1]) == "HCS_ISOLATED")
+  {
+    enclave_type = monza::host::EnclaveType::HCS_ISOLATED;
+  }
+  else if (std::string(argv[1]) == "QEMU")
+  {
+    enclave_type = monza::host::EnclaveType::QEMU;
+  }
+  else
+  {
+    std::cout << "TYPE must be 'HCS', 'HCS_ISOLATED' or 'QEMU'." << std::endl;
+    exit(-1);
+  }
+
+  auto guest_path = std::string(argv[2]);
+  auto max_queues = std::stoul(argv[3]);
+
+  try
+  {
+    std::cout << "queues,messages,seconds,messages_per_second" << std::endl;
+    for (size_t queue_count = 1; queue_count <= max_queues; queue_count *= 2)
+    {
+      run(enclave_type, guest_path, queue_count);
+    }
+
+    std::cout << "transfers,bytes,seconds,mebibytes_per_second" << std::endl;
+    run_bulk(enclave_type, guest_path);
+
+    std::cout << "launch,milliseconds_to_first_message" << std::endl;
+    run_launch(enclave_type, guest_path);
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    exit(-1);
+  }
+  return 0;
+}
@@ -0,0 +1,35 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+#include <ds/ring_buffer_types.h>
+#include <string>
+
+namespace bench
+{
+  enum : ringbuffer::Message
+  {
+    DEFINE_RINGBUFFER_MSG_TYPE(request),
+    DEFINE_RINGBUFFER_MSG_TYPE(response),
+    DEFINE_RINGBUFFER_MSG_TYPE(stop),
+    DEFINE_RINGBUFFER_MSG_TYPE(bulk_request),
+    DEFINE_RINGBUFFER_MSG_TYPE(bulk_response),
+  };
+
+  /**
+   * Rounds of hashing applied by the guest to each request payload, so that
+   * the benchmark is bound by the guest cores draining the queues.
+   */
+  constexpr size_t HASH_ROUNDS = 64;
+}
+
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(bench::request, uint64_t, std::string);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(bench::response, uint64_t, uint64_t);
+DECLARE_RINGBUFFER_MESSAGE_NO_PAYLOAD(bench::stop);
+// Descriptors of shared buffers, as offset, length and generation.
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  bench::bulk_request, uint64_t, uint64_t, uint64_t);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  bench::bulk_response, uint64_t, uint64_t, uint64_t);
@@ -9,9 +9,11 @@ global compartment_exit
 
 extern compartment_forward_exit
 extern compartment_forward_alloc_chunk
+extern compartment_forward_lease_chunks
 extern compartment_forward_alloc_meta_data
 extern compartment_forward_dealloc_chunk
 extern compartment_forward_callback
+extern compartment_forward_fast_callback
 
 extern kernel_pagetable
 
@@ -67,10 +69,32 @@ extern kernel_pagetable
     mov %1, [rsp]
 %endmacro
 
+; Arm CR0.TS so that the first use of extended state by the compartment about
+; to execute traps, unless the compartment already owns the state held in the
+; registers of the core. Registers not holding the state of any compartment
+; hold whatever the kernel left in them, so they are scrubbed like those of any
+; other owner. Monza core releases the ownership whenever it takes over from a
+; compartment, so only a compartment resumed from an interrupt still owns them. Interrupts stay disabled until sysret, so that handlers
+; never execute with CR0.TS armed. See fp.cc.
+; Argument is register containing the pointer to CompartmentBase.
+; Clobbers RAX.
+%macro arm_xstate 1
+    cmp [gs:PCD_XSTATE_OWNER_OFFSET], %1
+    je %%end_arm_xstate
+    cli
+    mov rax, cr0
+    or rax, CR0_TS
+    mov cr0, rax
+    mov byte [gs:PCD_XSTATE_ARMED_OFFSET], 1
+%%end_arm_xstate:
+%endmacro
+
 ; Save the compartment state to be restored on compartment_resume onto the stack.
+; RBP is saved as well, as kernel_enter clears it before running kernel code.
 ; Argument is register which contains compartment RFLAGS.
 %macro save_compartment_state 1
     ;save_registers
+    push rbp
     push %1
 %endmacro
 
@@ -78,6 +102,7 @@ extern kernel_pagetable
 ; This macro will also clear the state from the stack.
 %macro restore_compartment_state 0
     popf
+    pop rbp
     ;restore_registers
 %endmacro
 
@@ -98,12 +123,18 @@ compartment_enter:
     get_thread_execution_context_entry r10
     mov [r10 + THREAD_EXECUTION_CONTEXT_LAST_SP_OFFSET], rsp
 
-    ; Switch the TLS
+    ; Switch the TLS to the instance for the current core
     mov rax, [r9 + COMPARTMENTBASE_TLS_OFFSET]
+    get_per_core_data_macro r10, PCD_CORE_ID_OFFSET
+    mov rax, [rax + r10 * 8]
     set_tls_base_macro rax
 
-    ; Switch CR3
+    ; Hand over the extended state lazily
+    arm_xstate r9
+
+    ; Switch CR3, recording it first for TLB shootdowns
     mov rax, [r9 + COMPARTMENTBASE_PAGETABLE_OFFSET]
+    mov [gs:PCD_COMPARTMENT_PAGETABLE_OFFSET], rax
     mov cr3, rax
 
     ; We set up the target address in RAX for our stub
@@ -128,12 +159,18 @@ compartment_enter:
 ; Implemented in assembly to fully control transition code.
 ; As compared to compartment_enter, there is no need to save the kernel state.
 compartment_resume:
-    ; Switch the TLS
+    ; Switch the TLS to the instance for the current core
     mov rax, [rdx + COMPARTMENTBASE_TLS_OFFSET]
+    get_per_core_data_macro r10, PCD_CORE_ID_OFFSET
+    mov rax, [rax + r10 * 8]
     set_tls_base_macro rax
 
-    ; Switch CR3
+    ; Hand over the extended state lazily
+    arm_xstate rdx
+
+    ; Switch CR3, recording it first for TLB shootdowns
     mov rax, [rdx + COMPARTMENTBASE_PAGETABLE_OFFSET]
+    mov [gs:PCD_COMPARTMENT_PAGETABLE_OFFSET], rax
     mov cr3, rax
 
     ; Set up return value in RAX
@@ -159,6 +196,13 @@ abort_kernel_callback:
     ; Move argument to rsi as it will be used as second argument to compartment_forward_exit.
     mov rsi, rdi
 
+    ; Monza core runs on the kernel CR3, so skip this core in TLB shootdowns.
+    mov qword [gs:PCD_COMPARTMENT_PAGETABLE_OFFSET], 0
+
+    ; The aborted compartment gives up the registers, as the kernel carries on
+    ; with them.
+    release_xstate
+
     ; Reset the kernel state to match the last call to compartment_enter.
     get_thread_execution_context_entry r10
     mov rsp, [r10 + THREAD_EXECUTION_CONTEXT_LAST_SP_OFFSET]
@@ -177,6 +221,9 @@ abort_kernel_callback:
 ; RCX contains the compartment return address and R11 contains the compartment RFLAGS.
 kernel_enter:
     save_compartment_state r11
+    ; Terminate the frame chain of the kernel code, so that profiling never
+    ; follows one that the compartment chose.
+    xor ebp, ebp
     mov rcx, r10
 
     ; Switch CR3 to the kernel one.
@@ -186,6 +233,10 @@ kernel_enter:
     ; Ensure that the per-core data pointer is correct
     reset_per_core_pointer
 
+    ; The kernel CR3 flushed the compartment mappings, so skip this core in
+    ; TLB shootdowns.
+    mov qword [gs:PCD_COMPARTMENT_PAGETABLE_OFFSET], 0
+
     ; Switch the TLS and stack pointers to the kernel ones.
     ; Keep compartment RSP in R11 if we need to return to it later on.
     get_thread_execution_context_entry r10
@@ -194,6 +245,10 @@ kernel_enter:
     mov rax, [r10 + THREAD_EXECUTION_CONTEXT_TLS_OFFSET]
     set_tls_base_macro rax
 
+    ; The kernel may use extended state before resuming the compartment, so
+    ; the compartment gives up the registers and resuming it arms again.
+    release_xstate
+
     ; Switch for reason to enter kernel, default is to process compartment exit.
     ; Check reasons for compartment_return.
     cmp rdi, SYSCALL_COMPARTMENT_RETURN
@@ -207,6 +262,20 @@ kernel_enter:
     ; Tail-return out of compartment_enter
     ret
 .not_return:
+    ; Check reasons for compartment_fast_callback.
+    ; Checked early as it is the most latency-sensitive transition.
+    cmp rdi, SYSCALL_COMPARTMENT_FAST_CALLBACK
+    jne .not_fast_callback
+    ; Handle compartment_fast_callback.
+    get_compartment_from_state rdi
+    push r11
+    call compartment_forward_fast_callback
+    pop r11
+    mov rdi, rax
+    mov rsi, r11
+    get_compartment_from_state rdx
+    jmp compartment_resume
+.not_fast_callback:
     ; Check reasons for compartment_alloc_chunk.
     cmp rdi, SYSCALL_COMPARTMENT_ALLOC_CHUNK
     jne .not_alloc_chunk
@@ -220,6 +289,19 @@ kernel_enter:
     get_compartment_from_state rdx
     jmp compartment_resume
 .not_alloc_chunk:
+    ; Check reasons for compartment_lease_chunks.
+    cmp rdi, SYSCALL_COMPARTMENT_LEASE_CHUNKS
+    jne .not_lease_chunks
+    ; Handle compartment_lease_chunks.
+    get_compartment_from_state rdi
+    push r11
+    call compartment_forward_lease_chunks
+    pop r11
+    mov rdi, rax
+    mov rsi, r11
+    get_compartment_from_state rdx
+    jmp compartment_resume
+.not_lease_chunks:
     ; Check reasons for compartment_alloc_meta_data.
     cmp rdi, SYSCALL_COMPARTMENT_ALLOC_META_DATA
     jne .not_alloc_meta_data
@@ -275,6 +357,8 @@ SYSCALL_COMPARTMENT_ALLOC_CHUNK     EQU 2
 SYSCALL_COMPARTMENT_ALLOC_META_DATA EQU 3
 SYSCALL_COMPARTMENT_DEALLOC_CHUNK   EQU 4 
 SYSCALL_COMPARTMENT_CALLBACK        EQU 5
+SYSCALL_COMPARTMENT_FAST_CALLBACK   EQU 6
+SYSCALL_COMPARTMENT_LEASE_CHUNKS    EQU 7
 
 ; Matches class CompartmentBase in compartment.h.
 COMPARTMENTBASE_PAGETABLE_OFFSET    EQU 0x0
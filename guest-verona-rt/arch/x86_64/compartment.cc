@@ -41,6 +41,12 @@ namespace monza
       syscall(SYSCALL_COMPARTMENT_ALLOC_CHUNK, size, ras));
   }
 
+  void* compartment_lease_chunks(size_t size, uintptr_t ras, size_t count)
+  {
+    return reinterpret_cast<void*>(
+      syscall(SYSCALL_COMPARTMENT_LEASE_CHUNKS, size, ras, count));
+  }
+
   void* compartment_alloc_meta_data(size_t size)
   {
     return reinterpret_cast<void*>(
@@ -56,4 +62,11 @@ namespace monza
   {
     syscall(SYSCALL_COMPARTMENT_CALLBACK, index, ret, data);
   }
+
+  uintptr_t compartment_fast_callback(
+    size_t index, uintptr_t arg0, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3)
+  {
+    return syscall(
+      SYSCALL_COMPARTMENT_FAST_CALLBACK, index, arg0, arg1, arg2, arg3);
+  }
 }
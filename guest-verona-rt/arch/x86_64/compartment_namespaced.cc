@@ -13,6 +13,12 @@ namespace monza
       syscall(SYSCALL_COMPARTMENT_ALLOC_CHUNK, size, ras));
   }
 
+  void* compartment_lease_chunks(size_t size, uintptr_t ras, size_t count)
+  {
+    return reinterpret_cast<void*>(
+      syscall(SYSCALL_COMPARTMENT_LEASE_CHUNKS, size, ras, count));
+  }
+
   void compartment_dealloc_chunk(void* p, size_t size)
   {
     syscall(SYSCALL_COMPARTMENT_DEALLOC_CHUNK, p, size);
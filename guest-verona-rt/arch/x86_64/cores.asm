@@ -6,6 +6,9 @@ global acquire_semaphore.loop_suspend
 global acquire_semaphore.loop_hlt
 global ap_reset
 global wakeup_handler
+global tlb_flush_handler
+global timer_handler
+global profile_start_handler
 global ap_reset_handler
 
 extern executing_cores
@@ -16,10 +19,13 @@ extern idtr
 extern current_cr0
 extern current_cr3
 extern current_cr4
+extern current_xcr0
 extern current_gs
 extern finished_with_current
 
 extern ap_init
+extern timer_expired
+extern start_core_profiling
 
 %include "macros.asm"
 
@@ -52,6 +58,7 @@ acquire_semaphore:
 ; Starting point for non-primary cores to wait for work to be posted to them.
 ap_reset:
     call [ap_init]
+    call start_core_profiling
 .loop:
     ; Use RBX for table base address so it survives the function call
     get_thread_execution_context_entry rbx
@@ -81,22 +88,104 @@ align 8
 wakeup_handler:
     push rdi
     push rax
+    push rdx
+
+    ; The IPI might arrive in a compartment, so ensure that the per-core data pointer is correct and load the kernel
+    ; pagetable, as compartment pagetables map neither the local APIC nor the metrics page.
+    reset_per_core_pointer
+    swap_kernel_cr3 rdx, 0x20
 
     ; Increment generation counter to notify that at least one IPI has executed.
     get_per_core_data_address_macro rdi, PCD_NOT_GEN_OFFSET
     lock inc qword [rdi]
+    count_metric_macro METRIC_IPI_RECEIVED
+
+    reset_suspend_check 0x18
+
+    ; Acknowledge the IPI
+    mov rdi, [local_apic_mapping]
+    xor eax, eax
+    mov [rdi + 0xB0], eax
+
+    restore_swapped_cr3 rdx
+    pop rdx
+    pop rax
+    pop rdi
+    iretq
+
+; Interrupt handler flushing the non-global TLB entries of the core by reloading CR3.
+; Used for shootdown of compartment mappings on cores executing the same compartment.
+align 8
+tlb_flush_handler:
+    push rdi
+    push rax
+    push rdx
+
+    ; The interrupt might arrive in a compartment, so ensure that the per-core data pointer is correct.
+    reset_per_core_pointer
+
+    ; Loading the kernel pagetable in a compartment flushes the entries as well, and maps the local APIC and the
+    ; metrics page until the compartment pagetable is restored. Otherwise reload the current one.
+    swap_kernel_cr3 rdx, 0x20
+    test rdx, rdx
+    jnz .flushed
+    mov rax, cr3
+    mov cr3, rax
+.flushed:
 
-    reset_suspend_check 0x10
+    ; Increment the dedicated counter to notify that the flush has completed.
+    ; Wakeups increment another counter, so they cannot stand in for the flush.
+    get_per_core_data_address_macro rdi, PCD_TLB_FLUSH_GEN_OFFSET
+    lock inc dword [rdi]
+    count_metric_macro METRIC_IPI_RECEIVED
 
     ; Acknowledge the IPI
     mov rdi, [local_apic_mapping]
     xor eax, eax
     mov [rdi + 0xB0], eax
 
+    restore_swapped_cr3 rdx
+    pop rdx
     pop rax
     pop rdi
     iretq
 
+; Interrupt handler for the expiry of the local APIC timer of the core, shared by the watchdog and the profiler.
+; Does not return if it aborts the invocation of the interrupted compartment.
+align 8
+timer_handler:
+    interrupt_prelude_no_status
+
+    ; Acknowledge the interrupt
+    mov rdi, [local_apic_mapping]
+    xor eax, eax
+    mov [rdi + 0xB0], eax
+
+    ; RBX holds the pagetable of the interrupted compartment, 0 if the interrupt arrived in the kernel.
+    mov rdi, rbx
+    mov rsi, r12        ; Trap frame as second argument
+    call timer_expired
+    interrupt_conclusion
+
+; Interrupt handler starting to sample the core, for cores which were already running when profiling was set up.
+; Increments the notification generation like the wakeup, so that the sender can wait for it.
+align 8
+profile_start_handler:
+    interrupt_prelude_no_status
+
+    ; Acknowledge the IPI
+    mov rdi, [local_apic_mapping]
+    xor eax, eax
+    mov [rdi + 0xB0], eax
+
+    ; The prelude loaded the kernel pagetable, which maps the metrics page.
+    get_per_core_data_address_macro rdi, PCD_NOT_GEN_OFFSET
+    lock inc qword [rdi]
+    count_metric_macro METRIC_IPI_RECEIVED
+
+    call start_core_profiling
+    interrupt_conclusion
+
 align 8
 ; Emulates Hyper-V core init which will also set up system registers.
 ap_reset_handler:
@@ -106,6 +195,11 @@ ap_reset_handler:
     mov cr0, rax
     mov rax, [current_cr4]
     mov cr4, rax
+    ; XCR0 requires CR4.OSXSAVE
+    mov rax, [current_xcr0]
+    xor edx, edx
+    xor ecx, ecx
+    xsetbv
     mov rax, [current_gs]
     wrgsbase rax
     ; Set up FS and stack pointer for the core using pre-allocated region
@@ -1,11 +1,14 @@
 // Copyright Microsoft and Project Monza Contributors.
 // SPDX-License-Identifier: MIT
 
+#include <atomic>
 #include <cores.h>
 #include <hypervisor.h>
+#include <metrics.h>
 #include <per_core_data.h>
 #include <snmalloc.h>
 #include <tls.h>
+#include <trace.h>
 
 // Globals accessed from assembly so avoid namespacing
 snmalloc::TrivialInitAtomic<size_t> executing_cores;
@@ -18,6 +21,11 @@ namespace monza
     return PerCoreData::get_num_cores();
   }
 
+  size_t get_current_core()
+  {
+    return PerCoreData::get()->core_id;
+  }
+
   ThreadExecutionContext& get_thread_execution_context(size_t core_id)
   {
     return PerCoreData::get(core_id)->thread_execution_context;
@@ -29,20 +37,32 @@ namespace monza
   }
 
   /**
-   * Send an synchronous IPI to destination core to ping it.
-   * Returns after the target core has executed the IPI handler at least once.
+   * Send an IPI with the given vector to the destination core.
+   * Returns after the target core has executed a handler incrementing the
+   * notification generation at least once.
    */
-  void ping_core_sync(size_t core_id)
+  static void notify_core_sync(size_t core_id, uint8_t vector)
   {
+    MONZA_TRACE(IpiSend, core_id, vector);
     size_t generation_after_update =
       PerCoreData::get(core_id)->notification_generation.load();
     do
     {
-      trigger_ipi(core_id, 0x80);
+      trigger_ipi(core_id, vector);
+      count_metric(abi::Metric::IpiSent);
     } while (generation_after_update ==
              PerCoreData::get(core_id)->notification_generation.load());
   }
 
+  /**
+   * Send an synchronous IPI to destination core to ping it.
+   * Returns after the target core has executed the IPI handler at least once.
+   */
+  void ping_core_sync(size_t core_id)
+  {
+    notify_core_sync(core_id, 0x80);
+  }
+
   /**
    * Send an synchronous IPI to all cores to ping them.
    * Skips the current core, since that will not be delivered on x64.
@@ -59,4 +79,60 @@ namespace monza
       }
     }
   }
+
+  /**
+   * Flush the non-global TLB entries on the other cores which may hold
+   * mappings of the compartment pagetable and wait for them to complete. Used
+   * to remove stale compartment mappings after they were removed from the
+   * pagetable. Must not be called with locks held which the targets may wait
+   * for with interrupts masked.
+   *
+   * Cores record the pagetable before loading it, while the pagetable was
+   * updated before checking the records, so a core entering the compartment
+   * concurrently either is flushed or loads the updated pagetable. Returning
+   * to Monza core reloads CR3 and clears the record. The current core is
+   * skipped for the same reason.
+   */
+  void flush_tlb_cores_sync(void* pagetable_root)
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    size_t current_core = PerCoreData::get()->core_id;
+    size_t num_cores = PerCoreData::get_num_cores();
+    for (size_t c = 0; c < num_cores; ++c)
+    {
+      auto core_data = PerCoreData::get(c);
+      if (
+        c == current_core ||
+        core_data->compartment_pagetable.load(std::memory_order_acquire) !=
+          reinterpret_cast<uintptr_t>(pagetable_root))
+      {
+        continue;
+      }
+      MONZA_TRACE(IpiSend, c, 0x82);
+      auto generation = core_data->tlb_flush_generation.load();
+      do
+      {
+        trigger_ipi(c, 0x82);
+        count_metric(abi::Metric::IpiSent);
+      } while (generation == core_data->tlb_flush_generation.load());
+    }
+  }
+
+  /**
+   * Start sampling on the other cores which were already reset, as they only
+   * arm the profile timer when reset. Used when profiling is set up again
+   * after a restore. The current core is skipped, as it starts itself.
+   */
+  void start_profiling_cores_sync()
+  {
+    size_t current_core = PerCoreData::get()->core_id;
+    size_t num_cores = PerCoreData::get_num_cores();
+    for (size_t c = 0; c < num_cores; ++c)
+    {
+      if (c != current_core && get_thread_execution_context(c).tls_ptr)
+      {
+        notify_core_sync(c, 0x84);
+      }
+    }
+  }
 }
@@ -5,6 +5,7 @@
 #include <crt.h>
 #include <cstdint>
 #include <emmintrin.h>
+#include <fp.h>
 #include <hardware_io.h>
 #include <logging.h>
 #include <per_core_data.h>
@@ -20,6 +21,7 @@ uint8_t* local_apic_mapping = nullptr;
 snmalloc::TrivialInitAtomic<size_t> current_cr0;
 snmalloc::TrivialInitAtomic<size_t> current_cr3;
 snmalloc::TrivialInitAtomic<size_t> current_cr4;
+snmalloc::TrivialInitAtomic<size_t> current_xcr0;
 snmalloc::TrivialInitAtomic<size_t> current_gs;
 snmalloc::TrivialInitAtomic<size_t> finished_with_current;
 
@@ -315,11 +317,16 @@ namespace monza
   {
     size_t temp;
     asm volatile("mov %%cr0, %0" : "=a"(temp));
-    current_cr0.store(temp, std::memory_order_release);
+    // The waker might be in the middle of a lazy extended state switch.
+    current_cr0.store(temp & ~CR0_TS, std::memory_order_release);
     asm volatile("mov %%cr3, %0" : "=a"(temp));
     current_cr3.store(temp, std::memory_order_release);
     asm volatile("mov %%cr4, %0" : "=a"(temp));
     current_cr4.store(temp, std::memory_order_release);
+    uint32_t xcr0_low;
+    uint32_t xcr0_high;
+    asm volatile("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+    current_xcr0.store(xcr0_low, std::memory_order_release);
     current_gs.store(snmalloc::address_cast(PerCoreData::get(core)));
     finished_with_current.store(0);
     trigger_ipi_generic(core, 0x81);
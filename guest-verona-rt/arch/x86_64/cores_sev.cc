@@ -139,6 +139,7 @@ namespace monza
     asm volatile("mov %%cr4, %%rax" : "=a"(new_vmsa->cr4));
     asm volatile("mov %%cr3, %%rax" : "=a"(new_vmsa->cr3));
     asm volatile("mov %%cr0, %%rax" : "=a"(new_vmsa->cr0));
+    new_vmsa->cr0 &= ~CR0_TS;
     asm volatile("pushf; pop %%rax" : "=a"(new_vmsa->rflags));
     // Set state from firmware
     new_vmsa->guest_tsc_scale = tsc_state.scale;
@@ -5,6 +5,9 @@ extern print_exception
 extern shutdown
 
 extern wakeup_handler
+extern tlb_flush_handler
+extern timer_handler
+extern profile_start_handler
 extern hv_handler
 extern page_fault_handler
 
@@ -49,6 +52,8 @@ global idtr
 
 %macro print_and_halt 1
     set_kernel_cr3 INT_CS_OFFSET
+    ; The state of the compartment does not matter as the system halts.
+    clts
     mov rdi, %1
     mov rsi, [rsp + INT_ERR_OFFSET]
     mov rdx, [rsp + INT_RIP_OFFSET]
@@ -88,7 +93,7 @@ setup_idt_generic:
     install_exception_gate 04, 04
     install_exception_gate 05, 05
     install_exception_gate 06, 06
-    install_exception_gate 07, 07
+    install_exception_gate 07, device_not_available
     install_exception_gate 08, 08
     install_exception_gate 09, 09
     install_exception_gate 10, 10
@@ -124,6 +129,12 @@ setup_idt_generic:
     ; Add custom interrupt handlers
     mov ecx, 0x80 * 16
     install_interrupt_gate wakeup_handler
+    mov ecx, 0x82 * 16
+    install_interrupt_gate tlb_flush_handler
+    mov ecx, 0x83 * 16
+    install_interrupt_gate timer_handler
+    mov ecx, 0x84 * 16
+    install_interrupt_gate profile_start_handler
 
     lidt [idtr]			    ; Load the content of IDT register with the newly set up table
 
@@ -149,9 +160,6 @@ exception_gate_05:
 exception_gate_06:
     print_and_halt_no_status ex_string_06
 
-exception_gate_07:
-    print_and_halt_no_status ex_string_07
-
 exception_gate_08:
     print_and_halt ex_string_08
 
@@ -191,11 +199,18 @@ exception_gate_30:
 exception_gate_reserved:
     print_and_halt_no_status ex_string_res
 
+; Raised on the first use of extended state by a compartment which does not own
+; the state held in the registers of the core.
+; interrupt_prelude hands the state over, so there is nothing else to do.
+exception_gate_device_not_available:
+    interrupt_prelude_no_status
+    interrupt_conclusion
+
 exception_gate_breakpoint:
     interrupt_prelude_no_status
     mov rdi, ex_string_03
-    mov rsi, [rsp + TRAP_REGS_END + INT_ERR_OFFSET]
-    mov rdx, [rsp + TRAP_REGS_END + INT_RIP_OFFSET]
+    mov rsi, [r12 + TRAP_REGS_END + INT_ERR_OFFSET]
+    mov rdx, [r12 + TRAP_REGS_END + INT_RIP_OFFSET]
     call print_exception
     interrupt_conclusion
 
@@ -203,7 +218,7 @@ exception_gate_pagefault:
     interrupt_prelude
     mov rdi, cr2        ; Faulting address as first argument
     mov rsi, rbx        ; Page table root as second argument
-    mov rdx, rsp        ; Trap frame as third argument
+    mov rdx, r12        ; Trap frame as third argument
     call page_fault_handler
     interrupt_conclusion
 
@@ -220,7 +235,6 @@ ex_string_03    db "Exception Raised: Breakpoint", 0
 ex_string_04    db "Exception Raised: Overflow", 0
 ex_string_05    db "Exception Raised: Bound Range Exceeded", 0
 ex_string_06    db "Exception Raised: Invalid Opcode", 0
-ex_string_07    db "Exception Raised: Device Not Available", 0
 ex_string_08    db "Exception Raised: Double Fault", 0
 ex_string_09    db "Exception Raised: Coprocessor Segment Overrun", 0
 ex_string_10    db "Exception Raised: Invalid TSS", 0
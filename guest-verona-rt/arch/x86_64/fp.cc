@@ -1,7 +1,59 @@
 // Copyright Microsoft and Project Monza Contributors.
 // SPDX-License-Identifier: MIT
 
+#include <cpuid.h>
 #include <fp.h>
+#include <per_core_data.h>
 
 const uint32_t mxcsr = 0x1F80;
 const uint16_t fp_control = 0x037F;
+const monza::InitialExtendedState xstate_init_area{.mxcsr = mxcsr};
+size_t xstate_area_size = 0;
+
+namespace monza
+{
+  /**
+   * Extended register state (x87, SSE, AVX and AVX-512) is switched lazily
+   * between compartments. Every transition is a function call under the SysV
+   * ABI, so none of the vector registers are live across it and the state of a
+   * compartment never needs to be saved. It only needs to be scrubbed before
+   * another compartment can observe it.
+   *
+   * Each core tracks the compartment whose state its registers hold. Entering
+   * any other compartment sets CR0.TS, including when no compartment owns the
+   * registers yet and they hold state left by the kernel, so that its first
+   * use of extended state raises #NM, which loads the initial state before
+   * making it the owner.
+   * Compartments which never use extended state do not pay for the scrub.
+   *
+   * The kernel is trusted with the state of every compartment, but may leave
+   * its own data or that of other compartments in the registers, for example
+   * after a vectorised copy. Every transition into the kernel therefore drops
+   * the ownership of the compartment, so that it scrubs the registers again
+   * on its next use of extended state after a callback.
+   *
+   * Interrupts and exceptions are not calls, so the state of the interrupted
+   * context is live when their handlers run. interrupt_prelude saves it on
+   * the interrupt stack and interrupt_conclusion restores it, see
+   * macros.asm.
+   *
+   * Called when a compartment is destroyed, so that a compartment later
+   * allocated at the same address cannot take over stale ownership.
+   */
+  void release_extended_state(uintptr_t owner)
+  {
+    for (size_t i = 0; i < PerCoreData::get_num_cores(); ++i)
+    {
+      auto expected = owner;
+      PerCoreData::get(i)->xstate_owner.compare_exchange_strong(
+        expected, XSTATE_OWNER_STALE);
+    }
+  }
+
+  void setup_extended_state()
+  {
+    uint32_t eax, ebx, ecx, edx;
+    __cpuid_count(0xD, 0, eax, ebx, ecx, edx);
+    xstate_area_size = ebx;
+  }
+}
@@ -1,8 +1,42 @@
 // Copyright Microsoft and Project Monza Contributors.
 // SPDX-License-Identifier: MIT
 
+#pragma once
+
+#include <cstddef>
 #include <cstdint>
 
+namespace monza
+{
+  /**
+   * XSAVE area in standard format holding the initial extended state.
+   * The header is empty, so XRSTOR initializes every component, while MXCSR
+   * is always loaded from the legacy region.
+   */
+  struct alignas(64) InitialExtendedState
+  {
+    uint8_t x87_state[24]{};
+    uint32_t mxcsr;
+    uint8_t legacy_state[484]{};
+    uint8_t header[64]{};
+  };
+  static_assert(sizeof(InitialExtendedState) == 576);
+
+  // Task-switched flag in CR0, armed to trap the first use of extended state.
+  static constexpr size_t CR0_TS = 0x8;
+  // Owner of the extended state of a core after its compartment was destroyed.
+  static constexpr uintptr_t XSTATE_OWNER_STALE = 1;
+
+  /**
+   * Record the size of the XSAVE area for the components enabled in XCR0,
+   * used by interrupt handlers to preserve the interrupted state. Must run
+   * before interrupts are enabled.
+   */
+  void setup_extended_state();
+}
+
 // Outside of namespace to be accesible from ASM.
 extern const uint32_t mxcsr;
-extern const uint16_t fp_control;
\ No newline at end of file
+extern const uint16_t fp_control;
+extern const monza::InitialExtendedState xstate_init_area;
+extern size_t xstate_area_size;
@@ -37,4 +37,5 @@ namespace monza
 
   void setup_gdt();
   void setup_compartments();
+  void setup_watchdog();
 }
@@ -7,6 +7,10 @@ extern per_core_tss
 extern per_core_data
 extern acquire_semaphore.loop_suspend
 extern acquire_semaphore.loop_hlt
+extern xstate_init_area
+extern xstate_area_size
+extern metrics_cores
+extern kernel_pagetable
 
 ; Sets the TLS base address (FS).
 ; Does not clobber any registers.
@@ -152,6 +156,21 @@ extern acquire_semaphore.loop_hlt
     wrgsbase rax
 %endmacro
 
+; Add one to a counter in the metrics page of the current core, if set up.
+; Only valid with the kernel pagetable loaded, as compartment pagetables do not map the metrics page.
+; Takes 1 constant argument:
+;   Index of the counter, matching enum Metric in metrics_abi.h.
+; Clobbers RAX and RDI.
+%macro count_metric_macro 1
+    mov rdi, [metrics_cores]
+    test rdi, rdi
+    jz %%end_count_metric
+    mov eax, [gs:PCD_CORE_ID_OFFSET]
+    shl rax, METRICS_CORE_LOG2_SIZE
+    lock inc qword [rdi + rax + %1 * 8]
+%%end_count_metric:
+%endmacro
+
 ; Check if interrupt is racing the check of the semaphore before halt.
 ; If it is, then force the check to restart from the top of the loop on resume.
 ; This enforces the atomicity of the check-and-halt sequence and avoids lost notifications.
@@ -168,16 +187,93 @@ extern acquire_semaphore.loop_hlt
 .end_reset_suspend_check:
 %endmacro
 
+; Hand the extended register state of the core over to the compartment which
+; entered last on it, if CR0.TS is armed as another compartment owns the state.
+; The initial state is loaded first so that the state of the previous owner
+; cannot be observed by the compartment. See fp.cc.
+; Takes 1 argument:
+;   Register containing the thread execution context of the current core.
+; Clobbers RAX and RDX.
+%macro claim_xstate 1
+    cmp byte [gs:PCD_XSTATE_ARMED_OFFSET], 0
+    je %%end_claim_xstate
+    clts
+    mov byte [gs:PCD_XSTATE_ARMED_OFFSET], 0
+    mov rax, [%1 + THREAD_EXECUTION_CONTEXT_LAST_SP_OFFSET]
+    mov rax, [rax]
+    mov [gs:PCD_XSTATE_OWNER_OFFSET], rax
+    mov eax, -1
+    mov edx, -1
+    xrstor [xstate_init_area]
+%%end_claim_xstate:
+%endmacro
+
+; Drop the ownership of the extended register state of the core when Monza
+; core takes over from a compartment, as the kernel may leave its own state or
+; that of other compartments in the registers. The next entry into any
+; compartment then arms CR0.TS again. If still armed, CR0.TS is cleared so that
+; the kernel can use the registers, without scrubbing them as it is trusted.
+; See fp.cc.
+; Does not clobber any registers.
+%macro release_xstate 0
+    mov qword [gs:PCD_XSTATE_OWNER_OFFSET], 0
+    cmp byte [gs:PCD_XSTATE_ARMED_OFFSET], 0
+    je %%end_release_xstate
+    clts
+    mov byte [gs:PCD_XSTATE_ARMED_OFFSET], 0
+%%end_release_xstate:
+%endmacro
+
+; Save the extended register state of the interrupted context in an XSAVE
+; area below the trap frame. Handlers run compiled code which may use the
+; registers, and unlike across the calls of a transition the state of the
+; interrupted context is live. The trap frame stays at R12 for the handler.
+; Must run with CR0.TS clear.
+; Clobbers RAX and RDX.
+%macro save_xstate 0
+    mov r12, rsp
+    sub rsp, [xstate_area_size]
+    and rsp, -64
+    ; XSAVE only writes the bits of XSTATE_BV for the enabled components, and
+    ; XRSTOR faults unless the rest of the header is zero.
+    xor eax, eax
+%assign header_offset 0
+%rep XSAVE_HEADER_SIZE / 8
+    mov [rsp + XSAVE_HEADER_OFFSET + header_offset], rax
+%assign header_offset header_offset + 8
+%endrep
+    mov eax, -1
+    mov edx, -1
+    xsave64 [rsp]
+%endmacro
+
+; Restore the extended register state saved by save_xstate and return to the
+; trap frame.
+; Clobbers RAX and RDX.
+%macro restore_xstate 0
+    mov eax, -1
+    mov edx, -1
+    xrstor64 [rsp]
+    mov rsp, r12
+%endmacro
+
 %macro interrupt_prelude 0
     save_regs
     swap_kernel_cr3 rbx, TRAP_REGS_END + INT_CS_OFFSET
     reset_per_core_pointer
     ; Switch the TLS pointer to the kernel one.
-    ; Preserve the current TLS pointer in RBP.
-    get_tls_base_macro rbp
+    ; Preserve the current TLS pointer in R13.
+    get_tls_base_macro r13
     get_thread_execution_context_entry r10
     mov rax, [r10 + THREAD_EXECUTION_CONTEXT_TLS_OFFSET]
     set_tls_base_macro rax
+    ; Take the registers over for a compartment which did not use them yet, so
+    ; that they can be saved.
+    claim_xstate r10
+    save_xstate
+    ; Terminate the frame chain of the handler, so that profiling never follows
+    ; one that the interrupted code chose. The trap frame keeps the old RBP.
+    xor ebp, ebp
 %endmacro
 
 %macro interrupt_prelude_no_status 0
@@ -186,9 +282,10 @@ extern acquire_semaphore.loop_hlt
 %endmacro
 
 %macro interrupt_conclusion 0
+    restore_xstate
     restore_swapped_cr3 rbx
     ; Restore the TLS pointer.
-    set_tls_base_macro rbp
+    set_tls_base_macro r13
     reset_suspend_check TRAP_REGS_END + INT_RIP_OFFSET
     restore_regs
     ; Account for the error code in the stack.
@@ -223,8 +320,25 @@ PCD_SELF_OFFSET     EQU 0
 PCD_CORE_ID_OFFSET  EQU 0x8
 PCD_NOT_GEN_OFFSET  EQU 0x10
 PCD_TEC_OFFSET      EQU 0x18
+PCD_XSTATE_OWNER_OFFSET EQU 0x50
+PCD_XSTATE_ARMED_OFFSET EQU 0x59
+PCD_TLB_FLUSH_GEN_OFFSET EQU 0x5C
+PCD_COMPARTMENT_PAGETABLE_OFFSET EQU 0x78
 PCD_LOG2_SIZE       EQU 7
 
+; Matches metrics_abi.h.
+METRICS_CORE_LOG2_SIZE  EQU 9
+METRIC_IPI_RECEIVED     EQU 1
+
+; Matches the standard format of the XSAVE area.
+XSAVE_HEADER_OFFSET EQU 512
+XSAVE_HEADER_SIZE   EQU 64
+
+; Extended state components enabled in XCR0 when supported by the processor:
+; x87, SSE, AVX, AVX-512 opmask, ZMM_Hi256 and Hi16_ZMM.
+XCR0_SUPPORTED      EQU 0xE7
+CR0_TS              EQU 0x8
+
 
 ; Matches struct ThreadExecutionContext in cores.h.
 THREAD_EXECUTION_CONTEXT_CODE_OFFSET    EQU 0x0
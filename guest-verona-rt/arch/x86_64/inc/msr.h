@@ -7,6 +7,7 @@
 
 namespace monza
 {
+  constexpr uint32_t MSR_IA32_TSC_DEADLINE = 0x6E0;
   constexpr uint32_t MSR_IA32_EFER = 0xC0000080;
   constexpr uint32_t MSR_IA32_STAR = 0xC0000081;
   constexpr uint32_t MSR_IA32_LSTAR = 0xC0000082;
@@ -33,8 +33,29 @@ namespace monza
     ThreadExecutionContext thread_execution_context{};
     // Hypervisor-specific data.
     void* hypervisor_input_page = nullptr;
+    // Compartment whose extended register state is held in the registers of
+    // the core. Zero if they hold no compartment state, see fp.cc.
+    snmalloc::TrivialInitAtomic<uintptr_t> xstate_owner{};
     uint8_t apic_id = 0;
-    uint8_t padding[47]{};
+    // Set while CR0.TS is armed to trap the first use of extended state.
+    uint8_t xstate_armed = 0;
+    // Set once the local APIC timer of the core is set up, see watchdog.cc.
+    uint8_t timer_configured = 0;
+    uint8_t timer_padding[1]{};
+    // Generation counter incremented only once the core has flushed its TLB
+    // in response to a shootdown.
+    snmalloc::TrivialInitAtomic<uint32_t> tlb_flush_generation{};
+    // Tick at which the watchdog of the core fires. Zero if disarmed.
+    uint64_t watchdog_deadline = 0;
+    // Tick at which the next profiling sample of the core is taken. Zero if
+    // the core is not sampled.
+    uint64_t profile_deadline = 0;
+    // Tick at which a core sleeping in wait_for_write wakes up. Zero if the
+    // core is not waiting.
+    uint64_t wait_deadline = 0;
+    // Pagetable of the compartment last entered on the core, set before it is
+    // loaded and cleared on entry into Monza core. Zero if none.
+    snmalloc::TrivialInitAtomic<uintptr_t> compartment_pagetable{};
 
     static PerCoreData initial;
 
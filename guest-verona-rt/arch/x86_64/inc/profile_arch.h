@@ -0,0 +1,16 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+#include <trap.h>
+
+namespace monza
+{
+  bool arm_profile_timer(uint64_t deadline);
+  uint64_t profile_sample(
+    uintptr_t interrupted_pagetable, TrapFrame* frame, uint64_t now);
+}
+
+extern "C" void start_core_profiling();
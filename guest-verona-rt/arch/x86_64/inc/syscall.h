@@ -13,6 +13,8 @@ namespace monza
     SYSCALL_COMPARTMENT_ALLOC_META_DATA = 3,
     SYSCALL_COMPARTMENT_DEALLOC_CHUNK = 4,
     SYSCALL_COMPARTMENT_CALLBACK = 5,
+    SYSCALL_COMPARTMENT_FAST_CALLBACK = 6,
+    SYSCALL_COMPARTMENT_LEASE_CHUNKS = 7,
   };
 
   /**
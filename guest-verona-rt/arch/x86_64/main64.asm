@@ -60,12 +60,20 @@ start:
     mov cr4, rax
     ldmxcsr [mxcsr]
 
-    ; Update XCR0 with the enabled bits for FPU/SSE/AVX
-    ; Can enable AVX in the future by also setting bit 2
-    xor rcx, rcx
-    xgetbv         ; Load XCR0 register
+    ; Update XCR0 with the enabled bits for FPU/SSE/AVX/AVX-512
+    ; Only enable the components supported by the processor, as reported by
+    ; CPUID leaf 0xD, and never the supervisor or MPX ones
+    ; CPUID clobbers RBX, which holds the Zero Page
+    push rbx
+    mov eax, 0xD
+    xor ecx, ecx
+    cpuid
+    pop rbx
+    and eax, XCR0_SUPPORTED
     or eax, 3      ; Set SSE, X87 bits
-    xsetbv         ; Save back to XCR0
+    xor edx, edx
+    xor ecx, ecx
+    xsetbv         ; Save to XCR0
 
     ; Call the hypervisor here using the early stack
     ; This will guarantee that the regular stack and BSS are available
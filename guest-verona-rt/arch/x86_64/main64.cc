@@ -5,6 +5,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <early_alloc.h>
+#include <fp.h>
 #include <heap.h>
 #include <hypervisor.h>
 #include <per_core_data.h>
@@ -35,11 +36,13 @@ namespace monza
     setup_hypervisor_stage2();
     setup_gdt();
     setup_compartments();
+    setup_watchdog();
     setup_pagetable();
     for (auto& range : HeapRanges::additional())
     {
       fixed_handle.add_range(nullptr, range.data(), range.size());
     }
+    setup_extended_state();
     setup_idt();
 
     monza_main();
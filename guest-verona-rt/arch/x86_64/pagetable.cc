@@ -97,7 +97,35 @@ namespace monza
     }
   }
 
-  template<bool is_kernel, PagetableLevels level>
+  template<PagetableLevels level>
+  static inline size_t count_pagetable_nodes(PagetableEntry* root)
+  {
+    size_t count = 1;
+    if constexpr (level != PAGETABLE_LOWEST_LEVEL)
+    {
+      for (size_t index = 0; index < pagetable_entry_count(); ++index)
+      {
+        if (root[index].is_persistent())
+        {
+          continue;
+        }
+        PagetableEntry* next_root = root[index].next_level();
+        if (next_root == nullptr)
+        {
+          continue;
+        }
+        count += count_pagetable_nodes<next_pagetable_level(level)>(next_root);
+      }
+    }
+    return count;
+  }
+
+  /**
+   * Map [base, base + size) into the pagetable with the given permission.
+   * If keep_existing is set, leaves which are already mapped are left
+   * untouched rather than overwritten.
+   */
+  template<bool is_kernel, PagetableLevels level, bool keep_existing = false>
   static inline void add_to_pagetable(
     PagetableEntry* root,
     snmalloc::address_t base,
@@ -120,10 +148,12 @@ namespace monza
         }
         size_t next_size =
           std::min(base + size, pagetable_next_entry_base(addr, level)) - addr;
-        add_to_pagetable<is_kernel, next_pagetable_level(level)>(
-          next_root, addr, next_size, perm);
+        add_to_pagetable<
+          is_kernel,
+          next_pagetable_level(level),
+          keep_existing>(next_root, addr, next_size, perm);
       }
-      else
+      else if (!keep_existing || !root[index].notnull())
       {
         root[index].set_leaf<is_kernel>(addr, type, perm, level);
       }
@@ -320,6 +350,12 @@ namespace monza
     deallocate_pagetable<false, PML4_LEVEL>(static_cast<PagetableEntry*>(root));
   }
 
+  size_t count_compartment_pagetable_pages(void* root)
+  {
+    return count_pagetable_nodes<PML4_LEVEL>(
+      static_cast<PagetableEntry*>(root));
+  }
+
   void add_to_compartment_pagetable(
     void* root, snmalloc::address_t base, size_t size, PagetablePermission perm)
   {
@@ -334,6 +370,20 @@ namespace monza
       static_cast<PagetableEntry*>(root), base, size, perm);
   }
 
+  void add_missing_to_compartment_pagetable(
+    void* root, snmalloc::address_t base, size_t size, PagetablePermission perm)
+  {
+    if (base % PAGE_SIZE != 0 || size % PAGE_SIZE != 0)
+    {
+      LOG_MOD(ERROR, Pagetable)
+        << "Invalid alignment of base (" << base << ") or size (" << size
+        << ") of range when trying to expand pagetable." << LOG_ENDL;
+      kabort();
+    }
+    add_to_pagetable<false, PML4_LEVEL, true>(
+      static_cast<PagetableEntry*>(root), base, size, perm);
+  }
+
   void remove_from_compartment_pagetable(
     void* root, snmalloc::address_t base, size_t size)
   {
@@ -0,0 +1,248 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <atomic>
+#include <compartment.h>
+#include <cores.h>
+#include <cstdint>
+#include <logging.h>
+#include <new>
+#include <per_core_data.h>
+#include <profile.h>
+#include <profile_abi.h>
+#include <profile_arch.h>
+#include <shared.h>
+#include <snmalloc.h>
+#include <trap.h>
+
+extern char __stack_start;
+extern char __stack_end;
+extern size_t __stack_size;
+
+namespace monza
+{
+  extern const uint64_t tsc_freq;
+
+  /**
+   * Shortest interval between two samples on a core, so that a high requested
+   * frequency cannot starve the core of anything but sampling.
+   */
+  constexpr uint64_t MIN_PROFILE_PERIOD = 100'000;
+  /**
+   * Largest distance between two consecutive frame records which is accepted
+   * by the stack walk.
+   */
+  constexpr uintptr_t MAX_FRAME_SIZE = 1024 * 1024;
+
+  static uint8_t* profile_cores = nullptr;
+  static size_t profile_core_count = 0;
+  static size_t profile_core_stride = 0;
+  static size_t profile_samples_per_core = 0;
+  // Ticks between two samples of a core. Zero unless the host requested
+  // profiling.
+  static uint64_t profile_period = 0;
+
+  /**
+   * Split the profile region between the cores if the host requested
+   * profiling at the end of the IO shared memory, then start sampling the
+   * current core. Other cores start sampling as they are reset.
+   */
+  void setup_profiling()
+  {
+    auto shared_range = get_io_shared_range();
+    if (
+      shared_range.size() < abi::CONSOLE_REGION_SIZE +
+        abi::TRACE_REGION_SIZE + abi::PROFILE_REGION_SIZE)
+    {
+      return;
+    }
+    auto region =
+      shared_range.data() + abi::profile_offset(shared_range.size());
+    auto header = reinterpret_cast<abi::ProfileHeader*>(region);
+    if (
+      *reinterpret_cast<volatile uint64_t*>(&header->magic) !=
+      abi::PROFILE_MAGIC)
+    {
+      return;
+    }
+    if (!watchdog_supported())
+    {
+      LOG_MOD(WARNING, Profile)
+        << "Profiling requested, but the timer is unavailable." << LOG_ENDL;
+      return;
+    }
+
+    auto frequency = *reinterpret_cast<volatile uint64_t*>(&header->frequency);
+    if (frequency == 0)
+    {
+      frequency = abi::PROFILE_DEFAULT_FREQUENCY;
+    }
+
+    auto core_count = get_core_count();
+    auto stride = snmalloc::bits::align_down(
+      (abi::PROFILE_REGION_SIZE - abi::PROFILE_HEADER_SIZE) / core_count,
+      abi::PROFILE_CORE_HEADER_SIZE);
+    auto samples_per_core =
+      (stride - abi::PROFILE_CORE_HEADER_SIZE) / sizeof(abi::ProfileSample);
+    auto cores = region + abi::PROFILE_HEADER_SIZE;
+    for (size_t i = 0; i < core_count; ++i)
+    {
+      new (cores + i * stride) abi::ProfileCoreHeader{0};
+    }
+
+    header->tsc_frequency = tsc_freq;
+    header->core_count = core_count;
+    header->core_stride = stride;
+    header->samples_per_core = samples_per_core;
+    header->ready.store(1, std::memory_order_release);
+
+    profile_core_stride = stride;
+    profile_samples_per_core = samples_per_core;
+    profile_core_count = core_count;
+    profile_cores = cores;
+    profile_period = std::max(tsc_freq / frequency, MIN_PROFILE_PERIOD);
+
+    start_core_profiling();
+  }
+
+  /**
+   * Start sampling the current core if profiling is enabled.
+   */
+  extern "C" void start_core_profiling()
+  {
+    if (profile_period == 0)
+    {
+      return;
+    }
+    arm_profile_timer(snmalloc::Aal::tick() + profile_period);
+  }
+
+#ifdef MONZA_FRAME_POINTERS
+  /**
+   * Bounds of the kernel stack of a core. Core 0 runs on the boot stack, the
+   * other cores on the stacks allocated by initialize_threads.
+   */
+  struct StackRange
+  {
+    uintptr_t start;
+    uintptr_t end;
+  };
+
+  static StackRange kernel_stack_range(size_t core_id)
+  {
+    auto top = reinterpret_cast<uintptr_t>(
+      get_thread_execution_context(core_id).stack_ptr);
+    if (core_id == 0)
+    {
+      return {
+        reinterpret_cast<uintptr_t>(&__stack_start),
+        reinterpret_cast<uintptr_t>(&__stack_end)};
+    }
+    return {top - __stack_size, top};
+  }
+
+  /**
+   * Whether a frame record lies within the kernel stack being walked, so that
+   * the walk never copies any other memory into the samples.
+   */
+  static bool is_frame_record(uintptr_t address, const StackRange& stack)
+  {
+    auto end = address + 2 * sizeof(uint64_t);
+    if (address % alignof(uint64_t) != 0 || end < address)
+    {
+      return false;
+    }
+    return address >= stack.start && end <= stack.end;
+  }
+
+  /**
+   * Follow the chain of frame records from frame_pointer, recording the
+   * return addresses. Each record must be above the previous one on the given
+   * stack, which bounds the walk even for a corrupted chain.
+   */
+  static uint32_t walk_frames(
+    uintptr_t frame_pointer,
+    const StackRange& stack,
+    uint64_t* frames,
+    uint32_t& flags)
+  {
+    uint32_t count = 0;
+    while (is_frame_record(frame_pointer, stack))
+    {
+      auto record = reinterpret_cast<const uint64_t*>(frame_pointer);
+      if (record[1] == 0)
+      {
+        break;
+      }
+      if (count == abi::PROFILE_MAX_FRAMES)
+      {
+        flags |= abi::ProfileTruncated;
+        break;
+      }
+      frames[count++] = record[1];
+
+      auto next = static_cast<uintptr_t>(record[0]);
+      if (next <= frame_pointer || next - frame_pointer > MAX_FRAME_SIZE)
+      {
+        break;
+      }
+      frame_pointer = next;
+    }
+    return count;
+  }
+#endif
+
+  /**
+   * Record the interrupted state of the current core. Called from the timer
+   * interrupt with the pagetable of the interrupted compartment, or zero if
+   * Monza core was interrupted. Returns the deadline of the next sample.
+   */
+  uint64_t profile_sample(
+    uintptr_t interrupted_pagetable, TrapFrame* frame, uint64_t now)
+  {
+    auto core_id = get_current_core();
+    if (profile_cores == nullptr || core_id >= profile_core_count)
+    {
+      return 0;
+    }
+
+    auto core = profile_cores + core_id * profile_core_stride;
+    auto core_header = reinterpret_cast<abi::ProfileCoreHeader*>(core);
+    auto samples = reinterpret_cast<abi::ProfileSample*>(
+      core + abi::PROFILE_CORE_HEADER_SIZE);
+    auto position =
+      core_header->write_position.load(std::memory_order_relaxed);
+    auto& sample = samples[position % profile_samples_per_core];
+
+    uint32_t flags = 0;
+    sample.tick = now;
+    sample.owner = 0;
+    if (interrupted_pagetable != 0)
+    {
+      void* kernel_sp =
+        PerCoreData::get()->thread_execution_context.last_stack_ptr;
+      CompartmentBase* compartment =
+        *reinterpret_cast<CompartmentBase**>(static_cast<uint8_t*>(kernel_sp));
+      sample.owner = compartment->get_owner().as_uintptr_t();
+      flags |= abi::ProfileInCompartment;
+    }
+    sample.rip = frame->rip;
+    sample.frame_count = 0;
+#ifdef MONZA_FRAME_POINTERS
+    // The frame pointer of a compartment is under its control, so following
+    // it would copy arbitrary kernel memory into the host-visible samples.
+    // Monza core clears it on every entry, and the walk stays on the kernel
+    // stack that the core was interrupted on.
+    if (interrupted_pagetable == 0)
+    {
+      sample.frame_count = walk_frames(
+        frame->rbp, kernel_stack_range(core_id), sample.frames, flags);
+    }
+#endif
+    sample.flags = flags;
+
+    core_header->write_position.store(position + 1, std::memory_order_release);
+    return now + profile_period;
+  }
+}
@@ -6,18 +6,62 @@
 #include <crt.h>
 #include <heap.h>
 #include <logging.h>
+#include <metrics.h>
 #include <pagetable.h>
 #include <per_core_data.h>
 #include <snmalloc.h>
+#include <trace.h>
 #include <trap.h>
 
 namespace monza
 {
+  /**
+   * Map the page containing address together with the contiguous pages around
+   * it which lie within the fault-around window of the compartment, are heap
+   * memory and have the same owner. Pages already mapped keep their existing
+   * permission, so neighbouring grants are never downgraded.
+   *
+   * Returns the number of pages in the mapped range.
+   */
+  static size_t map_fault_around(
+    CompartmentBase* compartment,
+    void* pagetable_root,
+    snmalloc::address_t address,
+    CompartmentOwner owner,
+    PagetablePermission perm)
+  {
+    auto window_size = compartment->get_fault_around_size();
+    auto window_base = snmalloc::bits::align_down(address, window_size);
+    auto window_end = window_base + window_size;
+
+    auto matches = [owner](snmalloc::address_t page) {
+      return HeapRanges::is_heap_address(page) &&
+        snmalloc::MonzaCompartmentOwnership::get_monza_owner<true>(page) ==
+        owner;
+    };
+
+    auto base = snmalloc::address_align_down<PAGE_SIZE>(address);
+    auto end = base + PAGE_SIZE;
+    while (base > window_base && matches(base - PAGE_SIZE))
+    {
+      base -= PAGE_SIZE;
+    }
+    while (end < window_end && matches(end))
+    {
+      end += PAGE_SIZE;
+    }
+
+    add_missing_to_compartment_pagetable(
+      pagetable_root, base, end - base, perm);
+    return (end - base) / PAGE_SIZE;
+  }
+
   extern "C" void page_fault_handler(
     snmalloc::address_t address, void* pagetable_root, TrapFrame* frame)
   {
     bool is_kernel = (frame->err & 0x4) == 0;
     bool is_write = (frame->err & 0x2) != 0;
+    MONZA_TRACE(PageFault, address, frame->err);
 
     if (is_kernel)
     {
@@ -41,6 +85,9 @@ namespace monza
         PerCoreData::get()->thread_execution_context.last_stack_ptr;
       CompartmentBase* compartment =
         *reinterpret_cast<CompartmentBase**>(static_cast<uint8_t*>(kernel_sp));
+      // Hold the pagetable lock so that ownership cannot be removed by
+      // another core executing the compartment before the mapping is added.
+      snmalloc::FlagLock lock(compartment->get_pagetable_lock());
       auto owner =
         snmalloc::MonzaCompartmentOwnership::get_monza_owner<true>(address);
       if (owner == compartment->get_owner())
@@ -50,24 +97,22 @@ namespace monza
         if (compartment->is_active_stack(address))
         {
           compartment->update_active_stack_usage(address);
+          compartment->record_page_fault(1);
+          count_metric(abi::Metric::PageFaultStack);
         }
         else
         {
-          add_to_compartment_pagetable(
-            pagetable_root,
-            snmalloc::address_align_down<PAGE_SIZE>(address),
-            PAGE_SIZE,
-            PT_COMPARTMENT_WRITE);
+          compartment->record_page_fault(map_fault_around(
+            compartment, pagetable_root, address, owner, PT_COMPARTMENT_WRITE));
+          count_metric(abi::Metric::PageFaultOwned);
         }
         return;
       }
       else if (!is_write && owner == CompartmentOwner::null())
       {
-        add_to_compartment_pagetable(
-          pagetable_root,
-          snmalloc::address_align_down<PAGE_SIZE>(address),
-          PAGE_SIZE,
-          PT_COMPARTMENT_READ);
+        compartment->record_page_fault(map_fault_around(
+          compartment, pagetable_root, address, owner, PT_COMPARTMENT_READ));
+        count_metric(abi::Metric::PageFaultShared);
         return;
       }
       else
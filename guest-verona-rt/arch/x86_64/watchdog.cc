@@ -0,0 +1,296 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <arch_compartment.h>
+#include <callback.h>
+#include <confidential.h>
+#include <cpuid.h>
+#include <cstdint>
+#include <logging.h>
+#include <msr.h>
+#include <per_core_data.h>
+#include <profile_arch.h>
+#include <snmalloc.h>
+#include <trap.h>
+
+extern uint8_t* local_apic_mapping;
+
+namespace monza
+{
+  extern const uint64_t tsc_freq;
+
+  constexpr uint32_t CPUID_MONITOR_FLAG = 1 << 3;
+  constexpr uint32_t CPUID_TSC_DEADLINE_FLAG = 1 << 24;
+  constexpr size_t LAPIC_LVT_TIMER_OFFSET = 0x320;
+  constexpr uint32_t LVT_TIMER_MODE_TSC_DEADLINE = 0b10 << 17;
+  constexpr uint32_t TIMER_VECTOR = 0x83;
+  /**
+   * Delay before checking again for an expired invocation if the watchdog
+   * fires while Monza core is servicing the compartment, which cannot be
+   * interrupted at an arbitrary point.
+   */
+  constexpr uint64_t WATCHDOG_RETRY_TICKS = 100'000;
+  constexpr uint64_t NS_IN_S = 1'000'000'000;
+  /**
+   * Longest sleep in wait_for_write, which bounds the latency of noticing
+   * writes where MONITOR and MWAIT are unavailable.
+   */
+  constexpr uint64_t WAIT_MAX_NS = 1'000'000'000;
+  /**
+   * Treat interrupts as wakeup events of MWAIT even while they are masked.
+   */
+  constexpr uint32_t MWAIT_INTERRUPT_BREAK = 1;
+
+  static bool watchdog_available = false;
+  static bool monitor_available = false;
+
+  /**
+   * Deadline of the innermost invocation of the current thread, zero if it
+   * has none. The armed deadline can belong to an enclosing invocation, in
+   * which case the innermost one is unwound without being blamed for it.
+   * Nested invocations always run on the thread and core of the enclosing
+   * one, so this is equivalent to tracking it per core.
+   */
+  static thread_local uint64_t invocation_deadline = 0;
+
+  /**
+   * The watchdog uses the local APIC timer in TSC-deadline mode, so that
+   * deadlines are expressed in the same ticks as compartment usage. The timer
+   * is shared with the sampling profiler and with cores waiting for a write,
+   * and fires at the earliest of the deadlines of the core.
+   * Unavailable on platforms without a local APIC accessible to the guest.
+   * MONITOR and MWAIT are intercepted on confidential platforms, so they are
+   * only used elsewhere.
+   */
+  void setup_watchdog()
+  {
+    uint32_t unused;
+    uint32_t features;
+    __get_cpuid(1, &unused, &unused, &features, &unused);
+    watchdog_available = local_apic_mapping != nullptr &&
+      (features & CPUID_TSC_DEADLINE_FLAG) != 0;
+    monitor_available =
+      !is_confidential() && (features & CPUID_MONITOR_FLAG) != 0;
+  }
+
+  bool watchdog_supported()
+  {
+    return watchdog_available;
+  }
+
+  /**
+   * Earlier of two deadlines, either of which may be zero if disarmed.
+   */
+  static uint64_t earliest(uint64_t first, uint64_t second)
+  {
+    if (first == 0 || (second != 0 && second < first))
+    {
+      return second;
+    }
+    return first;
+  }
+
+  /**
+   * Earliest deadline armed on the current core, zero if none is.
+   */
+  static uint64_t next_timer_deadline(PerCoreData* core_data)
+  {
+    return earliest(
+      core_data->watchdog_deadline,
+      earliest(core_data->profile_deadline, core_data->wait_deadline));
+  }
+
+  static void program_timer(PerCoreData* core_data)
+  {
+    if (core_data->timer_configured == 0)
+    {
+      *reinterpret_cast<volatile uint32_t*>(
+        local_apic_mapping + LAPIC_LVT_TIMER_OFFSET) =
+        LVT_TIMER_MODE_TSC_DEADLINE | TIMER_VECTOR;
+      core_data->timer_configured = 1;
+    }
+    write_msr(MSR_IA32_TSC_DEADLINE, next_timer_deadline(core_data));
+  }
+
+  /**
+   * Start an invocation with the given deadline, zero if it has none, and arm
+   * the watchdog of the current core to fire at it, unless an earlier
+   * deadline is already armed. Returns the deadlines from before, to be passed
+   * to restore_watchdog.
+   */
+  WatchdogDeadlines arm_watchdog(uint64_t deadline)
+  {
+    auto core_data = PerCoreData::get();
+    WatchdogDeadlines previous{
+      core_data->watchdog_deadline, invocation_deadline};
+    invocation_deadline = deadline;
+    if (
+      !watchdog_available || deadline == 0 ||
+      (previous.armed != 0 && previous.armed <= deadline))
+    {
+      return previous;
+    }
+
+    core_data->watchdog_deadline = deadline;
+    program_timer(core_data);
+    return previous;
+  }
+
+  /**
+   * Restore the deadlines returned by arm_watchdog at the end of the
+   * invocation, disarming the watchdog if the armed one is zero.
+   */
+  void restore_watchdog(WatchdogDeadlines previous)
+  {
+    invocation_deadline = previous.invocation;
+    auto core_data = PerCoreData::get();
+    if (core_data->watchdog_deadline == previous.armed)
+    {
+      return;
+    }
+    core_data->watchdog_deadline = previous.armed;
+    program_timer(core_data);
+  }
+
+  /**
+   * Check whether the armed deadline of the current core passed, in which
+   * case the invocation it belongs to is about to be aborted.
+   */
+  bool watchdog_expired()
+  {
+    auto watchdog = PerCoreData::get()->watchdog_deadline;
+    return watchdog != 0 && snmalloc::Aal::tick() >= watchdog;
+  }
+
+  /**
+   * Take the first profiling sample of the current core at deadline. Returns
+   * false if the timer is unavailable.
+   */
+  bool arm_profile_timer(uint64_t deadline)
+  {
+    if (!watchdog_available)
+    {
+      return false;
+    }
+    auto core_data = PerCoreData::get();
+    core_data->profile_deadline = deadline;
+    program_timer(core_data);
+    return true;
+  }
+
+  /**
+   * Sleep the current core while the value at address is unchanged, until an
+   * interrupt is delivered to it or the timeout passes. Where MONITOR and
+   * MWAIT are available a write to the address, by the host or by another
+   * core, wakes the core at once. Elsewhere such a write is only noticed at the
+   * next interrupt or at the timeout, which bounds the latency. Returns at once
+   * on platforms without the timer to bound the sleep.
+   * Should never be called from a compartment.
+   */
+  void wait_for_write(
+    const volatile uint64_t* address, uint64_t value, uint64_t timeout_ns)
+  {
+    if (!watchdog_available)
+    {
+      snmalloc::Aal::pause();
+      return;
+    }
+
+    // Convert whole seconds and the remainder separately, so that neither
+    // product can overflow regardless of the clamp.
+    auto core_data = PerCoreData::get();
+    auto wait_ns = std::min(timeout_ns, WAIT_MAX_NS);
+    auto deadline = snmalloc::Aal::tick() + (wait_ns / NS_IN_S) * tsc_freq +
+      ((wait_ns % NS_IN_S) * tsc_freq) / NS_IN_S;
+
+    // Interrupts stay masked until the core sleeps, so that the timer cannot
+    // fire between the check of the value and the sleep.
+    asm volatile("cli" ::: "memory");
+    core_data->wait_deadline = deadline;
+    program_timer(core_data);
+    if (monitor_available)
+    {
+      asm volatile("monitor" : : "a"(address), "c"(0), "d"(0) : "memory");
+      if (*address == value)
+      {
+        asm volatile("mwait"
+                     :
+                     : "a"(0), "c"(MWAIT_INTERRUPT_BREAK)
+                     : "memory");
+      }
+    }
+    else if (*address == value)
+    {
+      // STI only takes effect after HLT, which the timer then always wakes.
+      asm volatile("sti; hlt; cli" ::: "memory");
+    }
+    core_data->wait_deadline = 0;
+    program_timer(core_data);
+    asm volatile("sti" ::: "memory");
+  }
+
+  /**
+   * Called on the expiry of the timer of the core with the pagetable of the
+   * interrupted compartment, or zero if Monza core was interrupted, and the
+   * interrupted register state.
+   *
+   * A profiling sample is taken if one is due. A compartment which exceeded
+   * the deadline of its invocation is aborted as if it faulted, returning to
+   * the matching compartment_enter. If the deadline belongs to an enclosing
+   * invocation instead, the interrupted one is unwound without invalidating
+   * its compartment, and the check repeats until the compartment which
+   * exceeded its deadline runs again and is aborted. Monza core is never
+   * aborted, so expiry while it services a compartment is checked again
+   * shortly after.
+   */
+  extern "C" void
+  timer_expired(uintptr_t interrupted_pagetable, TrapFrame* frame)
+  {
+    auto core_data = PerCoreData::get();
+    auto now = snmalloc::Aal::tick();
+
+    auto profile = core_data->profile_deadline;
+    if (profile != 0 && now >= profile)
+    {
+      core_data->profile_deadline =
+        profile_sample(interrupted_pagetable, frame, now);
+    }
+
+    // The waiting core only needed the interrupt to wake up.
+    if (core_data->wait_deadline != 0 && now >= core_data->wait_deadline)
+    {
+      core_data->wait_deadline = 0;
+    }
+
+    auto watchdog = core_data->watchdog_deadline;
+    if (watchdog == 0 || now < watchdog)
+    {
+      write_msr(MSR_IA32_TSC_DEADLINE, next_timer_deadline(core_data));
+      return;
+    }
+
+    // The expired deadline stays armed until restored, so check again
+    // shortly after rather than at once.
+    auto retry = now + WATCHDOG_RETRY_TICKS;
+    write_msr(
+      MSR_IA32_TSC_DEADLINE,
+      earliest(
+        retry,
+        earliest(core_data->profile_deadline, core_data->wait_deadline)));
+
+    if (interrupted_pagetable == 0)
+    {
+      return;
+    }
+
+    if (invocation_deadline == 0 || now < invocation_deadline)
+    {
+      abort_kernel_callback(COMPARTMENT_UNWIND_STATUS);
+    }
+
+    LOG_MOD(ERROR, Compartment)
+      << "Compartment invocation exceeded its deadline." << LOG_ENDL;
+    abort_kernel_callback(-1);
+  }
+}
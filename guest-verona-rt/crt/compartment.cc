@@ -1,23 +1,56 @@
 // Copyright Microsoft and Project Monza Contributors.
 // SPDX-License-Identifier: MIT
 
+#include <algorithm>
 #include <callback.h>
 #include <compartment.h>
+#include <metrics.h>
 #include <output.h>
 #include <pagetable.h>
 #include <snmalloc.h>
+#include <trace.h>
 
 namespace monza
 {
   extern "C" void abort_kernel_callback(int status);
 
+  /**
+   * Attributes the time spent in Monza core servicing a request to the
+   * compartment which issued it. Time is not accounted if the request aborts
+   * the compartment.
+   */
+  class KernelCyclesScope
+  {
+    CompartmentBase* compartment;
+    uint64_t start_cycles;
+
+  public:
+    KernelCyclesScope(CompartmentBase* compartment)
+    : compartment(compartment), start_cycles(snmalloc::Aal::tick())
+    {}
+
+    ~KernelCyclesScope()
+    {
+      compartment->account_kernel_cycles(snmalloc::Aal::tick() - start_cycles);
+    }
+  };
+
   extern "C" void compartment_forward_exit(CompartmentBase* self, int status)
   {
+    if (status == COMPARTMENT_UNWIND_STATUS)
+    {
+      return;
+    }
     self->invalidate(status);
   }
 
-  extern "C" void* compartment_forward_alloc_chunk(
-    CompartmentBase* self, size_t size, uintptr_t ras)
+  /**
+   * Check that a chunk requested by the compartment is described by a RAS
+   * referring to its own allocator and agreeing with the size requested.
+   * Aborts the compartment otherwise.
+   */
+  static void
+  validate_chunk_request(CompartmentBase* self, size_t size, uintptr_t ras)
   {
     // Parse RAS to check details.
     snmalloc::FrontendMetaEntry<snmalloc::FrontendSlabMetadata> entry(
@@ -38,16 +71,83 @@ namespace monza
       // The sizeclass does not agree with the size requested.
       abort_kernel_callback(-1);
     }
+  }
+
+  extern "C" void* compartment_forward_alloc_chunk(
+    CompartmentBase* self, size_t size, uintptr_t ras)
+  {
+    KernelCyclesScope cycles(self);
+    self->account_allocator_call();
+
+    validate_chunk_request(self, size, ras);
+    MONZA_TRACE(AllocChunk, reinterpret_cast<uintptr_t>(self), size);
+    count_metric(abi::Metric::ForwardedAllocChunk);
+
+    if (!self->check_memory_quota(size))
+    {
+      return nullptr;
+    }
 
     auto [slab, meta] = snmalloc::MonzaGlobals::Backend::alloc_chunk(
       *self->alloc_local_state, size, ras);
-    new (meta) decltype(slab)(slab);
+    new (meta) snmalloc::LeasedChunk{slab, nullptr};
     return meta;
   }
 
+  /**
+   * Allocate up to count chunks of the same size and RAS in a single request,
+   * validated once for all of them. The chunks are returned as a list of
+   * LeasedChunk threaded through their slab metadata.
+   *
+   * Only the first chunk is subject to the quota action of the compartment.
+   * The lease is cut short silently once the quota or the memory of Monza core
+   * would be exceeded.
+   */
+  extern "C" void* compartment_forward_lease_chunks(
+    CompartmentBase* self, size_t size, uintptr_t ras, size_t count)
+  {
+    KernelCyclesScope cycles(self);
+    self->account_allocator_call();
+
+    validate_chunk_request(self, size, ras);
+    MONZA_TRACE(LeaseChunks, reinterpret_cast<uintptr_t>(self), size);
+    count_metric(abi::Metric::ForwardedLeaseChunks);
+
+    if (!self->check_memory_quota(size))
+    {
+      return nullptr;
+    }
+
+    auto [slab, meta] = snmalloc::MonzaGlobals::Backend::alloc_chunk(
+      *self->alloc_local_state, size, ras);
+    auto head = new (meta) snmalloc::LeasedChunk{slab, nullptr};
+
+    count = std::min(count, self->get_chunk_lease_limit());
+    for (size_t i = 1; i < count && self->within_memory_quota(size); ++i)
+    {
+      auto [next_slab, next_meta] =
+        snmalloc::MonzaGlobals::Backend::try_alloc_chunk(
+          *self->alloc_local_state, size, ras);
+      if (next_slab == nullptr)
+      {
+        break;
+      }
+      head = new (next_meta) snmalloc::LeasedChunk{next_slab, head};
+    }
+    return head;
+  }
+
   extern "C" void*
   compartment_forward_alloc_meta_data(CompartmentBase* self, size_t size)
   {
+    KernelCyclesScope cycles(self);
+    self->account_allocator_call();
+
+    if (!self->check_memory_quota(size))
+    {
+      return nullptr;
+    }
+
     auto result = snmalloc::MonzaGlobals::Backend::alloc_meta_data<void>(
       self->alloc_local_state.get(), size);
     new (result.unsafe_ptr()) decltype(result)(result);
@@ -57,6 +157,9 @@ namespace monza
   extern "C" void
   compartment_forward_dealloc_chunk(CompartmentBase* self, void* p, size_t size)
   {
+    KernelCyclesScope cycles(self);
+    self->account_allocator_call();
+
     if (!snmalloc::MonzaCompartmentOwnership::validate_owner_range(
           self->get_owner(), snmalloc::address_cast(p), size))
     {
@@ -94,6 +197,8 @@ namespace monza
   extern "C" void compartment_forward_callback(
     CompartmentBase* self, size_t index, void* ret, void* data)
   {
+    KernelCyclesScope cycles(self);
+
     auto callback = self->get_callback(index);
     if (callback == nullptr)
     {
@@ -102,6 +207,24 @@ namespace monza
     callback->callback(self->get_owner(), ret, data);
   }
 
+  extern "C" uintptr_t compartment_forward_fast_callback(
+    CompartmentBase* self,
+    size_t index,
+    uintptr_t arg0,
+    uintptr_t arg1,
+    uintptr_t arg2,
+    uintptr_t arg3)
+  {
+    KernelCyclesScope cycles(self);
+
+    auto callback = self->get_callback(index);
+    if (callback == nullptr || callback->fast_callback == nullptr)
+    {
+      abort_kernel_callback(-1);
+    }
+    return callback->fast_callback(callback, arg0, arg1, arg2, arg3);
+  }
+
   void CompartmentBase::setup_stdout(StdoutCallback callback)
   {
     compartment_kwrite_stdout = callback;
@@ -0,0 +1,103 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <atomic>
+#include <console.h>
+#include <console_abi.h>
+#include <cstring>
+#include <shared.h>
+#include <snmalloc.h>
+
+namespace monza
+{
+  /**
+   * Attempts at finding space in the console before giving up on the host,
+   * after which output goes back to the UART.
+   */
+  static constexpr size_t CONSOLE_WAIT_ATTEMPTS = 1 << 20;
+
+  static abi::ConsoleHeader* console_header = nullptr;
+  static unsigned char* console_data = nullptr;
+  // Private copy of the write position, never read back from shared memory.
+  static uint64_t console_position = 0;
+
+  /**
+   * Enable the shared memory console if the host advertised it at the end of
+   * the IO shared memory. Without it, output keeps going to the UART.
+   */
+  void setup_console()
+  {
+    auto shared_range = get_io_shared_range();
+    if (shared_range.size() < abi::CONSOLE_REGION_SIZE)
+    {
+      return;
+    }
+    auto region =
+      shared_range.data() + abi::console_offset(shared_range.size());
+    auto header = reinterpret_cast<abi::ConsoleHeader*>(region);
+    if (*reinterpret_cast<volatile uint64_t*>(&header->magic) !=
+        abi::CONSOLE_MAGIC)
+    {
+      return;
+    }
+
+    console_position = header->read_position.load(std::memory_order_acquire);
+    header->write_position.store(console_position, std::memory_order_release);
+    console_data = region + abi::CONSOLE_HEADER_SIZE;
+    console_header = header;
+  }
+
+  /**
+   * Space available in the console, waiting for the host to drain it if full.
+   * The read position is written by the host, so a value inconsistent with
+   * the write position disables the console, as does a host which stopped
+   * draining.
+   */
+  static size_t console_wait_free()
+  {
+    for (size_t i = 0; i < CONSOLE_WAIT_ATTEMPTS; ++i)
+    {
+      auto read_position =
+        console_header->read_position.load(std::memory_order_acquire);
+      auto used = console_position - read_position;
+      if (used > abi::CONSOLE_CAPACITY)
+      {
+        break;
+      }
+      if (used < abi::CONSOLE_CAPACITY)
+      {
+        return abi::CONSOLE_CAPACITY - used;
+      }
+      snmalloc::Aal::pause();
+    }
+    console_header = nullptr;
+    return 0;
+  }
+
+  /**
+   * Append to the console, returning how much of the buffer was written. The
+   * rest is to be written to the UART. Called with io_lock held, other than
+   * when flushing before exit.
+   */
+  size_t console_write(std::span<const unsigned char> buffer)
+  {
+    size_t written = 0;
+    while (console_header != nullptr && written < buffer.size())
+    {
+      auto free = console_wait_free();
+      auto offset = console_position % abi::CONSOLE_CAPACITY;
+      auto length = std::min(
+        {free, buffer.size() - written, abi::CONSOLE_CAPACITY - offset});
+      memcpy(console_data + offset, buffer.data() + written, length);
+      written += length;
+      console_position += length;
+      if (console_header != nullptr)
+      {
+        console_header->write_position.store(
+          console_position, std::memory_order_release);
+      }
+    }
+    return written;
+  }
+}
@@ -0,0 +1,112 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <atomic>
+#include <console.h>
+#include <cores.h>
+#include <cstdint>
+#include <ctime>
+#include <launch.h>
+#include <launch_abi.h>
+#include <metrics.h>
+#include <metrics_abi.h>
+#include <output.h>
+#include <profile.h>
+#include <shared.h>
+#include <thread.h>
+#include <trace.h>
+
+namespace monza
+{
+  void init_timing(const timespec& measured_time) noexcept;
+  timespec get_timespec(bool sinceBoot = false) noexcept;
+
+  /**
+   * Longest sleep between two checks of the launch state. The host may set
+   * it while the guest is paused, in which case the write does not wake the
+   * core.
+   */
+  constexpr uint64_t LAUNCH_POLL_NS = 100'000;
+
+  __attribute__((monza_global)) uint64_t instance_id = 0;
+
+  /**
+   * Set when the guest was restored from a snapshot, returned by the calls
+   * to wait_for_launch() after the one which held.
+   */
+  __attribute__((monza_global)) bool launch_restored = false;
+
+  /**
+   * Attach to the regions of the new shared memory. Cores already running
+   * threads may keep counting metrics and tracing meanwhile, which only loses
+   * their updates since the regions stay at the same addresses.
+   */
+  static void reattach_regions()
+  {
+    setup_metrics();
+    setup_console();
+    setup_trace();
+  }
+
+  /**
+   * Re-attach to the shared memory of the new instance after a restore, as
+   * the host set up new shared memory whose headers the snapshot did not
+   * capture. Cores already reset do not arm the profile timer again, so are
+   * started through an IPI. The clock carries on from the snapshot, so
+   * restart the time since boot from the restore.
+   */
+  static void restore_after_launch()
+  {
+    reattach_output(reattach_regions);
+    setup_profiling();
+    start_profiling_cores_sync();
+    init_timing(get_timespec());
+  }
+
+  bool wait_for_launch()
+  {
+    auto shared_range = get_io_shared_range();
+    if (
+      shared_range.size() < abi::CONSOLE_REGION_SIZE + abi::TRACE_REGION_SIZE +
+        abi::PROFILE_REGION_SIZE + abi::METRICS_REGION_SIZE +
+        abi::LAUNCH_REGION_SIZE)
+    {
+      return false;
+    }
+    auto header = reinterpret_cast<abi::LaunchHeader*>(
+      shared_range.data() + abi::launch_offset(shared_range.size()));
+    if (
+      *reinterpret_cast<volatile uint64_t*>(&header->magic) !=
+      abi::LAUNCH_MAGIC)
+    {
+      return false;
+    }
+
+    uint64_t expected = abi::LaunchHold;
+    if (!header->state.compare_exchange_strong(expected, abi::LaunchReady))
+    {
+      return launch_restored;
+    }
+    auto state = reinterpret_cast<const volatile uint64_t*>(&header->state);
+    uint64_t current;
+    while ((current = header->state.load(std::memory_order_acquire)) ==
+           abi::LaunchReady)
+    {
+      wait_for_write(state, abi::LaunchReady, LAUNCH_POLL_NS);
+    }
+    instance_id = *reinterpret_cast<volatile uint64_t*>(&header->instance_id);
+
+    if (current != abi::LaunchRestored)
+    {
+      return false;
+    }
+    launch_restored = true;
+    restore_after_launch();
+    return true;
+  }
+
+  uint64_t get_instance_id()
+  {
+    return instance_id;
+  }
+}
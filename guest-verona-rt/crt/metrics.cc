@@ -0,0 +1,69 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <atomic>
+#include <cores.h>
+#include <cstdint>
+#include <metrics.h>
+#include <new>
+#include <shared.h>
+
+// Null until the metrics page is set up, counting is skipped until then.
+monza::abi::MetricsCore* metrics_cores = nullptr;
+
+namespace monza
+{
+  /**
+   * Publish the metrics page at the end of the IO shared memory. Events
+   * before this are not counted.
+   */
+  void setup_metrics()
+  {
+    auto shared_range = get_io_shared_range();
+    if (
+      shared_range.size() < abi::CONSOLE_REGION_SIZE + abi::TRACE_REGION_SIZE +
+        abi::PROFILE_REGION_SIZE + abi::METRICS_REGION_SIZE)
+    {
+      return;
+    }
+    auto core_count = get_core_count();
+    if (core_count > abi::METRICS_MAX_CORES)
+    {
+      return;
+    }
+
+    auto region =
+      shared_range.data() + abi::metrics_offset(shared_range.size());
+    auto header = reinterpret_cast<abi::MetricsHeader*>(region);
+    auto cores =
+      reinterpret_cast<abi::MetricsCore*>(region + abi::METRICS_HEADER_SIZE);
+    for (size_t i = 0; i < core_count; ++i)
+    {
+      new (&cores[i]) abi::MetricsCore{};
+    }
+
+    header->magic = abi::METRICS_MAGIC;
+    header->version = abi::METRICS_VERSION;
+    header->core_count = core_count;
+    header->counter_count = static_cast<uint64_t>(abi::Metric::Count);
+    header->ready.store(1, std::memory_order_release);
+
+    metrics_cores = cores;
+  }
+
+  /**
+   * Add value to a counter of the current core. The counter is only written
+   * by this core, but atomically so that interrupt handlers nested inside do
+   * not lose counts.
+   */
+  void count_metric(abi::Metric metric, uint64_t value) noexcept
+  {
+    if (metrics_cores == nullptr)
+    {
+      return;
+    }
+    metrics_cores[get_current_core()]
+      .counters[static_cast<size_t>(metric)]
+      .fetch_add(value, std::memory_order_relaxed);
+  }
+}
@@ -4,9 +4,14 @@
 #include <cores.h>
 #include <crt.h>
 #include <early_alloc.h>
+#include <launch.h>
 #include <logging.h>
+#include <metrics.h>
+#include <output.h>
+#include <profile.h>
 #include <snmalloc.h>
 #include <tls.h>
+#include <trace.h>
 
 extern void (*__init_array_start)(void);
 extern void (*__init_array_end)(void);
@@ -54,6 +59,7 @@ namespace monza
   [[noreturn]] void monza_exit(int status)
   {
     LOG(CRITICAL) << "Execution finished with " << status << "." << LOG_ENDL;
+    flush_output();
     shutdown();
     // Needed for no-exit and virtual shutdown.
     while (true)
@@ -67,6 +73,14 @@ namespace monza
     void* main_thread_tls = create_tls(true, &__stack_start, &__stack_end);
     get_thread_execution_context(0).tls_ptr = main_thread_tls;
     set_tls_base(main_thread_tls);
+    setup_metrics();
+    setup_output();
+    setup_trace();
+    setup_profiling();
+    if (defer_launch == nullptr || !defer_launch())
+    {
+      wait_for_launch();
+    }
 
     int ret = __libc_start_main(main);
 
@@ -1,13 +1,23 @@
 // Copyright Microsoft and Project Monza Contributors.
 // SPDX-License-Identifier: MIT
 
+#include <algorithm>
+#include <atomic>
+#include <console.h>
+#include <cores.h>
 #include <crt.h>
+#include <cstdint>
+#include <cstdlib>
+#include <metrics.h>
+#include <new>
 #include <output.h>
 #include <serial.h>
 #include <snmalloc.h>
 #include <span>
 #include <spinlock.h>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace monza
 {
@@ -15,30 +25,324 @@ namespace monza
 
   thread_local StdoutCallback compartment_kwrite_stdout;
 
+  /**
+   * Held while writing to the console, either to drain the log rings or for a
+   * synchronous write.
+   */
   static Spinlock io_lock;
 
   /**
-   * Monza version of kwritev used to write to stdout.
-   * To be called from trusted code in the priviledged context.
+   * Bytes of output buffered per core before writes are dropped. Writes
+   * larger than a quarter of a ring bypass it and are written synchronously.
    */
-  size_t kwritev_stdout(WriteBuffers data)
+  static constexpr size_t LOG_RING_SIZE = 16 * 1024;
+  static constexpr size_t LOG_RING_MAX_WRITE = LOG_RING_SIZE / 4;
+
+  /**
+   * Attempts at acquiring io_lock when flushing before exit, after which the
+   * rings are drained regardless in case the holder is stuck.
+   */
+  static constexpr size_t FLUSH_LOCK_ATTEMPTS = 1 << 20;
+
+  /**
+   * Passes over the rings made by a core after its own write, so that output
+   * of other cores cannot keep it draining indefinitely.
+   */
+  static constexpr size_t MAX_DRAIN_PASSES = 2;
+
+  static OutputObserver output_observer = nullptr;
+
+  /**
+   * Single-producer single-consumer ring buffering the output of one core.
+   * The core appends whole writes without taking any lock and the holder of
+   * io_lock drains them to the console, so that a core is never stalled
+   * behind the console writes of another. Positions grow monotonically and are
+   * reduced modulo the size on access.
+   */
+  struct LogRing
   {
-    ScopedSpinlock scoped_io_lock(io_lock);
+    std::atomic<size_t> read_position{0};
+    std::atomic<size_t> write_position{0};
+    // Set while the core appends, so that appends from interrupt handlers
+    // nested inside are dropped rather than corrupting the ring.
+    std::atomic<bool> appending{false};
+    std::atomic<size_t> dropped{0};
+    // Only accessed by the holder of io_lock.
+    size_t reported_dropped = 0;
+    unsigned char data[LOG_RING_SIZE];
 
-    size_t total_length = 0;
+    bool pending() const
+    {
+      return read_position.load(std::memory_order_relaxed) !=
+        write_position.load(std::memory_order_acquire);
+    }
 
-    for (auto& buffer : data)
+    void append(WriteBuffers buffers, size_t length)
+    {
+      if (appending.exchange(true, std::memory_order_acquire))
+      {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        count_metric(abi::Metric::LogDropped);
+        return;
+      }
+
+      auto start = write_position.load(std::memory_order_relaxed);
+      auto used = start - read_position.load(std::memory_order_acquire);
+      if (length > LOG_RING_SIZE - used)
+      {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        count_metric(abi::Metric::LogDropped);
+      }
+      else
+      {
+        auto position = start;
+        for (auto& buffer : buffers)
+        {
+          for (auto c : buffer)
+          {
+            data[position++ % LOG_RING_SIZE] = c;
+          }
+        }
+        write_position.store(position, std::memory_order_release);
+      }
+
+      appending.store(false, std::memory_order_release);
+    }
+  };
+
+  static LogRing* log_rings = nullptr;
+  // Zero until setup_output, all writes are synchronous until then.
+  static snmalloc::TrivialInitAtomic<size_t> log_ring_count;
+
+  /**
+   * Write to the shared memory console if the host provides one, and to the
+   * UART otherwise.
+   */
+  static void write_console(std::span<const unsigned char> buffer)
+  {
+    if (output_observer != nullptr)
+    {
+      output_observer(buffer);
+    }
+    auto written = console_write(buffer);
+    for (auto c : buffer.subspan(written))
+    {
+      uartputc(c);
+    }
+  }
+
+  static void write_console(std::string_view str)
+  {
+    write_console(std::span<const unsigned char>(
+      reinterpret_cast<const unsigned char*>(str.data()), str.size()));
+  }
+
+  static void write_console(size_t value)
+  {
+    char digits[20];
+    size_t start = sizeof(digits);
+    do
+    {
+      digits[--start] = static_cast<char>('0' + value % 10);
+      value /= 10;
+    } while (value != 0);
+    write_console(std::string_view(digits + start, sizeof(digits) - start));
+  }
+
+  /**
+   * Write out everything buffered by a core. Called with io_lock held.
+   */
+  static void drain_ring(size_t core_id, LogRing& ring)
+  {
+    auto position = ring.read_position.load(std::memory_order_relaxed);
+    auto end = ring.write_position.load(std::memory_order_acquire);
+    while (position != end)
+    {
+      auto offset = position % LOG_RING_SIZE;
+      auto length = std::min(end - position, LOG_RING_SIZE - offset);
+      write_console(std::span<const unsigned char>(ring.data + offset, length));
+      position += length;
+    }
+    ring.read_position.store(position, std::memory_order_release);
+
+    auto dropped = ring.dropped.load(std::memory_order_relaxed);
+    if (dropped != ring.reported_dropped)
+    {
+      write_console("<core ");
+      write_console(core_id);
+      write_console(" dropped ");
+      write_console(dropped - ring.reported_dropped);
+      write_console(" log writes>\n");
+      ring.reported_dropped = dropped;
+    }
+  }
+
+  static void drain_rings()
+  {
+    auto count = log_ring_count.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i)
+    {
+      drain_ring(i, log_rings[i]);
+    }
+  }
+
+  static bool rings_pending()
+  {
+    auto count = log_ring_count.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i)
+    {
+      if (log_rings[i].pending())
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Release io_lock, taking it back to drain for the cores which appended
+   * while it was held. These cores only attempted to take the lock after
+   * appending, so either they drain themselves or their writes are seen here.
+   * Each pass drains up to the write positions found when reaching a ring,
+   * and the passes are bounded, so that a core is not held back by a steady
+   * stream of output from others. Writes appended during the last pass stay
+   * buffered until the next write of any core, or the flush before exit.
+   */
+  static void release_io_lock()
+  {
+    for (size_t pass = 0; pass < MAX_DRAIN_PASSES; ++pass)
     {
-      for (auto c : buffer)
+      io_lock.release();
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (!rings_pending() || !io_lock.try_acquire())
       {
-        uartputc(c);
+        return;
       }
+      drain_rings();
+    }
+    io_lock.release();
+  }
+
+  /**
+   * Write to the console, through the log ring of the current core when
+   * possible. The first core to find the console free drains the rings of
+   * all cores, the others return as soon as their write is buffered.
+   */
+  static size_t write_stdout(WriteBuffers data)
+  {
+    size_t total_length = 0;
+    for (auto& buffer : data)
+    {
       total_length += buffer.size();
     }
+    count_metric(abi::Metric::LogBytes, total_length);
+
+    auto count = log_ring_count.load(std::memory_order_acquire);
+    auto core_id = count == 0 ? 0 : get_current_core();
+    if (core_id < count && total_length <= LOG_RING_MAX_WRITE)
+    {
+      log_rings[core_id].append(data, total_length);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (io_lock.try_acquire())
+      {
+        drain_rings();
+        release_io_lock();
+      }
+      return total_length;
+    }
+
+    // Drain first to preserve the order of the writes of the current core.
+    io_lock.acquire();
+    drain_rings();
+    for (auto& buffer : data)
+    {
+      write_console(buffer);
+    }
+    release_io_lock();
 
     return total_length;
   }
 
+  void setup_output()
+  {
+    setup_console();
+
+    auto count = get_core_count();
+    auto rings = static_cast<LogRing*>(malloc(sizeof(LogRing) * count));
+    if (rings == nullptr)
+    {
+      // Keep writing synchronously.
+      return;
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+      new (&rings[i]) LogRing();
+    }
+    log_rings = rings;
+    log_ring_count.store(count, std::memory_order_release);
+  }
+
+  /**
+   * Synchronously write out the output buffered by all cores. Used before
+   * exiting, including on abort, so the rings are drained even if io_lock
+   * cannot be acquired, at the risk of repeating some output.
+   */
+  void flush_output()
+  {
+    bool acquired = false;
+    for (size_t i = 0; i < FLUSH_LOCK_ATTEMPTS; ++i)
+    {
+      if (io_lock.try_acquire())
+      {
+        acquired = true;
+        break;
+      }
+      snmalloc::Aal::pause();
+    }
+
+    drain_rings();
+
+    if (acquired)
+    {
+      release_io_lock();
+    }
+  }
+
+  void set_output_observer(OutputObserver observer)
+  {
+    io_lock.acquire();
+    drain_rings();
+    output_observer = observer;
+    release_io_lock();
+  }
+
+  void reattach_output(void (*reattach)())
+  {
+    io_lock.acquire();
+    reattach();
+    release_io_lock();
+  }
+
+  size_t get_output_dropped()
+  {
+    size_t dropped = 0;
+    auto count = log_ring_count.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i)
+    {
+      dropped += log_rings[i].dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
+  }
+
+  /**
+   * Monza version of kwritev used to write to stdout.
+   * To be called from trusted code in the priviledged context.
+   */
+  size_t kwritev_stdout(WriteBuffers data)
+  {
+    return write_stdout(data);
+  }
+
   /**
    * Monza version of kwritev used to write to stdout.
    * Will execute in the priviledged context on behalf of the specified
@@ -51,44 +355,37 @@ namespace monza
     // Start with checks, so that lock is not held while running checks.
     // The top-level span needs to be owned by the compartment as it is
     // preparing it on its own stack.
-    if (!snmalloc::MonzaCompartmentOwnership::validate_owner(
-          owner, unsafe_data.data(), unsafe_data.size()))
+    if (
+      unsafe_data.size() > SIZE_MAX / sizeof(WriteBuffers::value_type) ||
+      !snmalloc::MonzaCompartmentOwnership::validate_owner(
+        owner, unsafe_data.data(), unsafe_data.size()))
     {
       LOG_MOD(ERROR, Compartment)
         << "Attempt to print protected data." << LOG_ENDL;
       abort_kernel_callback(-1);
     }
+    // Copy the inner spans into kernel memory once, and only check and write
+    // the copy, as a concurrent compartment keeps running on other cores and
+    // could change them between the checks and the write.
+    std::vector<std::span<const unsigned char>> buffers(
+      unsafe_data.begin(), unsafe_data.end());
     // Each inner buffer needs to be read-accesible by the compartment.
-    // No need to worry about TOCTOU, since the top-level span is owned by the
-    // compartment which is paused.
-    for (auto& buffer : unsafe_data)
-    {
-      if (
-        !snmalloc::MonzaCompartmentOwnership::validate_owner(
-          CompartmentOwner::null(), buffer.data(), buffer.size()) &&
-        !snmalloc::MonzaCompartmentOwnership::validate_owner(
-          owner, buffer.data(), buffer.size()))
-      {
-        LOG_MOD(ERROR, Compartment)
-          << "Attempt to print protected data." << LOG_ENDL;
-        abort_kernel_callback(-1);
-      }
-    }
-
-    ScopedSpinlock scoped_io_lock(io_lock);
-
-    size_t total_length = 0;
-
-    for (auto& buffer : unsafe_data)
+    auto readable = [owner](std::span<const unsigned char> buffer) {
+      return snmalloc::MonzaCompartmentOwnership::validate_owner(
+               CompartmentOwner::null(), buffer.data(), buffer.size()) ||
+        snmalloc::MonzaCompartmentOwnership::validate_owner(
+               owner, buffer.data(), buffer.size());
+    };
+    if (!std::all_of(buffers.begin(), buffers.end(), readable))
     {
-      for (auto c : buffer)
-      {
-        uartputc(c);
-      }
-      total_length += buffer.size();
+      // Aborting does not run destructors, so release the copy first.
+      std::vector<std::span<const unsigned char>>().swap(buffers);
+      LOG_MOD(ERROR, Compartment)
+        << "Attempt to print protected data." << LOG_ENDL;
+      abort_kernel_callback(-1);
     }
 
-    return total_length;
+    return write_stdout(buffers);
   }
 
   static constexpr unsigned char NEW_LINE[] = {'\n'};
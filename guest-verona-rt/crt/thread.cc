@@ -4,11 +4,13 @@
 #include <cores.h>
 #include <crt.h>
 #include <logging.h>
+#include <metrics.h>
 #include <semaphore.h>
 #include <snmalloc.h>
 #include <spinlock.h>
 #include <thread.h>
 #include <tls.h>
+#include <trace.h>
 
 extern size_t __stack_size;
 extern void (*__monza_init_start)(void);
@@ -33,8 +35,9 @@ namespace monza
 
   /**
    * The thread id is cached in TLS to avoid needing to request the core id.
-   * Use core id of 0 for both the initial core as well as for compartment
-   * threads.
+   * Use core id of 0 for the initial core. Compartments can be invoked from any
+   * core, so their thread id is instead tracked in the TCB and refreshed by the
+   * kernel on every invocation.
    */
   static thread_local monza_thread_t thread_id = core_to_thread(0);
 
@@ -111,6 +114,7 @@ namespace monza
           ping_core_sync(i);
         }
 
+        count_metric(abi::Metric::ThreadSubmit);
         return core_to_thread(i);
       }
     }
@@ -120,6 +124,10 @@ namespace monza
 
   monza_thread_t get_thread_id()
   {
+    if (is_compartment())
+    {
+      return get_tcb()->thread_id;
+    }
     return thread_id;
   }
 
@@ -246,6 +254,11 @@ namespace monza
     }
   }
 
+  bool Spinlock::try_acquire()
+  {
+    return this->lock.exchange(1, std::memory_order_acquire) == 0;
+  }
+
   void Spinlock::release()
   {
     this->lock.store(0, std::memory_order_release);
@@ -264,7 +277,10 @@ namespace monza
 #else
     waiter.store(get_thread_id());
 #endif
+    MONZA_TRACE(SemaphoreSleep, get_thread_id(), 0);
+    count_metric(abi::Metric::SemaphoreSleep);
     acquire_semaphore(value);
+    MONZA_TRACE(SemaphoreWake, get_thread_id(), 0);
     waiter.store(0);
   }
 
@@ -280,6 +296,7 @@ namespace monza
       last_value == 0 && current_waiter != 0 &&
       current_waiter != get_thread_id())
     {
+      count_metric(abi::Metric::SemaphoreWake);
       ping_core_sync(thread_to_core(current_waiter));
     }
   }
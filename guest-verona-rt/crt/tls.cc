@@ -121,6 +121,7 @@ namespace monza
     tcb->stack_limit_low = stack_limit_low;
     tcb->stack_limit_high = stack_limit_high;
     tcb->compartment = compartment;
+    tcb->thread_id = 0;
 
     return tls_base;
   }
@@ -0,0 +1,95 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <atomic>
+#include <cores.h>
+#include <cstdint>
+#include <new>
+#include <shared.h>
+#include <snmalloc.h>
+#include <trace.h>
+
+namespace monza
+{
+  extern const uint64_t tsc_freq;
+
+  static uint8_t* trace_cores = nullptr;
+  static size_t trace_core_count = 0;
+  static size_t trace_core_stride = 0;
+  static size_t trace_records_per_core = 0;
+
+  /**
+   * Split the trace region between the cores if the host requested tracing
+   * at the end of the IO shared memory. Events are discarded otherwise.
+   */
+  void setup_trace()
+  {
+    auto shared_range = get_io_shared_range();
+    if (
+      shared_range.size() < abi::CONSOLE_REGION_SIZE + abi::TRACE_REGION_SIZE)
+    {
+      return;
+    }
+    auto region = shared_range.data() + abi::trace_offset(shared_range.size());
+    auto header = reinterpret_cast<abi::TraceHeader*>(region);
+    if (
+      *reinterpret_cast<volatile uint64_t*>(&header->magic) != abi::TRACE_MAGIC)
+    {
+      return;
+    }
+
+    auto core_count = get_core_count();
+    auto stride = snmalloc::bits::align_down(
+      (abi::TRACE_REGION_SIZE - abi::TRACE_HEADER_SIZE) / core_count,
+      abi::TRACE_CORE_HEADER_SIZE);
+    auto records_per_core =
+      (stride - abi::TRACE_CORE_HEADER_SIZE) / sizeof(abi::TraceRecord);
+    auto cores = region + abi::TRACE_HEADER_SIZE;
+    for (size_t i = 0; i < core_count; ++i)
+    {
+      new (cores + i * stride) abi::TraceCoreHeader{0};
+    }
+
+    header->tsc_frequency = tsc_freq;
+    header->core_count = core_count;
+    header->core_stride = stride;
+    header->records_per_core = records_per_core;
+    header->ready.store(1, std::memory_order_release);
+
+    trace_core_stride = stride;
+    trace_records_per_core = records_per_core;
+    trace_core_count = core_count;
+    trace_cores = cores;
+  }
+
+  /**
+   * Append an event to the buffer of the current core. The position is
+   * claimed atomically, so that events traced from interrupt handlers nested
+   * inside this function do not overwrite each other.
+   */
+  void trace_event(
+    abi::TraceEvent event, uint64_t argument0, uint64_t argument1) noexcept
+  {
+    if (trace_cores == nullptr)
+    {
+      return;
+    }
+    auto core_id = get_current_core();
+    if (core_id >= trace_core_count)
+    {
+      return;
+    }
+
+    auto core = trace_cores + core_id * trace_core_stride;
+    auto core_header = reinterpret_cast<abi::TraceCoreHeader*>(core);
+    auto records = reinterpret_cast<abi::TraceRecord*>(
+      core + abi::TRACE_CORE_HEADER_SIZE);
+    auto position =
+      core_header->write_position.fetch_add(1, std::memory_order_relaxed);
+    records[position % trace_records_per_core] = {
+      .tick = snmalloc::Aal::tick(),
+      .event = event,
+      .reserved = 0,
+      .arguments = {argument0, argument1}};
+  }
+}
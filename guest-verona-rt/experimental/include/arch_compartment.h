@@ -3,7 +3,9 @@
 
 #pragma once
 
+#include <algorithm>
 #include <compartment_utils.h>
+#include <cores.h>
 #include <cstddef>
 #include <cstdint>
 #include <deque>
@@ -11,6 +13,8 @@
 #include <pagetable.h>
 #include <snmalloc.h>
 #include <tcb.h>
+#include <thread.h>
+#include <vector>
 
 extern size_t __stack_size;
 
@@ -22,6 +26,24 @@ namespace monza
     void* tsl_alloc_base,
     void* stack_limit_low,
     void* stack_limit_high);
+  void release_extended_state(uintptr_t owner);
+  bool watchdog_supported();
+
+  /**
+   * Deadlines of the watchdog of the current core saved by arm_watchdog, to be
+   * restored by restore_watchdog.
+   */
+  struct WatchdogDeadlines
+  {
+    // Deadline at which the timer fires, the earliest of all invocations.
+    uint64_t armed;
+    // Deadline of the innermost invocation itself. Zero if it has none.
+    uint64_t invocation;
+  };
+
+  WatchdogDeadlines arm_watchdog(uint64_t deadline);
+  void restore_watchdog(WatchdogDeadlines previous);
+  bool watchdog_expired();
 
   /**
    * The state of a compartment stack used for mapping it into the pagetable.
@@ -53,55 +75,124 @@ namespace monza
     void* pagetable;
 
     /**
-     * Pointer to TLS root.
+     * Pointer to the table of TLS roots, indexed by core id.
      * Must be the second member in this class to match the
      * COMPARTMENTBASE_TLS_OFFSET constant in compartment.asm.
      */
-    void* tls;
+    void** tls;
 
     /**
+     * State needed by a core to execute the compartment.
      * Compartments support re-entrency on the same thread (as a result of
      * callbacks). Each compartment invocation gets its own stack, so we need
-     * to track a stack of stacks.
+     * to track a stack of stacks. The first stack is pre-allocated together
+     * with the TLS, which avoids needing to re-initialize the stack for every
+     * non-reentrant call.
      */
-    std::deque<CompartmentMemory<uint8_t, false, false>> stack_of_stacks;
+    struct CoreState
+    {
+      CompartmentMemory<uint8_t, false, false> tls_memory;
+      std::deque<CompartmentMemory<uint8_t, false, false>> stack_of_stacks;
+      bool is_initial_stack_used = false;
+      void* tls_root;
+
+      CoreState(
+        std::shared_ptr<snmalloc::MonzaGlobals::LocalState> alloc_local_state,
+        CompartmentOwner owner)
+      : tls_memory(alloc_local_state, get_tls_alloc_size())
+      {
+        stack_of_stacks.push_back({CompartmentMemory<uint8_t, false, false>(
+          alloc_local_state, __stack_size)});
+        tls_root =
+          initialize_tls(owner, tls_memory.span().data(), nullptr, nullptr);
+      }
+    };
 
-    bool is_initial_stack_used;
+    /**
+     * Concurrent compartments have a separate CoreState for every core, which
+     * is created on the first invocation from that core. Otherwise a single
+     * CoreState is shared by all cores.
+     */
+    bool concurrent;
+    std::vector<void*> tls_table;
+    std::vector<std::unique_ptr<CoreState>> core_states;
+    snmalloc::TrivialInitAtomic<size_t> stack_count{};
+
+    /**
+     * Size of the naturally aligned window around a faulting address within
+     * which the page-fault handler also maps the neighbouring pages with the
+     * same owner. Always a power of two multiple of PAGE_SIZE.
+     */
+    size_t fault_around_size = DEFAULT_FAULT_AROUND_PAGES * PAGE_SIZE;
+    snmalloc::TrivialInitAtomic<size_t> page_faults{};
+    snmalloc::TrivialInitAtomic<size_t> fault_mapped_pages{};
+
+    CoreState& get_core_state() const
+    {
+      return *core_states[concurrent ? get_current_core() : 0];
+    }
 
   protected:
     std::shared_ptr<snmalloc::MonzaGlobals::LocalState> alloc_local_state;
-    CompartmentMemory<uint8_t, false, false> tls_memory;
 
   public:
-    ArchitecturalCompartmentBase()
-    : /**
-       * Initial compartment memory covering both the base stack and TLS.
-       * This avoids needing to re-initialize the stack for every non-reentrant
-       * call. Map the range to the compartment pagetables to avoid the
-       * guaranteed pagefault.
-       */
-      pagetable(create_compartment_pagetable()),
-      stack_of_stacks(),
-      is_initial_stack_used(false),
+    static constexpr size_t DEFAULT_FAULT_AROUND_PAGES = 16;
+
+    ArchitecturalCompartmentBase(bool concurrent = false)
+    : pagetable(create_compartment_pagetable()),
+      concurrent(concurrent),
+      tls_table(get_core_count(), nullptr),
+      core_states(concurrent ? get_core_count() : 1),
       alloc_local_state(std::make_shared<snmalloc::MonzaGlobals::LocalState>(
-        get_owner(), pagetable)),
-      tls_memory(CompartmentMemory<uint8_t, false, false>(
-        alloc_local_state, get_tls_alloc_size()))
+        get_owner(), pagetable, concurrent))
     {
-      stack_of_stacks.push_back({CompartmentMemory<uint8_t, false, false>(
-        alloc_local_state, __stack_size)});
-
-      tls =
-        initialize_tls(get_owner(), tls_memory.span().data(), nullptr, nullptr);
+      tls = tls_table.data();
     }
 
     ~ArchitecturalCompartmentBase()
     {
-      while (stack_of_stacks.size() > 0)
+      // No need to remove stacks from compartment pagetable since it is
+      // getting destroyed.
+      core_states.clear();
+      release_extended_state(reinterpret_cast<uintptr_t>(this));
+    }
+
+    bool is_concurrent() const
+    {
+      return concurrent;
+    }
+
+    /**
+     * Check if the state needed to execute the compartment on the current core
+     * was already created.
+     */
+    bool has_core_state() const
+    {
+      return core_states[concurrent ? get_current_core() : 0] != nullptr;
+    }
+
+    /**
+     * Create the TLS and initial stack used to execute the compartment on the
+     * current core. Maps them into the compartment pagetable to avoid the
+     * guaranteed pagefault. Only one core can create the state for a core, so
+     * no synchronization is needed beyond that of the allocator.
+     */
+    void create_core_state()
+    {
+      auto index = concurrent ? get_current_core() : 0;
+      core_states[index] =
+        std::make_unique<CoreState>(alloc_local_state, get_owner());
+      stack_count.fetch_add(1);
+      if (concurrent)
       {
-        // No need to remove from compartment pagetable since it is getting
-        // destroyed.
-        stack_of_stacks.pop_back();
+        tls_table[index] = core_states[index]->tls_root;
+      }
+      else
+      {
+        for (auto& entry : tls_table)
+        {
+          entry = core_states[index]->tls_root;
+        }
       }
     }
 
@@ -126,24 +217,32 @@ namespace monza
      */
     std::span<uint8_t> get_stack()
     {
+      auto& core_state = get_core_state();
       std::span<uint8_t> stack_range;
-      if (stack_of_stacks.size() == 1 && !is_initial_stack_used)
+      if (
+        core_state.stack_of_stacks.size() == 1 &&
+        !core_state.is_initial_stack_used)
       {
-        is_initial_stack_used = true;
-        stack_range = stack_of_stacks.front().span().subspan(0, __stack_size);
+        core_state.is_initial_stack_used = true;
+        stack_range = core_state.stack_of_stacks.front().span().subspan(
+          0, __stack_size);
       }
       else
       {
         auto new_stack = CompartmentMemory<uint8_t, false, false>(
           alloc_local_state, __stack_size);
-        stack_of_stacks.push_back(std::move(new_stack));
-        stack_range = stack_of_stacks.back().span();
+        core_state.stack_of_stacks.push_back(std::move(new_stack));
+        stack_range = core_state.stack_of_stacks.back().span();
+        stack_count.fetch_add(1);
       }
 
       // The TCB has fields for stack range that need to be set.
-      auto tcb = reinterpret_cast<TCB*>(tls);
+      // The compartment might be invoked from a different core than last time,
+      // so also refresh the thread id it observes.
+      auto tcb = reinterpret_cast<TCB*>(core_state.tls_root);
       tcb->stack_limit_low = &(*(stack_range.begin()));
       tcb->stack_limit_high = &(*(stack_range.end()));
+      tcb->thread_id = get_thread_id();
 
       return stack_range;
     }
@@ -157,18 +256,130 @@ namespace monza
      */
     void release_stack()
     {
-      if (stack_of_stacks.size() == 1)
+      auto& core_state = get_core_state();
+      if (core_state.stack_of_stacks.size() == 1)
       {
-        is_initial_stack_used = false;
+        core_state.is_initial_stack_used = false;
         return;
       }
       else
       {
-        stack_of_stacks.pop_back();
+        core_state.stack_of_stacks.pop_back();
+        stack_count.fetch_sub(1);
         return;
       }
     }
 
+    /**
+     * Number of stacks currently allocated for the compartment across all
+     * cores, including the pre-allocated ones.
+     */
+    size_t get_stack_count() const
+    {
+      return stack_count.load();
+    }
+
+    /**
+     * Number of stacks in use by invocations on the current core which have
+     * not yet returned.
+     */
+    size_t get_active_stack_count() const
+    {
+      if (!has_core_state())
+      {
+        return 0;
+      }
+      auto& core_state = get_core_state();
+      if (
+        core_state.stack_of_stacks.size() == 1 &&
+        !core_state.is_initial_stack_used)
+      {
+        return 0;
+      }
+      return core_state.stack_of_stacks.size();
+    }
+
+    size_t get_pagetable_pages() const
+    {
+      snmalloc::FlagLock lock(get_pagetable_lock());
+      return count_compartment_pagetable_pages(pagetable);
+    }
+
+    /**
+     * Lock to be held while modifying the compartment pagetable outside of the
+     * allocator, which takes it internally.
+     */
+    snmalloc::FlagWord& get_pagetable_lock() const
+    {
+      return alloc_local_state->get_monza_range()->get_pagetable_lock();
+    }
+
+    /**
+     * Set the number of pages in the fault-around window, rounded up to a power
+     * of two. A single page disables fault-around.
+     */
+    void set_fault_around_pages(size_t pages)
+    {
+      fault_around_size =
+        snmalloc::bits::next_pow2(std::max<size_t>(pages, 1)) * PAGE_SIZE;
+    }
+
+    size_t get_fault_around_size() const
+    {
+      return fault_around_size;
+    }
+
+    /**
+     * Called by the page-fault handler to account a fault which mapped the
+     * given number of pages.
+     */
+    void record_page_fault(size_t mapped_pages)
+    {
+      page_faults.fetch_add(1, std::memory_order_relaxed);
+      fault_mapped_pages.fetch_add(mapped_pages, std::memory_order_relaxed);
+    }
+
+    size_t get_page_faults() const
+    {
+      return page_faults.load(std::memory_order_relaxed);
+    }
+
+    size_t get_fault_mapped_pages() const
+    {
+      return fault_mapped_pages.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Map a range of memory owned by Monza core into the compartment pagetable
+     * with a single pagetable update. Used by CompartmentGrant, which is
+     * responsible for validating the range.
+     */
+    void map_granted_range(
+      snmalloc::address_t base, size_t size, PagetablePermission perm)
+    {
+      snmalloc::FlagLock lock(get_pagetable_lock());
+      add_to_compartment_pagetable(pagetable, base, size, perm);
+    }
+
+    /**
+     * Remove a range previously mapped with map_granted_range() from the
+     * compartment pagetable. The compartment pagetable is reloaded on every
+     * entry into the compartment, so no further TLB maintenance is needed
+     * unless the compartment might be executing on other cores. The shootdown
+     * happens after releasing the pagetable lock.
+     */
+    void unmap_granted_range(snmalloc::address_t base, size_t size)
+    {
+      {
+        snmalloc::FlagLock lock(get_pagetable_lock());
+        remove_from_compartment_pagetable(pagetable, base, size);
+      }
+      if (concurrent)
+      {
+        flush_tlb_cores_sync(pagetable);
+      }
+    }
+
     /**
      * Check if a particular address corresponds to the currently active
      * compartment stack or not. Used by the page-fault handler to delegate
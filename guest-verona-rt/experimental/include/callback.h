@@ -15,18 +15,36 @@ namespace monza
   class CallbackBase;
 
   extern "C" void abort_kernel_callback(int status);
+  /**
+   * Status passed to abort_kernel_callback to unwind the innermost invocation
+   * without invalidating its compartment, as the reason for the abort lies
+   * with an enclosing invocation.
+   */
+  constexpr int COMPARTMENT_UNWIND_STATUS = -2;
   extern "C" void
   compartment_forward_callback(CompartmentBase*, size_t, void*, void*);
+  extern "C" uintptr_t compartment_forward_fast_callback(
+    CompartmentBase*, size_t, uintptr_t, uintptr_t, uintptr_t, uintptr_t);
 
   /**
    * Abstract class for a callback to allow storing pointers to diversly
    * templated subclasses. Virtual callback method called by
    * compartment_forward_invoke when back in the kernel to dispatch the
-   * callback.
+   * callback. Callbacks qualifying for the register-only path additionally
+   * provide a non-virtual entry point taking and returning raw registers.
    */
   class CallbackBase
   {
   protected:
+    using FastCallbackFunction = uintptr_t (*)(
+      const CallbackBase*, uintptr_t, uintptr_t, uintptr_t, uintptr_t);
+
+    FastCallbackFunction fast_callback;
+
+    CallbackBase(FastCallbackFunction fast_callback)
+    : fast_callback(fast_callback)
+    {}
+
     virtual ~CallbackBase() {}
 
     virtual void callback(CompartmentOwner, void*, void*) const = 0;
@@ -34,6 +52,8 @@ namespace monza
     friend class CompartmentBase;
     friend void
     compartment_forward_callback(CompartmentBase*, size_t, void*, void*);
+    friend uintptr_t compartment_forward_fast_callback(
+      CompartmentBase*, size_t, uintptr_t, uintptr_t, uintptr_t, uintptr_t);
   };
 
   /**
@@ -64,7 +84,10 @@ namespace monza
     using A = typename T::args_type;
 
   private:
-    Callback(F f) : CallbackBase(), f(f) {}
+    Callback(F f)
+    : CallbackBase(is_fast_callback_v<R, A> ? &fast_callback_helper : nullptr),
+      f(f)
+    {}
 
     /**
      * Create a typed CompartmentCallback handle from the callback.
@@ -78,7 +101,7 @@ namespace monza
 
     /**
      * Called by compartment_forward_invoke when back in the kernel to dispatch
-     * the callback.
+     * the callback. The callback only sees a copy of the arguments.
      */
     virtual void callback(CompartmentOwner owner, void* ret, void* data) const
     {
@@ -98,7 +121,39 @@ namespace monza
           << "Callback result pointer not owned by compartment." << LOG_ENDL;
         abort_kernel_callback(-1);
       }
-      *typed_ret = std::apply(f, *typed_data);
+      // Copy the arguments into kernel memory once, as a concurrent
+      // compartment keeps running on other cores and could change them
+      // between the checks of the callback and their use.
+      A args = *typed_data;
+      *typed_ret = std::apply(f, args);
+    }
+
+    /**
+     * Called by compartment_forward_fast_callback when back in the kernel to
+     * dispatch a callback using the register-only path. As arguments are
+     * values, no ownership checks are needed.
+     */
+    static uintptr_t fast_callback_helper(
+      const CallbackBase* base,
+      uintptr_t arg0,
+      uintptr_t arg1,
+      uintptr_t arg2,
+      uintptr_t arg3)
+    {
+      if constexpr (is_fast_callback_v<R, A>)
+      {
+        auto self = static_cast<const Callback*>(base);
+        uintptr_t registers[] = {arg0, arg1, arg2, arg3};
+        return [&]<size_t... I>(std::index_sequence<I...>) {
+          return to_register<R>(self->f(
+            from_register<std::tuple_element_t<I, A>>(registers[I])...));
+        }(std::make_index_sequence<std::tuple_size_v<A>>());
+      }
+      else
+      {
+        abort_kernel_callback(-1);
+        return 0;
+      }
     }
 
     friend class CompartmentBase;
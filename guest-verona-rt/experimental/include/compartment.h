@@ -3,12 +3,19 @@
 
 #pragma once
 
+#include <algorithm>
 #include <arch_compartment.h>
+#include <atomic>
 #include <callback.h>
+#include <compartment_grant.h>
+#include <compartment_usage.h>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
+#include <metrics.h>
 #include <new>
 #include <snmalloc.h>
+#include <trace.h>
 #include <writebuffers.h>
 
 extern size_t __stack_size;
@@ -28,6 +35,8 @@ namespace monza
   extern "C" void compartment_forward_exit(CompartmentBase*, int);
   extern "C" void*
   compartment_forward_alloc_chunk(CompartmentBase*, size_t, uintptr_t);
+  extern "C" void*
+  compartment_forward_lease_chunks(CompartmentBase*, size_t, uintptr_t, size_t);
   extern "C" void
   compartment_forward_dealloc_chunk(CompartmentBase*, void* base, size_t);
   extern "C" void*
@@ -41,10 +50,19 @@ namespace monza
   protected:
     using WriterFunction = size_t (*)(CompartmentOwner, WriteBuffers);
 
-    bool is_valid = true;
+    std::atomic<bool> is_valid = true;
     std::vector<CallbackBase*> callbacks;
 
-    CompartmentBase() {}
+    CompartmentQuota quota;
+    std::atomic<uint64_t> invocations = 0;
+    std::atomic<uint64_t> total_cycles = 0;
+    std::atomic<uint64_t> kernel_cycles = 0;
+    std::atomic<uint64_t> allocator_calls = 0;
+    size_t chunk_lease_limit = MAX_LEASE_CHUNKS;
+
+    CompartmentBase(bool concurrent)
+    : ArchitecturalCompartmentBase(concurrent)
+    {}
 
     ~CompartmentBase()
     {
@@ -78,6 +96,70 @@ namespace monza
       return callback->get_compartment_callback(get_owner(), index);
     }
 
+    /**
+     * Grant the compartment zero-copy access to a buffer owned by Monza core
+     * for as long as the returned grant is alive.
+     * See CompartmentGrant for the restrictions on the buffer.
+     */
+    template<typename T>
+    CompartmentGrant grant(std::span<T> buffer, GrantPermission permission)
+    {
+      return CompartmentGrant(
+        *this,
+        std::span<const uint8_t>(
+          reinterpret_cast<const uint8_t*>(buffer.data()), buffer.size_bytes()),
+        permission);
+    }
+
+    /**
+     * Report the resources consumed by the compartment so far.
+     */
+    CompartmentUsage get_usage() const
+    {
+      CompartmentUsage result;
+      result.invocations = invocations.load();
+      result.total_cycles = total_cycles.load();
+      result.kernel_cycles = kernel_cycles.load();
+      result.allocator_calls = allocator_calls.load();
+      auto monza_range = alloc_local_state->get_monza_range();
+      result.bytes_owned = monza_range->get_bytes_owned();
+      result.peak_bytes_owned = monza_range->get_peak_bytes_owned();
+      result.pagetable_pages = get_pagetable_pages();
+      result.stacks = get_stack_count();
+      result.page_faults = get_page_faults();
+      result.fault_mapped_pages = get_fault_mapped_pages();
+      return result;
+    }
+
+    const CompartmentQuota& get_quota() const
+    {
+      return quota;
+    }
+
+    /**
+     * Replace the resource limits of the compartment. Resources already
+     * consumed are not reclaimed if they exceed the new limits.
+     */
+    void set_quota(const CompartmentQuota& new_quota)
+    {
+      quota = new_quota;
+    }
+
+    size_t get_chunk_lease_limit() const
+    {
+      return chunk_lease_limit;
+    }
+
+    /**
+     * Bound the number of chunks Monza core leases to the compartment per
+     * allocator request, trading memory held by the compartment for fewer
+     * requests. A limit of 1 allocates chunks one at a time.
+     */
+    void set_chunk_lease_limit(size_t limit)
+    {
+      chunk_lease_limit = std::clamp<size_t>(limit, 1, MAX_LEASE_CHUNKS);
+    }
+
     const CallbackBase* get_callback(size_t index) const
     {
       if (index < callbacks.size())
@@ -90,20 +172,144 @@ namespace monza
       }
     }
 
+  protected:
+    /**
+     * Check the quotas which are enforced when the compartment is invoked.
+     * Invalidates the compartment if it used up its cycles.
+     */
+    bool check_invoke_quota()
+    {
+      if (total_cycles.load() - kernel_cycles.load() >= quota.max_cycles)
+      {
+        LOG_MOD(ERROR, Compartment)
+          << "Compartment exceeded its quota of " << quota.max_cycles
+          << " cycles." << LOG_ENDL;
+        is_valid = false;
+        return false;
+      }
+      if (get_active_stack_count() >= quota.max_stacks)
+      {
+        LOG_MOD(ERROR, Compartment)
+          << "Compartment exceeded its quota of " << quota.max_stacks
+          << " stacks." << LOG_ENDL;
+        return false;
+      }
+      return true;
+    }
+
+    /**
+     * Attribute the time spent in an invocation to the compartment.
+     * Must be called while the stack of the invocation is still active.
+     * Nested invocations happen from within a callback, which already accounts
+     * the time as spent in the kernel, so it is moved back to the compartment.
+     */
+    void account_invoke_cycles(uint64_t cycles)
+    {
+      invocations++;
+      if (get_active_stack_count() <= 1)
+      {
+        total_cycles += cycles;
+      }
+      else
+      {
+        kernel_cycles -= cycles;
+      }
+    }
+
   private:
     void invalidate(int)
     {
       is_valid = false;
     }
 
+    void account_kernel_cycles(uint64_t cycles)
+    {
+      kernel_cycles += cycles;
+    }
+
+    void account_allocator_call()
+    {
+      allocator_calls++;
+    }
+
+    /**
+     * Check whether size more bytes owned by the compartment fit its quota.
+     */
+    bool within_memory_quota(size_t size) const
+    {
+      auto bytes_owned =
+        alloc_local_state->get_monza_range()->get_bytes_owned();
+      return bytes_owned + size <= quota.max_bytes &&
+        bytes_owned + size >= size;
+    }
+
+    /**
+     * Check whether a request by the compartment for size more bytes is
+     * within its memory quota. Returns false if the request should fail and
+     * aborts instead if the quota is configured to invalidate the compartment.
+     */
+    bool check_memory_quota(size_t size)
+    {
+      if (within_memory_quota(size))
+      {
+        return true;
+      }
+      LOG_MOD(ERROR, Compartment)
+        << "Compartment exceeded its quota of " << quota.max_bytes << " bytes."
+        << LOG_ENDL;
+      if (quota.on_memory_exceeded == QuotaAction::Invalidate)
+      {
+        abort_kernel_callback(-1);
+      }
+      return false;
+    }
+
     // Friend function so that it can use private members.
     friend void compartment_forward_exit(CompartmentBase*, int);
     friend void*
     compartment_forward_alloc_chunk(CompartmentBase*, size_t, uintptr_t);
+    friend void* compartment_forward_lease_chunks(
+      CompartmentBase*, size_t, uintptr_t, size_t);
     friend void
     compartment_forward_dealloc_chunk(CompartmentBase*, void*, size_t);
 
     friend void* compartment_forward_alloc_meta_data(CompartmentBase*, size_t);
+    friend class KernelCyclesScope;
+  };
+
+  /**
+   * Arms the watchdog of the current core with the deadline of an invocation
+   * for the duration of the scope, restoring the enclosing deadline after.
+   * Invocations without a budget are tracked too, so that the watchdog can
+   * tell whose deadline expired.
+   */
+  class WatchdogScope
+  {
+    WatchdogDeadlines previous;
+
+    static uint64_t deadline_for(uint64_t budget)
+    {
+      if (budget == std::numeric_limits<uint64_t>::max())
+      {
+        return 0;
+      }
+      auto now = snmalloc::Aal::tick();
+      if (now + budget < now)
+      {
+        return std::numeric_limits<uint64_t>::max();
+      }
+      return now + budget;
+    }
+
+  public:
+    WatchdogScope(uint64_t budget)
+    : previous(arm_watchdog(deadline_for(budget)))
+    {}
+
+    ~WatchdogScope()
+    {
+      restore_watchdog(previous);
+    }
   };
 
   class InvokeScopedStack
@@ -140,39 +346,31 @@ namespace monza
     }
   };
 
-  template<typename FData = NoData>
+  /**
+   * A compartment with data of type FData shared across its invocations.
+   *
+   * Concurrent compartments can be invoked from several cores at the same
+   * time, with each core using its own TLS and stacks, which are set up on the
+   * first invocation from that core. Thread-local state inside the compartment
+   * is thus per core, while FData is shared and any synchronization of it is
+   * up to the user. Removing memory from a concurrent compartment needs a TLB
+   * shootdown, making it more expensive than for a non-concurrent one.
+   */
+  template<typename FData = NoData, bool Concurrent = false>
   class Compartment : public CompartmentBase
   {
   private:
     CompartmentMemory<FData, false, true> data;
+    StdoutCallback stdout_callback;
 
   public:
-    inline Compartment() : CompartmentBase(), data(alloc_local_state)
+    inline Compartment() : CompartmentBase(Concurrent), data(alloc_local_state)
     {
-      auto p = get_root_pagemap();
-
-      auto stdout_callback = register_callback(
+      stdout_callback = register_callback(
         [owner = get_owner(), writer = get_compartment_writer()](
           WriteBuffers buffers) { return writer(owner, buffers); });
 
-      if constexpr (std::is_same_v<FData, NoData>)
-      {
-        invoke([p, stdout_callback]() {
-          setup_stdout(stdout_callback);
-          snmalloc_compartment_initializer(p);
-          monza_thread_initializers();
-          return true;
-        });
-      }
-      else
-      {
-        invoke([p, stdout_callback](FData*) {
-          setup_stdout(stdout_callback);
-          snmalloc_compartment_initializer(p);
-          monza_thread_initializers();
-          return true;
-        });
-      }
+      initialize_core();
     }
 
     inline ~Compartment() {}
@@ -209,10 +407,50 @@ namespace monza
     }
 
   private:
+    /**
+     * Create the state for executing on the current core and run the
+     * initializers of the compartment runtime with it.
+     */
+    void initialize_core()
+    {
+      create_core_state();
+
+      auto p = get_root_pagemap();
+
+      if constexpr (std::is_same_v<FData, NoData>)
+      {
+        invoke([p, stdout_callback = stdout_callback]() {
+          setup_stdout(stdout_callback);
+          snmalloc_compartment_initializer(p);
+          monza_thread_initializers();
+          return true;
+        });
+      }
+      else
+      {
+        invoke([p, stdout_callback = stdout_callback](FData*) {
+          setup_stdout(stdout_callback);
+          snmalloc_compartment_initializer(p);
+          monza_thread_initializers();
+          return true;
+        });
+      }
+    }
+
     template<typename F, typename FRet>
     inline CompartmentErrorOr<FRet> invoke_typed(F lambda)
     {
-      if (!is_valid)
+      if constexpr (Concurrent)
+      {
+        if (!has_core_state())
+        {
+          initialize_core();
+        }
+      }
+
+      // An enclosing invocation which exceeded its deadline is about to be
+      // aborted, so do not start nested invocations which would delay it.
+      if (!is_valid || !check_invoke_quota() || watchdog_expired())
       {
         return CompartmentErrorOr<FRet>();
       }
@@ -221,6 +459,10 @@ namespace monza
 
       FRet* compartment_ret = stack.reserve<FRet>();
 
+      auto start_cycles = snmalloc::Aal::tick();
+      WatchdogScope watchdog(quota.max_invoke_cycles);
+      MONZA_TRACE(CompartmentEnter, reinterpret_cast<uintptr_t>(this), 0);
+      count_metric(abi::Metric::CompartmentEnter);
       bool ret = compartment_enter(
         &lambda,
         compartment_ret,
@@ -228,9 +470,12 @@ namespace monza
         &invoke_helper<F, FRet>,
         stack.get(),
         this);
+      MONZA_TRACE(CompartmentExit, reinterpret_cast<uintptr_t>(this), ret);
+      account_invoke_cycles(snmalloc::Aal::tick() - start_cycles);
 
       if (!ret)
       {
+        count_metric(abi::Metric::CompartmentAbort);
         return CompartmentErrorOr<FRet>();
       }
 
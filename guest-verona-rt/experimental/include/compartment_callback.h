@@ -6,14 +6,75 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <functional>
 #include <logging.h>
 #include <tcb.h>
+#include <tuple>
+#include <type_traits>
 #include <writebuffers.h>
 
 namespace monza
 {
   void compartment_callback(size_t index, void* ret, void* data);
+  uintptr_t compartment_fast_callback(
+    size_t index,
+    uintptr_t arg0 = 0,
+    uintptr_t arg1 = 0,
+    uintptr_t arg2 = 0,
+    uintptr_t arg3 = 0);
+
+  /**
+   * Maximum number of arguments for the register-only callback path.
+   * The syscall convention allows for 5 arguments, one of which is taken by the
+   * callback index.
+   */
+  constexpr size_t FAST_CALLBACK_MAX_ARGS = 4;
+
+  /**
+   * Types which can be passed through a single register across the compartment
+   * boundary. Pointers are excluded as they would need validation against the
+   * compartment ownership.
+   */
+  template<typename T>
+  constexpr bool is_register_value_v =
+    (std::is_arithmetic_v<T> || std::is_enum_v<T>) &&
+    (sizeof(T) <= sizeof(uintptr_t));
+
+  template<typename R, typename A>
+  struct is_fast_callback : std::false_type
+  {};
+
+  template<typename R, typename... Args>
+  struct is_fast_callback<R, std::tuple<Args...>>
+  : std::bool_constant<
+      is_register_value_v<R> && (is_register_value_v<Args> && ...) &&
+      sizeof...(Args) <= FAST_CALLBACK_MAX_ARGS>
+  {};
+
+  /**
+   * Check if a callback with result R and argument tuple A qualifies for the
+   * register-only path, avoiding the copy of arguments and result through
+   * compartment memory and the ownership validation of the pointers to them.
+   */
+  template<typename R, typename A>
+  constexpr bool is_fast_callback_v = is_fast_callback<R, A>::value;
+
+  template<typename T>
+  inline uintptr_t to_register(T value)
+  {
+    uintptr_t result = 0;
+    memcpy(&result, &value, sizeof(T));
+    return result;
+  }
+
+  template<typename T>
+  inline T from_register(uintptr_t value)
+  {
+    std::remove_cv_t<T> result;
+    memcpy(&result, &value, sizeof(T));
+    return result;
+  }
 
   template<typename F>
   class Callback;
@@ -35,7 +96,8 @@ namespace monza
     /**
      * Called from within the compartment.
      * Bundles argument and preprates space for return and issues
-     * compartment_callback.
+     * compartment_callback. Signatures consisting only of scalars instead pass
+     * arguments and return in registers using compartment_fast_callback.
      */
     template<typename... Args>
     R operator()(Args&&... args) const
@@ -51,11 +113,24 @@ namespace monza
       }
 
       auto fused_args = A(std::forward_as_tuple(args...));
-      R return_value;
 
-      compartment_callback(index, &return_value, &fused_args);
+      if constexpr (is_fast_callback_v<R, A>)
+      {
+        return std::apply(
+          [this](auto... values) {
+            return from_register<R>(
+              compartment_fast_callback(index, to_register(values)...));
+          },
+          fused_args);
+      }
+      else
+      {
+        R return_value;
 
-      return std::move(return_value);
+        compartment_callback(index, &return_value, &fused_args);
+
+        return std::move(return_value);
+      }
     }
 
   private:
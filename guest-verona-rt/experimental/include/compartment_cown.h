@@ -0,0 +1,57 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <compartment.h>
+#include <cpp/when.h>
+#include <utility>
+
+namespace monza
+{
+  /**
+   * A compartment owned by a Verona cown.
+   *
+   * Compartment instances are not safe for concurrent invocation, but they
+   * carry no affinity to the core that created them. Wrapping them in a cown
+   * lets the Verona scheduler enforce exclusive access while running
+   * invocations on whichever core picks up the behaviour. All per-invocation
+   * kernel state (saved kernel stack pointer, kernel TLS and per-core pointer)
+   * lives in per-core storage, so invocations on different cores do not
+   * interfere.
+   */
+  template<typename FData = NoData>
+  using CompartmentCown = verona::cpp::cown_ptr<Compartment<FData>>;
+
+  /**
+   * Access to a compartment within a behaviour scheduled on its cown.
+   */
+  template<typename FData = NoData>
+  using AcquiredCompartment = verona::cpp::acquired_cown<Compartment<FData>>;
+
+  /**
+   * Create a new compartment owned by a cown.
+   */
+  template<typename FData = NoData>
+  CompartmentCown<FData> make_compartment_cown()
+  {
+    return verona::cpp::make_cown<Compartment<FData>>();
+  }
+
+  /**
+   * Schedule an invocation of the compartment on any available core. The
+   * result of the invocation is handed to the continuation, which runs as part
+   * of the same behaviour and thus still has exclusive access to the
+   * compartment.
+   */
+  template<typename FData, typename F, typename C>
+  void when_invoke(
+    CompartmentCown<FData> compartment, F lambda, C continuation)
+  {
+    verona::cpp::when(compartment)
+      << [lambda = std::move(lambda), continuation = std::move(continuation)](
+           AcquiredCompartment<FData> acquired) mutable {
+           continuation(acquired->invoke(std::move(lambda)));
+         };
+  }
+}
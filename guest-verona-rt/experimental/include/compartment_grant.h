@@ -0,0 +1,159 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <arch_compartment.h>
+#include <cstddef>
+#include <cstdint>
+#include <logging.h>
+#include <pagetable.h>
+#include <snmalloc.h>
+#include <span>
+
+namespace monza
+{
+  enum class GrantPermission
+  {
+    Read,
+    ReadWrite
+  };
+
+  /**
+   * Scoped, zero-copy grant of memory owned by Monza core to a compartment.
+   *
+   * The pages covering the buffer are mapped into the compartment pagetable
+   * with a single pagetable update when the grant is created and removed again
+   * when it is revoked or goes out of scope. Typical use is to keep the grant
+   * alive for the duration of one or more invocations, avoiding the copy into
+   * compartment-owned memory.
+   *
+   * Ownership of the memory does not change. Only memory without a compartment
+   * owner can be granted, so a compartment can never gain access to memory of
+   * another compartment through a grant. Since the mapping is page-granular,
+   * writable grants require page-aligned buffers to avoid exposing unrelated
+   * kernel data sharing the same pages. Read-only grants are rounded out to
+   * page boundaries, matching what the page-fault handler would map on demand.
+   *
+   * The granted memory must outlive the grant.
+   */
+  class CompartmentGrant
+  {
+    ArchitecturalCompartmentBase* compartment;
+    snmalloc::address_t base;
+    size_t size;
+
+  public:
+    constexpr CompartmentGrant() : compartment(nullptr), base(0), size(0) {}
+
+    CompartmentGrant(
+      ArchitecturalCompartmentBase& target,
+      std::span<const uint8_t> buffer,
+      GrantPermission permission)
+    : CompartmentGrant()
+    {
+      if (buffer.empty())
+      {
+        return;
+      }
+
+      auto buffer_base = snmalloc::address_cast(buffer.data());
+      auto buffer_end = buffer_base + buffer.size();
+      if (buffer_end < buffer_base)
+      {
+        LOG_MOD(ERROR, Compartment)
+          << "Grant range wraps around the address space." << LOG_ENDL;
+        return;
+      }
+
+      if (
+        permission == GrantPermission::ReadWrite &&
+        (buffer_base % PAGE_SIZE != 0 || buffer.size() % PAGE_SIZE != 0))
+      {
+        LOG_MOD(ERROR, Compartment)
+          << "Writable grant of " << static_cast<const void*>(buffer.data())
+          << " with size " << buffer.size() << " is not page-aligned."
+          << LOG_ENDL;
+        return;
+      }
+
+      auto aligned_base = snmalloc::address_align_down<PAGE_SIZE>(buffer_base);
+      auto aligned_end = snmalloc::bits::align_up(buffer_end, PAGE_SIZE);
+
+      if (!snmalloc::MonzaCompartmentOwnership::validate_owner_range(
+            CompartmentOwner::null(), aligned_base, aligned_end - aligned_base))
+      {
+        LOG_MOD(ERROR, Compartment)
+          << "Grant of " << static_cast<const void*>(buffer.data())
+          << " with size " << buffer.size()
+          << " covers memory owned by a compartment." << LOG_ENDL;
+        return;
+      }
+
+      target.map_granted_range(
+        aligned_base,
+        aligned_end - aligned_base,
+        permission == GrantPermission::ReadWrite ? PT_COMPARTMENT_WRITE :
+                                                   PT_COMPARTMENT_READ);
+
+      compartment = &target;
+      base = aligned_base;
+      size = aligned_end - aligned_base;
+    }
+
+    CompartmentGrant(const CompartmentGrant&) = delete;
+    CompartmentGrant& operator=(const CompartmentGrant&) = delete;
+
+    CompartmentGrant(CompartmentGrant&& source)
+    : compartment(source.compartment), base(source.base), size(source.size)
+    {
+      source.compartment = nullptr;
+      source.base = 0;
+      source.size = 0;
+    }
+
+    CompartmentGrant& operator=(CompartmentGrant&& source)
+    {
+      if (this != &source)
+      {
+        revoke();
+        compartment = source.compartment;
+        base = source.base;
+        size = source.size;
+        source.compartment = nullptr;
+        source.base = 0;
+        source.size = 0;
+      }
+      return *this;
+    }
+
+    ~CompartmentGrant()
+    {
+      revoke();
+    }
+
+    /**
+     * Check if the grant was successfully established and not yet revoked.
+     */
+    bool is_granted() const
+    {
+      return compartment != nullptr;
+    }
+
+    /**
+     * Remove the mapping from the compartment pagetable.
+     * Must not be called while the compartment is executing.
+     */
+    void revoke()
+    {
+      if (compartment == nullptr)
+      {
+        return;
+      }
+      compartment->unmap_granted_range(base, size);
+      compartment = nullptr;
+      base = 0;
+      size = 0;
+    }
+  };
+}
@@ -0,0 +1,116 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <compartment.h>
+#include <cstddef>
+#include <memory>
+#include <snmalloc.h>
+#include <vector>
+
+namespace monza
+{
+  /**
+   * Pool of compartments constructed ahead of time, each of which already ran
+   * the same setup lambda.
+   *
+   * Each compartment handed out by acquire() has completed construction and
+   * the setup lambda, but is otherwise fresh and fully isolated from all the
+   * others. Setup runs inside the compartment as a regular invocation
+   * returning bool, and compartments for which it fails are discarded.
+   *
+   * The pool does not make compartments cheaper to create. Compartment memory
+   * is identity mapped and addressed directly by Monza core, so compartments
+   * cannot share pages copy-on-write. Instead, the construction cost is moved
+   * off the critical path by calling replenish() when convenient, leaving
+   * acquire() to only take a compartment out of the pool. acquire() falls
+   * back to constructing a compartment if the pool is empty.
+   */
+  template<typename FData, typename Setup, bool Concurrent = false>
+  class CompartmentPool
+  {
+    using CompartmentType = Compartment<FData, Concurrent>;
+
+    Setup setup;
+    size_t target_size;
+    snmalloc::FlagWord pool_lock{};
+    std::vector<std::unique_ptr<CompartmentType>> pool;
+
+    std::unique_ptr<CompartmentType> create()
+    {
+      auto compartment = std::make_unique<CompartmentType>();
+      auto return_value = compartment->invoke(setup);
+      if (!return_value.get_success() || !return_value)
+      {
+        LOG_MOD(ERROR, Compartment)
+          << "Setup of pooled compartment failed." << LOG_ENDL;
+        return nullptr;
+      }
+      return compartment;
+    }
+
+  public:
+    CompartmentPool(Setup setup, size_t target_size)
+    : setup(setup), target_size(target_size)
+    {
+      pool.reserve(target_size);
+      replenish();
+    }
+
+    CompartmentPool(const CompartmentPool&) = delete;
+    CompartmentPool(CompartmentPool&&) = delete;
+
+    /**
+     * Get a compartment in the state after setup. Returns nullptr if setup
+     * failed.
+     */
+    std::unique_ptr<CompartmentType> acquire()
+    {
+      {
+        snmalloc::FlagLock lock(pool_lock);
+        if (!pool.empty())
+        {
+          auto compartment = std::move(pool.back());
+          pool.pop_back();
+          return compartment;
+        }
+      }
+      return create();
+    }
+
+    /**
+     * Refill the pool up to its target size. Compartments are constructed
+     * without holding the pool lock, so acquire() can proceed
+     * concurrently.
+     */
+    void replenish()
+    {
+      while (true)
+      {
+        {
+          snmalloc::FlagLock lock(pool_lock);
+          if (pool.size() >= target_size)
+          {
+            return;
+          }
+        }
+
+        auto compartment = create();
+        if (compartment == nullptr)
+        {
+          return;
+        }
+
+        snmalloc::FlagLock lock(pool_lock);
+        pool.push_back(std::move(compartment));
+      }
+    }
+
+    size_t available()
+    {
+      snmalloc::FlagLock lock(pool_lock);
+      return pool.size();
+    }
+  };
+}
@@ -0,0 +1,137 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <callback.h>
+#include <compartment_utils.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <logging.h>
+#include <memory>
+#include <snmalloc.h>
+#include <span>
+
+namespace monza
+{
+  /**
+   * Compartment-side handle for passing a payload from one compartment to
+   * the entry point of another, created by register_portal().
+   *
+   * Calling the portal passes a buffer owned by the calling compartment to the
+   * entry point of the target and returns the result of the target as a
+   * CompartmentErrorOr, which reports failure if the target did not complete
+   * or the payload exceeds the capacity of the portal. Can be captured in
+   * lambdas passed to the source compartment like any other compartment
+   * callback.
+   */
+  template<typename C>
+  class CompartmentPortal
+  {
+    C callback;
+
+  public:
+    constexpr CompartmentPortal(C callback) : callback(callback) {}
+
+    auto operator()(std::span<const uint8_t> payload) const
+    {
+      return callback(
+        reinterpret_cast<uintptr_t>(payload.data()), payload.size());
+    }
+  };
+
+  /**
+   * Executed by Monza core for every call through a portal, as a callback of
+   * the source compartment which invokes the target as a nested invocation.
+   *
+   * The payload is validated against the ownership of the source and copied
+   * once into the buffer of the portal, which the target owns, so the target
+   * never sees any other memory of the source. The source is not concurrent,
+   * so it is paused in the callback and cannot modify the payload during the
+   * copy.
+   */
+  template<typename Target, typename Entry>
+  auto portal_dispatch(
+    Target& target,
+    const Entry& entry,
+    CompartmentOwner source_owner,
+    std::span<uint8_t> buffer,
+    uintptr_t base,
+    size_t size)
+  {
+    auto payload = std::span<const uint8_t>(buffer.data(), size);
+    auto stage = [entry, payload](auto... data) {
+      return entry(payload, data...);
+    };
+
+    if (
+      base + size < base ||
+      !snmalloc::MonzaCompartmentOwnership::validate_owner_range(
+        source_owner, base, size))
+    {
+      LOG_MOD(ERROR, Compartment)
+        << "Portal payload not owned by calling compartment." << LOG_ENDL;
+      abort_kernel_callback(-1);
+    }
+
+    if (size > buffer.size())
+    {
+      LOG_MOD(ERROR, Compartment)
+        << "Portal payload of " << size << " bytes exceeds capacity of "
+        << buffer.size() << " bytes." << LOG_ENDL;
+      return decltype(target.invoke(stage))();
+    }
+
+    memcpy(buffer.data(), reinterpret_cast<const void*>(base), size);
+    return target.invoke(stage);
+  }
+
+  /**
+   * Register a portal through which source can pass payloads of up to
+   * max_payload bytes to target.
+   *
+   * entry executes inside target and receives the payload as a span of memory
+   * owned by target, followed by the data pointer of target if it has data.
+   * The span is only valid for the duration of the call, as the next call
+   * through the portal reuses its memory.
+   *
+   * A call through the portal is not a direct switch between the
+   * compartments. It is a callback out of source wrapping a nested invocation
+   * of target, so it takes one transition pair more than source returning to
+   * Monza core for the latter to invoke target. What it avoids is source
+   * having to return before target runs, with the payload validated and
+   * copied by Monza core on the way.
+   *
+   * Sources must not be concurrent, as another core could otherwise modify
+   * the payload while it is copied. Both compartments must outlive the
+   * portal.
+   */
+  template<typename Source, typename Target, typename Entry>
+  auto register_portal(
+    Source& source, Target& target, size_t max_payload, Entry entry)
+  {
+    if (source.is_concurrent())
+    {
+      LOG_MOD(ERROR, Compartment)
+        << "Portals cannot be registered for concurrent compartments."
+        << LOG_ENDL;
+      kabort();
+    }
+
+    auto memory = std::make_shared<CompartmentMemory<uint8_t, false>>(
+      target.template alloc_compartment_memory<uint8_t, false>(max_payload));
+    auto callback = source.register_callback(
+      [&target, entry, source_owner = source.get_owner(), memory, max_payload](
+        uintptr_t base, size_t size) {
+        return portal_dispatch(
+          target,
+          entry,
+          source_owner,
+          std::span<uint8_t>(memory->get_ptr(), max_payload),
+          base,
+          size);
+      });
+    return CompartmentPortal<decltype(callback)>(callback);
+  }
+}
@@ -0,0 +1,203 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <algorithm>
+#include <arch_compartment.h>
+#include <atomic>
+#include <compartment_grant.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <logging.h>
+#include <snmalloc.h>
+#include <span>
+
+namespace monza
+{
+  /**
+   * Consumer side of a CompartmentRingbuffer, used from inside the
+   * compartment. Only holds pointers into the granted memory, so it can be
+   * captured by value by lambdas passed to Compartment::invoke.
+   */
+  class CompartmentRingbufferReader
+  {
+    const std::atomic<size_t>* head;
+    std::atomic<size_t>* tail;
+    const uint8_t* data;
+    size_t capacity;
+
+  public:
+    constexpr CompartmentRingbufferReader(
+      const std::atomic<size_t>* head,
+      std::atomic<size_t>* tail,
+      const uint8_t* data,
+      size_t capacity)
+    : head(head), tail(tail), data(data), capacity(capacity)
+    {}
+
+    /**
+     * Number of bytes ready to be read.
+     */
+    size_t available() const
+    {
+      return head->load(std::memory_order_acquire) -
+        tail->load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Copy up to destination.size() bytes out of the ringbuffer and release
+     * the space to the producer. Returns the number of bytes read.
+     */
+    size_t read(std::span<uint8_t> destination) const
+    {
+      auto current_tail = tail->load(std::memory_order_relaxed);
+      auto count = std::min(
+        head->load(std::memory_order_acquire) - current_tail,
+        destination.size());
+      auto offset = current_tail & (capacity - 1);
+      auto first_part = std::min(count, capacity - offset);
+      memcpy(destination.data(), data + offset, first_part);
+      memcpy(destination.data() + first_part, data, count - first_part);
+      tail->store(current_tail + count, std::memory_order_release);
+      return count;
+    }
+  };
+
+  /**
+   * Single-producer single-consumer byte stream from Monza core into a
+   * long-lived compartment, built on top of CompartmentGrant.
+   *
+   * The memory is owned by Monza core and laid out as a consumer control page,
+   * which is granted writable, followed by a producer control page and the
+   * data area, which are granted read-only. This avoids both the copy into
+   * compartment-owned memory and the pagetable update per transfer that a
+   * scoped grant would need. The consumer index is writable by the compartment
+   * and is thus validated before every use by the producer.
+   */
+  class CompartmentRingbuffer
+  {
+    struct ControlPage
+    {
+      alignas(PAGE_SIZE) std::atomic<size_t> index;
+    };
+
+    static_assert(sizeof(ControlPage) == PAGE_SIZE);
+
+    uint8_t* memory;
+    size_t capacity;
+    size_t head;
+    CompartmentGrant consumer_grant;
+    CompartmentGrant producer_grant;
+
+    size_t allocation_size() const
+    {
+      return 2 * sizeof(ControlPage) + capacity;
+    }
+
+    ControlPage* consumer_control() const
+    {
+      return reinterpret_cast<ControlPage*>(memory);
+    }
+
+    ControlPage* producer_control() const
+    {
+      return reinterpret_cast<ControlPage*>(memory + sizeof(ControlPage));
+    }
+
+    uint8_t* data() const
+    {
+      return memory + 2 * sizeof(ControlPage);
+    }
+
+  public:
+    /**
+     * Create a ringbuffer for the given compartment. The capacity is rounded
+     * up to a power of two of at least a page.
+     */
+    CompartmentRingbuffer(
+      ArchitecturalCompartmentBase& compartment, size_t requested_capacity)
+    : capacity(snmalloc::bits::next_pow2(
+        std::max(requested_capacity, static_cast<size_t>(PAGE_SIZE)))),
+      head(0)
+    {
+      memory = static_cast<uint8_t*>(
+        snmalloc::ThreadAlloc::get().alloc<snmalloc::ZeroMem::YesZero>(
+          allocation_size()));
+      if (memory == nullptr || snmalloc::address_cast(memory) % PAGE_SIZE != 0)
+      {
+        LOG_MOD(ERROR, Compartment)
+          << "Failed to allocate page-aligned memory for ringbuffer."
+          << LOG_ENDL;
+        kabort();
+      }
+
+      consumer_grant = CompartmentGrant(
+        compartment,
+        std::span<const uint8_t>(memory, sizeof(ControlPage)),
+        GrantPermission::ReadWrite);
+      producer_grant = CompartmentGrant(
+        compartment,
+        std::span<const uint8_t>(
+          memory + sizeof(ControlPage), sizeof(ControlPage) + capacity),
+        GrantPermission::Read);
+      if (!consumer_grant.is_granted() || !producer_grant.is_granted())
+      {
+        LOG_MOD(ERROR, Compartment)
+          << "Failed to grant ringbuffer to compartment." << LOG_ENDL;
+        kabort();
+      }
+    }
+
+    CompartmentRingbuffer(const CompartmentRingbuffer&) = delete;
+    CompartmentRingbuffer(CompartmentRingbuffer&&) = delete;
+
+    ~CompartmentRingbuffer()
+    {
+      consumer_grant.revoke();
+      producer_grant.revoke();
+      snmalloc::ThreadAlloc::get().dealloc(memory);
+    }
+
+    /**
+     * Copy as much of source into the ringbuffer as there is space for.
+     * Returns the number of bytes written, or 0 if the consumer index was
+     * corrupted by the compartment.
+     */
+    size_t write(std::span<const uint8_t> source)
+    {
+      auto tail = consumer_control()->index.load(std::memory_order_acquire);
+      auto used = head - tail;
+      if (used > capacity)
+      {
+        LOG_MOD(ERROR, Compartment)
+          << "Ringbuffer consumer index " << tail
+          << " is inconsistent with producer index " << head << "."
+          << LOG_ENDL;
+        return 0;
+      }
+
+      auto count = std::min(capacity - used, source.size());
+      auto offset = head & (capacity - 1);
+      auto first_part = std::min(count, capacity - offset);
+      memcpy(data() + offset, source.data(), first_part);
+      memcpy(data(), source.data() + first_part, count - first_part);
+      head += count;
+      producer_control()->index.store(head, std::memory_order_release);
+      return count;
+    }
+
+    /**
+     * Create the view that the compartment uses to consume the data.
+     */
+    CompartmentRingbufferReader get_reader() const
+    {
+      return CompartmentRingbufferReader(
+        &producer_control()->index,
+        &consumer_control()->index,
+        data(),
+        capacity);
+    }
+  };
+}
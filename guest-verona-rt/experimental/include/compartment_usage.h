@@ -0,0 +1,78 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace monza
+{
+  /**
+   * Snapshot of the resources consumed by a compartment.
+   *
+   * Time is measured in architectural ticks. total_cycles covers every
+   * outermost invocation from entry to exit, while kernel_cycles covers the
+   * part of it spent in Monza core servicing allocations and callbacks on
+   * behalf of the compartment. Nested invocations of the same compartment from
+   * within its callbacks are attributed to the compartment rather than to the
+   * callback. Page faults taken by the compartment are counted together with
+   * the pages they mapped, which exceeds the faults when fault-around applies.
+   * allocator_calls counts the requests of the compartment allocator to Monza
+   * core for memory, which chunk leases batch.
+   */
+  struct CompartmentUsage
+  {
+    uint64_t invocations = 0;
+    uint64_t total_cycles = 0;
+    uint64_t kernel_cycles = 0;
+    uint64_t allocator_calls = 0;
+    size_t bytes_owned = 0;
+    size_t peak_bytes_owned = 0;
+    size_t pagetable_pages = 0;
+    size_t stacks = 0;
+    size_t page_faults = 0;
+    size_t fault_mapped_pages = 0;
+
+    uint64_t compartment_cycles() const
+    {
+      return total_cycles - kernel_cycles;
+    }
+  };
+
+  enum class QuotaAction
+  {
+    // Refuse the request, letting the compartment handle the failure.
+    Fail,
+    // Invalidate the compartment.
+    Invalidate
+  };
+
+  /**
+   * Limits on the resources a compartment can consume. Defaults to unlimited.
+   *
+   * The memory limit applies to requests made by the compartment itself and is
+   * checked before they are serviced, with on_memory_exceeded deciding the
+   * outcome. Memory allocated by Monza core on behalf of the compartment, such
+   * as its stacks, is accounted but never refused. The cycle limit is checked
+   * on every invocation and invalidates the compartment once exceeded. The
+   * stack limit bounds the nesting of invocations through callbacks and
+   * refuses invocations beyond it.
+   *
+   * The deadline limits the cycles of each single invocation, including time
+   * spent in Monza core on its behalf. On expiry the watchdog of the core
+   * aborts the invocation as if the compartment faulted, which invalidates
+   * it. Nested invocations run within the earliest enclosing deadline. The
+   * abort is deferred while Monza core services the compartment, and the
+   * deadline is only enforced where watchdog_supported() holds.
+   */
+  struct CompartmentQuota
+  {
+    size_t max_bytes = std::numeric_limits<size_t>::max();
+    uint64_t max_cycles = std::numeric_limits<uint64_t>::max();
+    size_t max_stacks = std::numeric_limits<size_t>::max();
+    uint64_t max_invoke_cycles = std::numeric_limits<uint64_t>::max();
+    QuotaAction on_memory_exceeded = QuotaAction::Fail;
+  };
+}
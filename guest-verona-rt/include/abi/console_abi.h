@@ -0,0 +1,50 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Layout of the console channel shared between the guest and the host, placed
+ * at the end of the IO shared memory. Included by both sides, so it must not
+ * depend on any other Monza header.
+ *
+ * The host enables the channel by writing CONSOLE_MAGIC before the guest
+ * boots. The guest then appends its output to the byte ring and publishes it
+ * by advancing write_position, while the host drains it and advances
+ * read_position. Positions grow monotonically and are reduced modulo
+ * CONSOLE_CAPACITY. Each side validates the position written by the other.
+ */
+namespace monza::abi
+{
+  constexpr uint64_t CONSOLE_MAGIC = 0x31656c6f736e6f4d; // "Monsole1"
+  constexpr size_t CONSOLE_HEADER_SIZE = 4096;
+  constexpr size_t CONSOLE_CAPACITY = 1024 * 1024;
+  constexpr size_t CONSOLE_REGION_SIZE = CONSOLE_HEADER_SIZE + CONSOLE_CAPACITY;
+
+  struct ConsoleHeader
+  {
+    uint64_t magic;
+    uint8_t magic_padding[56];
+    // Written by the guest only.
+    std::atomic<uint64_t> write_position;
+    uint8_t write_padding[56];
+    // Written by the host only.
+    std::atomic<uint64_t> read_position;
+  };
+
+  static_assert(sizeof(ConsoleHeader) <= CONSOLE_HEADER_SIZE);
+  static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+  /**
+   * Offset of the console region from the start of the shared memory of the
+   * given size.
+   */
+  constexpr size_t console_offset(size_t shared_memory_size)
+  {
+    return shared_memory_size - CONSOLE_REGION_SIZE;
+  }
+}
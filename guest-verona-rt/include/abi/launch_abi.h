@@ -0,0 +1,59 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <metrics_abi.h>
+
+/**
+ * Layout of the launch handshake page shared between the guest and the host,
+ * placed just below the metrics page in the IO shared memory. Included by
+ * both sides, so it must not depend on any other Monza header.
+ *
+ * A host which wants to boot a guest ahead of time writes the magic and sets
+ * state to LaunchHold before starting it. The guest then finishes booting and
+ * initializing, sets state to LaunchReady and holds until the host, having
+ * written the initialization arguments and the instance identifier, sets
+ * state to LaunchGo. Guests whose host did not ask to hold run on directly.
+ *
+ * A guest held in LaunchReady can be snapshotted. A host restoring the
+ * snapshot into new shared memory writes the magic and LaunchReady again, so
+ * that the restored guest keeps holding, and releases it with LaunchRestored
+ * instead of LaunchGo.
+ */
+namespace monza::abi
+{
+  constexpr uint64_t LAUNCH_MAGIC = 0x313068636e4c4d4d; // "MMLnch01"
+  constexpr size_t LAUNCH_REGION_SIZE = 4096;
+
+  enum LaunchState : uint64_t
+  {
+    LaunchHold = 1,
+    LaunchReady = 2,
+    LaunchGo = 3,
+    LaunchRestored = 4,
+  };
+
+  struct LaunchHeader
+  {
+    // Written by the host only, before starting the guest.
+    uint64_t magic;
+    std::atomic<uint64_t> state;
+    // Written by the host only, before releasing the guest.
+    uint64_t instance_id;
+  };
+
+  static_assert(sizeof(LaunchHeader) <= LAUNCH_REGION_SIZE);
+
+  /**
+   * Offset of the launch page from the start of the shared memory of the
+   * given size. Host allocations in the shared memory end below it.
+   */
+  constexpr size_t launch_offset(size_t shared_memory_size)
+  {
+    return metrics_offset(shared_memory_size) - LAUNCH_REGION_SIZE;
+  }
+}
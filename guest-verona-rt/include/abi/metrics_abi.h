@@ -0,0 +1,89 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <profile_abi.h>
+
+/**
+ * Layout of the runtime metrics page shared between the guest and the host,
+ * placed just below the profile buffers in the IO shared memory. Included by
+ * both sides, so it must not depend on any other Monza header.
+ *
+ * The guest fills in the header, sets ready and then keeps counting into a
+ * fixed block of counters per core. The host may read the counters at any
+ * time without synchronising with the guest, each of them being a monotonic
+ * 64-bit value.
+ *
+ * Metrics are only ever appended, so that a host reading counter_count
+ * counters can handle guests from both older and newer builds. Any other
+ * change to the layout requires a new version.
+ */
+namespace monza::abi
+{
+  constexpr uint64_t METRICS_MAGIC = 0x31307274654d4d4d; // "MMMetr01"
+  constexpr uint64_t METRICS_VERSION = 1;
+  constexpr size_t METRICS_HEADER_SIZE = 4096;
+  constexpr size_t METRICS_CORE_SIZE = 512;
+  constexpr size_t METRICS_MAX_CORES = 256;
+  constexpr size_t METRICS_REGION_SIZE =
+    METRICS_HEADER_SIZE + METRICS_MAX_CORES * METRICS_CORE_SIZE;
+
+  /**
+   * Index of each counter in the block of a core. Also used from assembly,
+   * see macros.asm.
+   */
+  enum class Metric : uint32_t
+  {
+    IpiSent = 0,
+    IpiReceived = 1,
+    SemaphoreSleep = 2,
+    SemaphoreWake = 3,
+    ThreadSubmit = 4,
+    CompartmentEnter = 5,
+    CompartmentAbort = 6,
+    PageFaultStack = 7,
+    PageFaultOwned = 8,
+    PageFaultShared = 9,
+    ForwardedAllocChunk = 10,
+    ForwardedLeaseChunks = 11,
+    LogBytes = 12,
+    LogDropped = 13,
+    Count
+  };
+
+  struct MetricsCore
+  {
+    std::atomic<uint64_t> counters[METRICS_CORE_SIZE / sizeof(uint64_t)];
+  };
+
+  static_assert(sizeof(MetricsCore) == METRICS_CORE_SIZE);
+  static_assert(
+    static_cast<size_t>(Metric::Count) <=
+    METRICS_CORE_SIZE / sizeof(uint64_t));
+
+  struct MetricsHeader
+  {
+    // Written by the guest only, before setting ready.
+    uint64_t magic;
+    uint64_t version;
+    uint64_t core_count;
+    uint64_t counter_count;
+    std::atomic<uint64_t> ready;
+  };
+
+  static_assert(sizeof(MetricsHeader) <= METRICS_HEADER_SIZE);
+
+  /**
+   * Offset of the metrics page from the start of the shared memory of the
+   * given size. The block of core i follows the header at offset
+   * i * METRICS_CORE_SIZE.
+   */
+  constexpr size_t metrics_offset(size_t shared_memory_size)
+  {
+    return profile_offset(shared_memory_size) - METRICS_REGION_SIZE;
+  }
+}
@@ -0,0 +1,93 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <trace_abi.h>
+
+/**
+ * Layout of the sampling profiler buffers shared between the guest and the
+ * host, placed just below the trace buffers in the IO shared memory. Included
+ * by both sides, so it must not depend on any other Monza header.
+ *
+ * The host requests profiling by writing the sampling frequency and then
+ * PROFILE_MAGIC before the guest boots. The guest then splits the region
+ * between its cores, describes the split in the header, sets ready and starts
+ * the sampling timer of each core as it comes up. Each core records samples
+ * into its own ring, overwriting the oldest once full. The host reads the
+ * buffers once the guest has stopped.
+ */
+namespace monza::abi
+{
+  constexpr uint64_t PROFILE_MAGIC = 0x3130666f72504d4d; // "MMProf01"
+  constexpr size_t PROFILE_HEADER_SIZE = 4096;
+  // Reserved in the shared memory whether or not profiling is requested, so
+  // kept small. Holds about 4K samples, split between the cores.
+  constexpr size_t PROFILE_REGION_SIZE = 1024 * 1024;
+  constexpr size_t PROFILE_CORE_HEADER_SIZE = 64;
+  constexpr uint64_t PROFILE_DEFAULT_FREQUENCY = 997;
+  // Return addresses recorded per sample after the interrupted instruction.
+  constexpr size_t PROFILE_MAX_FRAMES = 28;
+
+  enum ProfileSampleFlags : uint32_t
+  {
+    // The core was executing compartment code.
+    ProfileInCompartment = 1,
+    // The stack walk stopped at PROFILE_MAX_FRAMES rather than at its end.
+    ProfileTruncated = 2
+  };
+
+  struct ProfileSample
+  {
+    uint64_t tick;
+    // Owner of the interrupted compartment, zero for Monza core.
+    uint64_t owner;
+    uint32_t flags;
+    // Number of valid entries in frames.
+    uint32_t frame_count;
+    uint64_t rip;
+    // Return addresses, innermost first. Empty for samples of compartments,
+    // and unless built with MONZA_FRAME_POINTERS.
+    uint64_t frames[PROFILE_MAX_FRAMES];
+  };
+
+  static_assert(sizeof(ProfileSample) == 256);
+
+  struct ProfileHeader
+  {
+    // Written by the host only, before the magic.
+    uint64_t magic;
+    uint64_t frequency;
+    // Written by the guest only, before setting ready.
+    uint64_t tsc_frequency;
+    uint64_t core_count;
+    uint64_t core_stride;
+    uint64_t samples_per_core;
+    std::atomic<uint64_t> ready;
+  };
+
+  static_assert(sizeof(ProfileHeader) <= PROFILE_HEADER_SIZE);
+
+  /**
+   * Header of the buffer of each core, followed by its samples. The sample
+   * for position p is stored at index p % samples_per_core.
+   */
+  struct ProfileCoreHeader
+  {
+    std::atomic<uint64_t> write_position;
+  };
+
+  static_assert(sizeof(ProfileCoreHeader) <= PROFILE_CORE_HEADER_SIZE);
+
+  /**
+   * Offset of the profile region from the start of the shared memory of the
+   * given size.
+   */
+  constexpr size_t profile_offset(size_t shared_memory_size)
+  {
+    return trace_offset(shared_memory_size) - PROFILE_REGION_SIZE;
+  }
+}
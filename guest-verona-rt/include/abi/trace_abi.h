@@ -0,0 +1,94 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <atomic>
+#include <console_abi.h>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Layout of the kernel trace buffers shared between the guest and the host,
+ * placed just below the console in the IO shared memory. Included by both
+ * sides, so it must not depend on any other Monza header.
+ *
+ * The host requests tracing by writing TRACE_MAGIC before the guest boots.
+ * The guest then splits the region between its cores, describes the split in
+ * the header and sets ready. Each core records events into its own ring of
+ * records, overwriting the oldest once full. The host reads the buffers once
+ * the guest has stopped.
+ */
+namespace monza::abi
+{
+  constexpr uint64_t TRACE_MAGIC = 0x3165636172746d4d; // "MMTrace1"
+  constexpr size_t TRACE_HEADER_SIZE = 4096;
+  // Reserved in the shared memory whether or not tracing is requested, so
+  // kept small. Holds about 32K records, split between the cores.
+  constexpr size_t TRACE_REGION_SIZE = 1024 * 1024;
+  constexpr size_t TRACE_CORE_HEADER_SIZE = 64;
+
+  enum class TraceEvent : uint32_t
+  {
+    // Arguments: compartment.
+    CompartmentEnter = 1,
+    // Arguments: compartment, whether the invocation succeeded.
+    CompartmentExit = 2,
+    // Arguments: destination core, vector.
+    IpiSend = 3,
+    // Arguments: waiting thread.
+    SemaphoreSleep = 4,
+    // Arguments: waiting thread.
+    SemaphoreWake = 5,
+    // Arguments: faulting address, error code.
+    PageFault = 6,
+    // Arguments: compartment, chunk size.
+    AllocChunk = 7,
+    // Arguments: compartment, chunk size.
+    LeaseChunks = 8
+  };
+
+  struct TraceRecord
+  {
+    uint64_t tick;
+    TraceEvent event;
+    uint32_t reserved;
+    uint64_t arguments[2];
+  };
+
+  static_assert(sizeof(TraceRecord) == 32);
+
+  struct TraceHeader
+  {
+    // Written by the host only.
+    uint64_t magic;
+    // Written by the guest only, before setting ready.
+    uint64_t tsc_frequency;
+    uint64_t core_count;
+    uint64_t core_stride;
+    uint64_t records_per_core;
+    std::atomic<uint64_t> ready;
+  };
+
+  static_assert(sizeof(TraceHeader) <= TRACE_HEADER_SIZE);
+
+  /**
+   * Header of the buffer of each core, followed by its records. The record
+   * for position p is stored at index p % records_per_core.
+   */
+  struct TraceCoreHeader
+  {
+    std::atomic<uint64_t> write_position;
+  };
+
+  static_assert(sizeof(TraceCoreHeader) <= TRACE_CORE_HEADER_SIZE);
+
+  /**
+   * Offset of the trace region from the start of the shared memory of the
+   * given size.
+   */
+  constexpr size_t trace_offset(size_t shared_memory_size)
+  {
+    return console_offset(shared_memory_size) - TRACE_REGION_SIZE;
+  }
+}
@@ -0,0 +1,13 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+namespace monza
+{
+  void setup_console();
+  size_t console_write(std::span<const unsigned char> buffer);
+}
@@ -20,10 +20,13 @@ namespace monza
   } __attribute__((packed));
 
   size_t get_core_count();
+  size_t get_current_core();
   ThreadExecutionContext& get_thread_execution_context(size_t core_id);
   void reset_core(size_t core_id, void* stack_ptr, void* tls_ptr);
   void ping_core_sync(size_t core_id);
   void ping_all_cores_sync();
+  void flush_tlb_cores_sync(void* pagetable_root);
+  void start_profiling_cores_sync();
   extern "C" void acquire_semaphore(snmalloc::TrivialInitAtomic<size_t>&);
 }
 
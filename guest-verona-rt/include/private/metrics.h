@@ -0,0 +1,16 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+#include <metrics_abi.h>
+
+namespace monza
+{
+  void setup_metrics();
+  void count_metric(abi::Metric metric, uint64_t value = 1) noexcept;
+}
+
+// Globals accessed from assembly so avoid namespacing
+extern monza::abi::MetricsCore* metrics_cores;
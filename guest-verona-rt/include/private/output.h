@@ -5,6 +5,7 @@
 
 #include <compartment_callback.h>
 #include <cstddef>
+#include <span>
 #include <tcb.h>
 #include <writebuffers.h>
 
@@ -13,5 +14,34 @@ namespace monza
   size_t kwritev_stdout(WriteBuffers buffers);
   size_t kwritev_stdout_protected(CompartmentOwner owner, WriteBuffers buffers);
 
+  /**
+   * Set up the per-core log rings. Writes are synchronous before this.
+   */
+  void setup_output();
+  void flush_output();
+  /**
+   * Total number of writes dropped because the log ring of their core was
+   * full.
+   */
+  size_t get_output_dropped();
+
+  /**
+   * Function observing every buffer written to the console, called with the
+   * output lock held so that buffers are observed in the order written.
+   */
+  using OutputObserver = void (*)(std::span<const unsigned char> buffer);
+  /**
+   * Install an observer of the console output, or remove it if null. Output
+   * buffered before the call is written out first, so it is not observed.
+   * Intended for tests checking the order and completeness of the output.
+   */
+  void set_output_observer(OutputObserver observer);
+  /**
+   * Run a function attaching to new shared memory with the output lock held,
+   * so that no core writes to the console meanwhile. Output buffered by the
+   * cores in the meantime is written out to the new console afterwards.
+   */
+  void reattach_output(void (*reattach)());
+
   extern thread_local StdoutCallback compartment_kwrite_stdout;
 }
@@ -0,0 +1,9 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+namespace monza
+{
+  void setup_profiling();
+}
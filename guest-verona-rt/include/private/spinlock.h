@@ -14,6 +14,11 @@ namespace monza
 
   public:
     void acquire();
+    /**
+     * Acquire the lock if it is free, without waiting. Returns whether it was
+     * acquired.
+     */
+    bool try_acquire();
     void release();
   };
 
@@ -0,0 +1,29 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+#include <trace_abi.h>
+
+namespace monza
+{
+  void setup_trace();
+  void trace_event(
+    abi::TraceEvent event, uint64_t argument0, uint64_t argument1) noexcept;
+}
+
+/**
+ * Record a kernel event into the trace buffer of the current core, if the
+ * host requested tracing. Compiled out, arguments included, unless built with
+ * MONZA_TRACING.
+ */
+#ifdef MONZA_TRACING
+#  define MONZA_TRACE(event, argument0, argument1) \
+    monza::trace_event( \
+      monza::abi::TraceEvent::event, \
+      static_cast<uint64_t>(argument0), \
+      static_cast<uint64_t>(argument1))
+#else
+#  define MONZA_TRACE(event, argument0, argument1) ((void)0)
+#endif
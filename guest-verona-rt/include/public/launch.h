@@ -0,0 +1,39 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+
+namespace monza
+{
+  /**
+   * Report that the guest has finished initializing and hold until released,
+   * if the host booted the guest ahead of time or snapshots it. Returns at
+   * once otherwise. Everything done before the call is skipped by guests
+   * restored from a snapshot. Only the first call holds, later ones return
+   * its result. Unless defer_launch() is defined, the runtime already holds
+   * before main().
+   *
+   * Returns true if the guest was restored from a snapshot, in which case the
+   * runtime has already attached to the new shared memory and restarted the
+   * clock, but any randomness drawn before the call is shared with the other
+   * guests restored from the same snapshot and must be drawn again.
+   */
+  bool wait_for_launch();
+
+  /**
+   * Optional hook for application frameworks which hold in wait_for_launch()
+   * themselves once their own initialization is done. If it returns true,
+   * the runtime does not hold before main(), so the framework must call
+   * wait_for_launch() for the guest to be booted ahead of time.
+   */
+  bool defer_launch() __attribute__((weak));
+
+  /**
+   * Random identifier given by the host to this launch of the guest, distinct
+   * between guests restored from the same snapshot. Zero if the host did not
+   * hold the guest.
+   */
+  uint64_t get_instance_id();
+}
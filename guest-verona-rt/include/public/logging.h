@@ -8,6 +8,11 @@
 #include <span>
 #include <tcb.h>
 
+#if defined(MONZA_BINARY_LOGGING) && !defined(MONZA_COMPARTMENT_NAMESPACE)
+extern char __rodata_start;
+extern char __rodata_end;
+#endif
+
 namespace monza
 {
   extern void output_log_entry(std::span<const unsigned char> str) noexcept;
@@ -39,90 +44,90 @@ namespace monza
 #endif
 
   /**
-   * Logging stream that works without dependencies on libc or libcxx
-   * initialization. Requires consteval constructor to worh before global and/or
-   * TLS initialization. Uses some methods with known trivial implementations,
-   * such as strlen, memcpy and span.
+   * Buffer wrapper with consteval constructor.
+   * std::array and its iterator does not give the needed interface.
+   * Encapsulates position tracking to avoid errors in parsing code.
    */
-  class LoggerStream
+  class LoggingBuffer
   {
+    unsigned char buffer[CURRENT_LOG_BUFFER_SIZE] = {};
+    size_t position = 0;
+
+  public:
     /**
-     * Different bases defined for integer conversion.
+     * Detect in advance if a particular input size will not fit into the
+     * buffer. Return false if the input size will not fit.
      */
-    enum class IntegerBase : uint8_t
+    inline size_t remaining_space() const noexcept
     {
-      Decimal = 10,
-      Hex = 16
-    };
+      return std::size(buffer) - position;
+    }
 
     /**
-     * Buffer wrapper with consteval constructor.
-     * std::array and its iterator does not give the needed interface.
-     * Encapsulates position tracking to avoid errors in parsing code.
+     * Append input range into the buffer if it fits.
+     * Returns false if the input did not fit and was skipped.
      */
-    class LoggingBuffer
+    inline bool append(std::span<const unsigned char> input) noexcept
     {
-      unsigned char buffer[CURRENT_LOG_BUFFER_SIZE] = {};
-      size_t position = 0;
-
-    public:
-      /**
-       * Detect in advance if a particular input size will not fit into the
-       * buffer. Return false if the input size will not fit.
-       */
-      inline size_t remaining_space() const noexcept
+      if (remaining_space() < std::size(input))
       {
-        return std::size(buffer) - position;
+        return false;
       }
 
-      /**
-       * Append input range into the buffer if it fits.
-       * Returns false if the input did not fit and was skipped.
-       */
-      inline bool append(std::span<const unsigned char> input) noexcept
-      {
-        if (remaining_space() < std::size(input))
-        {
-          return false;
-        }
-
-        memcpy(buffer + position, input.data(), std::size(input));
-        position += std::size(input);
+      memcpy(buffer + position, input.data(), std::size(input));
+      position += std::size(input);
 
-        return true;
-      }
+      return true;
+    }
 
-      /**
-       * Reserve a particular range in the buffer to be filled in.
-       * Returns span with 0 length if the requested size does not fit.
-       * Returns subspan into buffer of the requested size on success.
-       */
-      std::span<unsigned char> reserve(size_t size) noexcept
+    /**
+     * Reserve a particular range in the buffer to be filled in.
+     * Returns span with 0 length if the requested size does not fit.
+     * Returns subspan into buffer of the requested size on success.
+     */
+    std::span<unsigned char> reserve(size_t size) noexcept
+    {
+      if (remaining_space() < size)
       {
-        if (remaining_space() < size)
-        {
-          return std::span<unsigned char>(nullptr, nullptr);
-        }
-        auto return_value = std::span(buffer).subspan(position, size);
-        position += size;
-        return return_value;
+        return std::span<unsigned char>(nullptr, nullptr);
       }
+      auto return_value = std::span(buffer).subspan(position, size);
+      position += size;
+      return return_value;
+    }
 
-      /**
-       * Reset the buffer content.
-       */
-      inline void reset() noexcept
-      {
-        position = 0;
-      }
+    /**
+     * Reset the buffer content.
+     */
+    inline void reset() noexcept
+    {
+      position = 0;
+    }
 
-      /**
-       * Get the current buffer content (not the full buffer extent).
-       */
-      inline std::span<const unsigned char> get_data() const noexcept
-      {
-        return std::span(buffer).subspan(0, position);
-      }
+    /**
+     * Get the current buffer content (not the full buffer extent).
+     */
+    inline std::span<const unsigned char> get_data() const noexcept
+    {
+      return std::span(buffer).subspan(0, position);
+    }
+  };
+
+  /**
+   * Logging stream that works without dependencies on libc or libcxx
+   * initialization. Requires consteval constructor to worh before global and/or
+   * TLS initialization. Uses some methods with known trivial implementations,
+   * such as strlen, memcpy and span.
+   */
+  class LoggerStream
+  {
+    /**
+     * Different bases defined for integer conversion.
+     */
+    enum class IntegerBase : uint8_t
+    {
+      Decimal = 10,
+      Hex = 16
     };
 
     LoggingBuffer buffer;
@@ -321,6 +326,200 @@ namespace monza
     }
   };
 
+#if defined(MONZA_BINARY_LOGGING) && !defined(MONZA_COMPARTMENT_NAMESPACE)
+  /**
+   * Static description of a logging site, placed in the .monza_log_sites
+   * section and identified at runtime by its address.
+   */
+  struct LogSite
+  {
+    const char* file;
+    uint64_t line;
+    const char* prefix;
+  };
+
+  /**
+   * Logging stream which defers formatting to the host. Each entry is written
+   * as a binary record holding the address of its LogSite, a TSC timestamp and
+   * the raw arguments, decoded against the ELF image by
+   * utils/decode_binary_log.py.
+   *
+   * Record layout: RECORD_MARKER, 16-bit little-endian payload length, then
+   * the payload of the 64-bit site address, the 64-bit timestamp and one
+   * tagged value per argument. Integers are LEB128-encoded, signed ones after
+   * zigzag encoding. Strings in the read-only data of the image are written as
+   * their address, others inline with their length. Arguments which do not fit
+   * are skipped.
+   */
+  class BinaryLoggerStream
+  {
+    enum class Tag : uint8_t
+    {
+      Unsigned = 1,
+      Signed = 2,
+      Pointer = 3,
+      StaticString = 4,
+      String = 5
+    };
+
+    static constexpr unsigned char RECORD_MARKER[] = {0x1e, 'M', 'L'};
+    static constexpr size_t HEADER_LENGTH = std::size(RECORD_MARKER) + 2;
+    // Tag and largest LEB128 encoding of a 64-bit value.
+    static constexpr size_t MAX_VALUE_LENGTH = 1 + 10;
+
+    LoggingBuffer buffer;
+    std::span<unsigned char> header;
+
+  public:
+    /**
+     * Start the entry of the given site.
+     */
+    inline BinaryLoggerStream& begin(const LogSite* site) noexcept
+    {
+      buffer.reset();
+      header = buffer.reserve(HEADER_LENGTH);
+      append_u64(reinterpret_cast<uintptr_t>(site));
+      append_u64(__builtin_ia32_rdtsc());
+      return *this;
+    }
+
+    inline BinaryLoggerStream& operator<<(const char* value) noexcept
+    {
+      if (
+        value >= &__rodata_start && value < &__rodata_end &&
+        buffer.remaining_space() >= MAX_VALUE_LENGTH)
+      {
+        append_tag(Tag::StaticString);
+        append_leb128(reinterpret_cast<uintptr_t>(value));
+        return *this;
+      }
+
+      if (buffer.remaining_space() < MAX_VALUE_LENGTH)
+      {
+        return *this;
+      }
+      size_t length = strlen(value);
+      // Truncate string if it does not fit, instead of throwing it all away.
+      if (length > buffer.remaining_space() - MAX_VALUE_LENGTH)
+      {
+        length = buffer.remaining_space() - MAX_VALUE_LENGTH;
+      }
+      append_tag(Tag::String);
+      append_leb128(length);
+      buffer.append(
+        std::span(reinterpret_cast<const unsigned char*>(value), length));
+      return *this;
+    }
+
+    inline BinaryLoggerStream& operator<<(const void* value) noexcept
+    {
+      if (buffer.remaining_space() >= 1 + sizeof(uint64_t))
+      {
+        append_tag(Tag::Pointer);
+        append_u64(reinterpret_cast<uintptr_t>(value));
+      }
+      return *this;
+    }
+
+    template<
+      typename T,
+      typename std::enable_if_t<std::is_signed_v<T>>* = nullptr>
+    inline BinaryLoggerStream& operator<<(const T& value) noexcept
+    {
+      if (buffer.remaining_space() >= MAX_VALUE_LENGTH)
+      {
+        auto extended = static_cast<int64_t>(value);
+        append_tag(Tag::Signed);
+        append_leb128(
+          (static_cast<uint64_t>(extended) << 1) ^
+          static_cast<uint64_t>(extended >> 63));
+      }
+      return *this;
+    }
+
+    template<
+      typename T,
+      typename std::enable_if_t<std::is_unsigned_v<T>>* = nullptr>
+    inline BinaryLoggerStream& operator<<(const T& value) noexcept
+    {
+      if (buffer.remaining_space() >= MAX_VALUE_LENGTH)
+      {
+        append_tag(Tag::Unsigned);
+        append_leb128(value);
+      }
+      return *this;
+    }
+
+    template<
+      typename T,
+      typename std::enable_if_t<std::is_enum_v<T>>* = nullptr>
+    inline BinaryLoggerStream& operator<<(const T& value) noexcept
+    {
+      *this << static_cast<std::underlying_type_t<T>>(value);
+
+      return *this;
+    }
+
+    /**
+     * Flush entry when endl_marker detected.
+     */
+    inline BinaryLoggerStream& operator<<(void (*)()) noexcept
+    {
+      flush();
+
+      return *this;
+    }
+
+  private:
+    inline void flush() noexcept
+    {
+      auto data = buffer.get_data();
+      auto payload_length = std::size(data) - HEADER_LENGTH;
+      memcpy(header.data(), RECORD_MARKER, std::size(RECORD_MARKER));
+      header[std::size(RECORD_MARKER)] =
+        static_cast<unsigned char>(payload_length);
+      header[std::size(RECORD_MARKER) + 1] =
+        static_cast<unsigned char>(payload_length >> 8);
+      output_log_entry(data);
+      buffer.reset();
+    }
+
+    inline void append_tag(Tag tag) noexcept
+    {
+      const unsigned char value[] = {static_cast<unsigned char>(tag)};
+      buffer.append(value);
+    }
+
+    inline void append_u64(uint64_t value) noexcept
+    {
+      unsigned char bytes[sizeof(uint64_t)];
+      memcpy(bytes, &value, sizeof(uint64_t));
+      buffer.append(bytes);
+    }
+
+    inline void append_leb128(uint64_t value) noexcept
+    {
+      unsigned char bytes[MAX_VALUE_LENGTH - 1];
+      size_t length = 0;
+      do
+      {
+        bytes[length] = static_cast<unsigned char>(value & 0x7f);
+        value >>= 7;
+        if (value != 0)
+        {
+          bytes[length] |= 0x80;
+        }
+        ++length;
+      } while (value != 0);
+      buffer.append(std::span(bytes, length));
+    }
+  };
+
+  using KernelLoggerStream = BinaryLoggerStream;
+#else
+  using KernelLoggerStream = LoggerStream;
+#endif
+
 #ifdef MONZA_COMPARTMENT_NAMESPACE
   /**
    * Static logger managing logging streams.
@@ -350,16 +549,16 @@ namespace monza
    */
   class Logger
   {
-    static thread_local constinit inline LoggerStream thread_local_stream;
-    __attribute__((monza_global)) __attribute__((
-      section(".data"))) static constinit inline LoggerStream global_stream;
+    static thread_local constinit inline KernelLoggerStream thread_local_stream;
+    __attribute__((monza_global)) __attribute__((section(
+      ".data"))) static constinit inline KernelLoggerStream global_stream;
 
   public:
     /**
      * Retreive the currently active stream.
      * get_tcb just reads the underlying TLS register so is safe to use early.
      */
-    inline static LoggerStream& stream() noexcept
+    inline static KernelLoggerStream& stream() noexcept
     {
       if (get_tcb() == nullptr)
       {
@@ -381,12 +580,32 @@ namespace monza
 #  define LOG(level) \
     if constexpr (monza::level >= monza::CURRENT_LOG_LEVEL) \
     monza::CompartmentLogger::stream() << (#level ": ")
+#elif defined(MONZA_BINARY_LOGGING)
+/**
+ * Emit the LogSite of the current logging site, with the level and module
+ * folded into its prefix, and return its address.
+ */
+#  define MONZA_LOG_SITE(prefix) \
+    ([]() noexcept { \
+      __attribute__((section(".monza_log_sites"), used)) static constexpr \
+        monza::LogSite site{__FILE__, __LINE__, prefix}; \
+      return &site; \
+    }())
+#  define LOG(level) \
+    if constexpr (monza::level >= monza::CURRENT_LOG_LEVEL) \
+    monza::Logger::stream().begin(MONZA_LOG_SITE(#level ": "))
 #else
 #  define LOG(level) \
     if constexpr (monza::level >= monza::CURRENT_LOG_LEVEL) \
     monza::Logger::stream() << (#level ": ")
 #endif
 
-#define LOG_MOD(level, module) LOG(level) << (#module ": ")
+#if defined(MONZA_BINARY_LOGGING) && !defined(MONZA_COMPARTMENT_NAMESPACE)
+#  define LOG_MOD(level, module) \
+    if constexpr (monza::level >= monza::CURRENT_LOG_LEVEL) \
+    monza::Logger::stream().begin(MONZA_LOG_SITE(#level ": " #module ": "))
+#else
+#  define LOG_MOD(level, module) LOG(level) << (#module ": ")
+#endif
 
 #define LOG_ENDL monza::LoggerStream::endl_marker
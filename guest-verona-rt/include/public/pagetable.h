@@ -22,11 +22,25 @@ namespace monza
     snmalloc::address_t base, size_t size, PagetablePermission perm);
   void* create_compartment_pagetable();
   void deallocate_compartment_pagetable(void* root);
+  /**
+   * Number of pagetable pages allocated for a compartment pagetable, not
+   * counting the ones shared with the kernel pagetable.
+   */
+  size_t count_compartment_pagetable_pages(void* root);
   void add_to_compartment_pagetable(
     void* root,
     snmalloc::address_t base,
     size_t size,
     PagetablePermission perm);
+  /**
+   * Like add_to_compartment_pagetable, but pages which are already mapped keep
+   * their existing permission.
+   */
+  void add_missing_to_compartment_pagetable(
+    void* root,
+    snmalloc::address_t base,
+    size_t size,
+    PagetablePermission perm);
   void remove_from_compartment_pagetable(
     void* root, snmalloc::address_t base, size_t size);
 }
\ No newline at end of file
@@ -21,12 +21,16 @@ namespace monza
 
   void* compartment_alloc_chunk(size_t size, uintptr_t ras);
 
+  void* compartment_lease_chunks(size_t size, uintptr_t ras, size_t count);
+
   void* compartment_alloc_meta_data(size_t size);
 
   void compartment_dealloc_chunk(void* p, size_t size);
 
   void notify_using(std::span<uint8_t> range);
 
+  void flush_tlb_cores_sync(void* pagetable_root);
+
   extern "C"
   {
     [[noreturn]] void kabort();
@@ -158,30 +162,129 @@ namespace monza
   constexpr size_t MIN_OWNERSHIP_BITS =
     snmalloc::bits::next_pow2_bits_const(MIN_OWNERSHIP_SIZE);
 
+  /**
+   * Upper bound on the number of chunks leased to a compartment at once.
+   */
+  constexpr size_t MAX_LEASE_CHUNKS = 16;
+
 } // namespace monza
 
 namespace snmalloc
 {
   using SlabMetadata = LaxProvenanceSlabMetadataMixin<FrontendSlabMetadata>;
 
+  /**
+   * Layout of the slab metadata of a chunk allocated by Monza core for a
+   * compartment, until the chunk is handed to the allocator of the compartment.
+   * Chunks leased together are linked through next.
+   */
+  struct LeasedChunk
+  {
+    capptr::Chunk<void> chunk;
+    LeasedChunk* next;
+  };
+  static_assert(sizeof(SlabMetadata) >= sizeof(LeasedChunk));
+
+  /**
+   * Chunks leased by the current compartment thread but not yet handed to its
+   * allocator.
+   *
+   * Monza core validates a lease once and sets up the pagemap for all of its
+   * chunks with the RAS they were requested for, so that further chunks for the
+   * same RAS are carved from the lease without a transition. Leases are kept
+   * in a few slots, evicting the oldest by returning its remaining chunks.
+   */
+  class CompartmentChunkLeases
+  {
+    static constexpr size_t SLOT_COUNT = 8;
+    // Chunks are leased to cover this many bytes, within MAX_LEASE_CHUNKS.
+    static constexpr size_t LEASE_BYTES = 256 * 1024;
+
+    struct Slot
+    {
+      uintptr_t ras = 0;
+      size_t size = 0;
+      LeasedChunk* head = nullptr;
+    };
+
+    Slot slots[SLOT_COUNT];
+    size_t next_eviction = 0;
+
+    Slot& find_slot()
+    {
+      for (auto& slot : slots)
+      {
+        if (slot.head == nullptr)
+        {
+          return slot;
+        }
+      }
+      auto& slot = slots[next_eviction];
+      next_eviction = (next_eviction + 1) % SLOT_COUNT;
+      while (slot.head != nullptr)
+      {
+        auto leased = slot.head;
+        auto chunk = leased->chunk;
+        slot.head = leased->next;
+        memset(leased, 0, sizeof(LeasedChunk));
+        monza::compartment_dealloc_chunk(chunk.unsafe_ptr(), slot.size);
+      }
+      return slot;
+    }
+
+  public:
+    LeasedChunk* take(size_t size, uintptr_t ras)
+    {
+      for (auto& slot : slots)
+      {
+        if (slot.head != nullptr && slot.ras == ras && slot.size == size)
+        {
+          auto leased = slot.head;
+          slot.head = leased->next;
+          return leased;
+        }
+      }
+
+      auto count =
+        std::clamp<size_t>(LEASE_BYTES / size, 1, monza::MAX_LEASE_CHUNKS);
+      auto leased = static_cast<LeasedChunk*>(
+        monza::compartment_lease_chunks(size, ras, count));
+      if (leased != nullptr && leased->next != nullptr)
+      {
+        auto& slot = find_slot();
+        slot = {ras, size, leased->next};
+      }
+      return leased;
+    }
+  };
+
+  inline thread_local CompartmentChunkLeases compartment_chunk_leases;
+
   static std::pair<capptr::Chunk<void>, SlabMetadata*>
   compartment_alloc_chunk_wrapper(size_t size, uintptr_t ras)
   {
-    void* raw_result = monza::compartment_alloc_chunk(size, ras);
+    LeasedChunk* leased = compartment_chunk_leases.take(size, ras);
+    if (leased == nullptr)
+    {
+      return {nullptr, nullptr};
+    }
 
     // TODO should we just look up in the pagemap?
     //  Leave for now for simplicity.
 
-    capptr::Chunk<void> result_first(
-      *reinterpret_cast<capptr::Chunk<void>*>(raw_result));
-    memset(raw_result, 0, sizeof(decltype(result_first)));
-    SlabMetadata* result_second = reinterpret_cast<SlabMetadata*>(raw_result);
+    capptr::Chunk<void> result_first(leased->chunk);
+    memset(leased, 0, sizeof(LeasedChunk));
+    SlabMetadata* result_second = reinterpret_cast<SlabMetadata*>(leased);
     return {result_first, result_second};
   }
 
   static capptr::Alloc<void> compartment_alloc_meta_data_wrapper(size_t size)
   {
     void* raw_result = monza::compartment_alloc_meta_data(size);
+    if (raw_result == nullptr)
+    {
+      return nullptr;
+    }
     capptr::Alloc<void> result =
       *reinterpret_cast<capptr::Alloc<void>*>(raw_result);
     memset(raw_result, 0, sizeof(decltype(result)));
@@ -325,6 +428,288 @@ namespace snmalloc
     __attribute__((monza_global)) static inline MonzaOwnershipPagemap
       concreteCompartmentPagemap{};
 
+    /**
+     * Ownership is additionally summarised over naturally aligned blocks of
+     * 2^SUMMARY_FANOUT_BITS entries of the level below, with level 0 being the
+     * ownership pagemap itself. This allows validating large ranges with a
+     * number of lookups that is logarithmic in their size rather than linear.
+     */
+    static constexpr size_t SUMMARY_FANOUT_BITS = 6;
+    static constexpr size_t SUMMARY_LEVELS = 2;
+
+    static constexpr size_t summary_block_bits(size_t level)
+    {
+      return monza::MIN_OWNERSHIP_BITS + SUMMARY_FANOUT_BITS * level;
+    }
+
+    /**
+     * Summary of the ownership of a single block.
+     *
+     * Tracks how many ownership entries of the block have any owner and how
+     * many belong to the first owner added to the block while it was empty.
+     * If the counts match, all owned entries of the block share that owner.
+     * The version is a sequence lock, odd while an update is in progress.
+     * Writers take it to serialise updates of the same summary, while readers
+     * treat torn reads as inconclusive.
+     */
+    struct SummaryEntry
+    {
+      TrivialInitAtomic<size_t> version{};
+      TrivialInitAtomic<uintptr_t> owner{};
+      TrivialInitAtomic<size_t> owner_count{};
+      TrivialInitAtomic<size_t> total_count{};
+
+      constexpr SummaryEntry() = default;
+    };
+
+    /**
+     * Flat array of summaries for one level, covering the same range as the
+     * ownership pagemap.
+     */
+    struct SummaryLevel
+    {
+      SummaryEntry* entries{nullptr};
+      address_t base{0};
+      size_t count{0};
+
+      constexpr SummaryLevel() = default;
+    };
+
+    SNMALLOC_REQUIRE_CONSTINIT
+    __attribute__((monza_global)) static inline SummaryLevel
+      summary_levels[SUMMARY_LEVELS]{};
+
+    enum class SummaryVerdict
+    {
+      // Every ownership entry in the block belongs to the owner.
+      All,
+      // No ownership entry in the block belongs to the owner.
+      None,
+      // The summary cannot decide, the level below needs to be consulted.
+      Unknown
+    };
+
+    /**
+     * Allocate the summary arrays for a heap covering [base, base + length)
+     * from storage. Returns the end of the storage used.
+     */
+    static void* init_summaries(void* storage, address_t base, size_t length)
+    {
+      for (size_t level = 1; level <= SUMMARY_LEVELS; ++level)
+      {
+        auto& summary = summary_levels[level - 1];
+        auto block_size = bits::one_at_bit(summary_block_bits(level));
+        summary.base = bits::align_down(base, block_size);
+        summary.count =
+          (bits::align_up(base + length, block_size) - summary.base) /
+          block_size;
+        summary.entries = static_cast<SummaryEntry*>(storage);
+        storage = pointer_offset(storage, summary.count * sizeof(SummaryEntry));
+      }
+      return storage;
+    }
+
+    static SummaryEntry* get_summary(size_t level, address_t a)
+    {
+      auto& summary = summary_levels[level - 1];
+      if (a < summary.base)
+      {
+        return nullptr;
+      }
+      auto index = (a - summary.base) >> summary_block_bits(level);
+      if (index >= summary.count)
+      {
+        return nullptr;
+      }
+      return &summary.entries[index];
+    }
+
+    /**
+     * Take the sequence lock of a summary, returning the odd version to
+     * release it with.
+     */
+    static size_t lock_summary(SummaryEntry* summary)
+    {
+      while (true)
+      {
+        auto version = summary->version.load(std::memory_order_relaxed);
+        if (
+          (version & 1) == 0 &&
+          summary->version.compare_exchange_strong(
+            version, version + 1, std::memory_order_acquire))
+        {
+          // Order the updates after the odd version for readers.
+          std::atomic_thread_fence(std::memory_order_release);
+          return version + 1;
+        }
+        Aal::pause();
+      }
+    }
+
+    /**
+     * Account for size bytes starting at p gaining or losing the given owner
+     * in all summary levels. Each summary is locked on its own, so updates of
+     * unrelated blocks proceed in parallel.
+     */
+    template<bool adding>
+    static void update_summaries(
+      address_t p, size_t size, monza::CompartmentOwner owner)
+    {
+      auto owner_id = owner.as_uintptr_t();
+      for (size_t level = 1; level <= SUMMARY_LEVELS; ++level)
+      {
+        auto block_size = bits::one_at_bit(summary_block_bits(level));
+        for (address_t a = p; a < p + size;)
+        {
+          auto block_end = bits::align_down(a, block_size) + block_size;
+          auto end = std::min(p + size, block_end);
+          auto count = (end - a) >> monza::MIN_OWNERSHIP_BITS;
+          a = end;
+
+          auto summary = get_summary(level, a - 1);
+          if (summary == nullptr)
+          {
+            continue;
+          }
+
+          auto version = lock_summary(summary);
+          auto total = summary->total_count.load(std::memory_order_relaxed);
+          auto owned = summary->owner_count.load(std::memory_order_relaxed);
+          auto first_owner = summary->owner.load(std::memory_order_relaxed);
+          if constexpr (adding)
+          {
+            if (total == 0)
+            {
+              first_owner = owner_id;
+              owned = 0;
+            }
+            if (first_owner == owner_id)
+            {
+              owned += count;
+            }
+            total += count;
+          }
+          else
+          {
+            if (first_owner == owner_id)
+            {
+              owned -= count;
+            }
+            total -= count;
+            if (total == 0)
+            {
+              first_owner = monza::CompartmentOwner::null().as_uintptr_t();
+              owned = 0;
+            }
+          }
+          summary->owner.store(first_owner, std::memory_order_relaxed);
+          summary->owner_count.store(owned, std::memory_order_relaxed);
+          summary->total_count.store(total, std::memory_order_relaxed);
+          summary->version.store(version + 1, std::memory_order_release);
+        }
+      }
+    }
+
+    template<size_t level>
+    static SummaryVerdict
+    summarise(address_t block, monza::CompartmentOwner owner)
+    {
+      auto summary = get_summary(level, block);
+      if (summary == nullptr)
+      {
+        return SummaryVerdict::Unknown;
+      }
+
+      auto version = summary->version.load(std::memory_order_acquire);
+      if ((version & 1) != 0)
+      {
+        return SummaryVerdict::Unknown;
+      }
+      auto first_owner = summary->owner.load(std::memory_order_relaxed);
+      auto owned = summary->owner_count.load(std::memory_order_relaxed);
+      auto total = summary->total_count.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (summary->version.load(std::memory_order_relaxed) != version)
+      {
+        return SummaryVerdict::Unknown;
+      }
+
+      constexpr size_t full = bits::one_at_bit(SUMMARY_FANOUT_BITS * level);
+      auto owner_id = owner.as_uintptr_t();
+      if (owner == monza::CompartmentOwner::null())
+      {
+        if (total == 0)
+        {
+          return SummaryVerdict::All;
+        }
+        if (total == full)
+        {
+          return SummaryVerdict::None;
+        }
+      }
+      else
+      {
+        if (first_owner == owner_id && owned == full)
+        {
+          return SummaryVerdict::All;
+        }
+        if (total == 0 || (first_owner != owner_id && owned == total))
+        {
+          return SummaryVerdict::None;
+        }
+      }
+      return SummaryVerdict::Unknown;
+    }
+
+    /**
+     * Validate [start, end) against the summaries of the given level, only
+     * descending into blocks for which the summary is inconclusive.
+     */
+    template<size_t level>
+    static bool validate_owner_level(
+      monza::CompartmentOwner owner, address_t start, address_t end)
+    {
+      if constexpr (level == 0)
+      {
+        for (address_t a =
+               address_align_down<monza::MIN_OWNERSHIP_SIZE>(start);
+             a < end;
+             a += monza::MIN_OWNERSHIP_SIZE)
+        {
+          if (get_monza_owner<true>(a) != owner)
+          {
+            return false;
+          }
+        }
+        return true;
+      }
+      else
+      {
+        constexpr size_t block_size =
+          bits::one_at_bit(summary_block_bits(level));
+        for (address_t a = start; a < end;)
+        {
+          auto block = address_align_down<block_size>(a);
+          auto block_end = (end - block > block_size) ? block + block_size : end;
+          switch (summarise<level>(block, owner))
+          {
+            case SummaryVerdict::All:
+              break;
+            case SummaryVerdict::None:
+              return false;
+            case SummaryVerdict::Unknown:
+              if (!validate_owner_level<level - 1>(owner, a, block_end))
+              {
+                return false;
+              }
+              break;
+          }
+          a = block_end;
+        }
+        return true;
+      }
+    }
+
   public:
     /**
      * Get the Monza owner associated with a chunk.
@@ -369,6 +754,7 @@ namespace snmalloc
         if (owner_chunk_list_head != nullptr)
           owner_chunk_list_head->add(current_monza_entry_ref);
       }
+      update_summaries<true>(p, size, owner);
     }
 
     /**
@@ -396,6 +782,7 @@ namespace snmalloc
         current_monza_entry_ref.clear_owner();
         current_monza_entry_ref.remove();
       }
+      update_summaries<false>(p, size, owner);
     }
 
     /**
@@ -412,20 +799,21 @@ namespace snmalloc
 
     /**
      * Check that an address range is fully owned by the specified
-     * compartment.
+     * compartment. Every ownership entry overlapping the range is checked,
+     * using the ownership summaries to skip over uniformly owned blocks.
      */
     static bool validate_owner_range(
       monza::CompartmentOwner owner, snmalloc::address_t p, size_t size)
     {
-      for (snmalloc::address_t a = p; a < p + size;
-           a += monza::MIN_OWNERSHIP_SIZE)
+      if (size == 0)
       {
-        if (get_monza_owner<true>(a) != owner)
-        {
-          return false;
-        }
+        return true;
       }
-      return true;
+      if (p + size < p)
+      {
+        return false;
+      }
+      return validate_owner_level<SUMMARY_LEVELS>(owner, p, p + size);
     }
 
     template<typename Pagemap>
@@ -442,6 +830,52 @@ namespace snmalloc
         monza::CompartmentOwner owner = monza::CompartmentOwner::null();
         void* compartment_pagetable_root = nullptr;
 
+        /**
+         * Set for compartments which can execute on several cores at once.
+         * Removing mappings from their pagetable requires a TLB shootdown.
+         */
+        bool concurrent = false;
+
+        /**
+         * Ranges of concurrent compartments disowned but not yet returned to
+         * the parent, as other cores may still hold stale mappings of them.
+         * The shootdown happens once the lock of the ranges above has been
+         * released, see ShootdownRange. Protected by pagetable_lock.
+         */
+        static constexpr size_t MAX_PENDING_RANGES = 16;
+
+        struct PendingRange
+        {
+          capptr::Arena<void> base;
+          size_t size;
+        };
+
+        PendingRange pending_ranges[MAX_PENDING_RANGES]{};
+        size_t pending_count = 0;
+
+        /**
+         * Serialises updates of ownership together with the compartment
+         * pagetable. Also taken by the page-fault handler, so that mappings
+         * are never added for memory whose ownership is being removed.
+         */
+        FlagWord pagetable_lock{};
+
+        TrivialInitAtomic<size_t> bytes_owned{};
+        TrivialInitAtomic<size_t> peak_bytes_owned{};
+
+        /**
+         * Remove ownership and compartment mappings for the range without
+         * shootdown or returning it to the parent.
+         */
+        void disown_range(address_t base, size_t size)
+        {
+          FlagLock lock(pagetable_lock);
+          monza::remove_from_compartment_pagetable(
+            compartment_pagetable_root, base, size);
+          remove_monza_owner(base, size, owner);
+          bytes_owned.fetch_sub(size, std::memory_order_relaxed);
+        }
+
       public:
         static constexpr bool Aligned = ParentRange::Aligned;
 
@@ -457,12 +891,19 @@ namespace snmalloc
           auto range = parent.alloc_range(size);
           if ((range != nullptr) && (monza::CompartmentOwner::null() != owner))
           {
+            FlagLock lock(pagetable_lock);
             add_monza_owner(address_cast(range), size, owner, &head);
             monza::add_to_compartment_pagetable(
               compartment_pagetable_root,
               address_cast(range),
               size,
               monza::PagetablePermission::PT_COMPARTMENT_WRITE);
+            auto new_bytes_owned =
+              bytes_owned.fetch_add(size, std::memory_order_relaxed) + size;
+            if (new_bytes_owned > peak_bytes_owned.load())
+            {
+              peak_bytes_owned.store(new_bytes_owned);
+            }
           }
           return range;
         }
@@ -472,37 +913,150 @@ namespace snmalloc
           SNMALLOC_ASSERT((size % monza::MIN_OWNERSHIP_SIZE) == 0);
           if ((monza::CompartmentOwner::null() != owner))
           {
-            monza::remove_from_compartment_pagetable(
-              compartment_pagetable_root, address_cast(base), size);
-            remove_monza_owner(address_cast(base), size, owner);
+            disown_range(address_cast(base), size);
+            if (concurrent)
+            {
+              {
+                FlagLock lock(pagetable_lock);
+                if (pending_count < MAX_PENDING_RANGES)
+                {
+                  pending_ranges[pending_count++] = {base, size};
+                  return;
+                }
+              }
+              // Out of space to defer, shoot down under the lock instead.
+              monza::flush_tlb_cores_sync(compartment_pagetable_root);
+            }
           }
           parent.dealloc_range(base, size);
         }
 
+        /**
+         * Shoot down the stale mappings of the ranges deferred by
+         * dealloc_range and return them to the parent. Called without the
+         * lock of the ranges above held, as the parent is concurrency safe.
+         */
+        void complete_pending()
+        {
+          PendingRange completed[MAX_PENDING_RANGES];
+          size_t count;
+          {
+            FlagLock lock(pagetable_lock);
+            count = pending_count;
+            for (size_t i = 0; i < count; ++i)
+            {
+              completed[i] = pending_ranges[i];
+            }
+            pending_count = 0;
+          }
+          if (count == 0)
+          {
+            return;
+          }
+          monza::flush_tlb_cores_sync(compartment_pagetable_root);
+          for (size_t i = 0; i < count; ++i)
+          {
+            parent.dealloc_range(completed[i].base, completed[i].size);
+          }
+        }
+
+        /**
+         * Number of bytes currently owned by the compartment, including the
+         * memory cached by the ranges above.
+         */
+        size_t get_bytes_owned() const
+        {
+          return bytes_owned.load(std::memory_order_relaxed);
+        }
+
+        size_t get_peak_bytes_owned() const
+        {
+          return peak_bytes_owned.load(std::memory_order_relaxed);
+        }
+
+        FlagWord& get_pagetable_lock()
+        {
+          return pagetable_lock;
+        }
+
+        /**
+         * Return a contiguous run of pages owned by the compartment to the
+         * parent range during teardown. The compartment pagetable is about to
+         * be destroyed and the compartment can no longer execute, so neither
+         * pagetable updates nor shootdowns are needed.
+         */
+        void reclaim_run(address_t base, size_t size)
+        {
+          // Clear the pagemap when we reclaim pages.  This should fix various
+          // internal invariant for snmalloc, which assumes memory is not
+          // abruptly recycled.
+          MonzaCommonConfig::PagemapEntry default_entry;
+          Pagemap::set_metaentry(base, size, default_entry);
+
+          {
+            FlagLock lock(pagetable_lock);
+            remove_monza_owner(base, size, owner);
+            bytes_owned.fetch_sub(size, std::memory_order_relaxed);
+          }
+
+          // The parent only accepts naturally aligned power of two blocks.
+          // TODO: Not okay on CHERI.
+          range_to_pow_2_blocks<monza::MIN_OWNERSHIP_BITS>(
+            capptr::Arena<void>::unsafe_from(reinterpret_cast<void*>(base)),
+            size,
+            [&](capptr::Arena<void> p, size_t sz, bool) {
+              parent.dealloc_range(p, sz);
+            });
+        }
+
+        /**
+         * Return all memory owned by the compartment to the parent range.
+         * Only used on destruction, as it leaves the compartment pagetable
+         * stale.
+         *
+         * Entries are linked in reverse order of allocation, one per page, so
+         * the list is walked coalescing neighbouring pages into runs which are
+         * then reclaimed in one go.
+         */
         void dealloc_all()
         {
+          address_t run_start = 0;
+          address_t run_end = 0;
+
           head.forall([&](List::Entry& le) {
             address_t chunk_address =
               concreteCompartmentPagemap.get_address(le);
 
-            // TODO: Not okay on CHERI.
-            void* p = reinterpret_cast<void*>(chunk_address);
-
-            // Clear the pagemap when we reclaim pages.  This should fix various
-            // internal invariant for snmalloc, which assumes memory is not
-            // abruptly recycled.
-            MonzaCommonConfig::PagemapEntry default_entry;
-            Pagemap::set_metaentry(
-              address_cast(p), monza::MIN_OWNERSHIP_SIZE, default_entry);
-
-            dealloc_range(
-              capptr::Arena<void>::unsafe_from(p), monza::MIN_OWNERSHIP_SIZE);
-
-            le.clear_owner();
+            if (chunk_address + monza::MIN_OWNERSHIP_SIZE == run_start)
+            {
+              run_start = chunk_address;
+              return;
+            }
+            if (chunk_address == run_end)
+            {
+              run_end += monza::MIN_OWNERSHIP_SIZE;
+              return;
+            }
+
+            // Flushing the previous run only unlinks entries already visited.
+            if (run_end != run_start)
+            {
+              reclaim_run(run_start, run_end - run_start);
+            }
+            run_start = chunk_address;
+            run_end = chunk_address + monza::MIN_OWNERSHIP_SIZE;
           });
+
+          if (run_end != run_start)
+          {
+            reclaim_run(run_start, run_end - run_start);
+          }
         }
 
-        void set_owner(monza::CompartmentOwner new_owner, void* root)
+        void set_owner(
+          monza::CompartmentOwner new_owner,
+          void* root,
+          bool is_concurrent = false)
         {
           if ((root == nullptr) && (monza::CompartmentOwner::null() != owner))
           {
@@ -511,10 +1065,12 @@ namespace snmalloc
           }
           owner = new_owner;
           compartment_pagetable_root = root;
+          concurrent = is_concurrent;
         }
 
         ~Type()
         {
+          complete_pending();
           dealloc_all();
           if ((monza::CompartmentOwner::null() != owner))
           {
@@ -523,6 +1079,49 @@ namespace snmalloc
         }
       };
     };
+
+    /**
+     * Range placed above the lock of the ranges of a compartment, completing
+     * the shootdowns deferred by its MonzaR once the lock has been released,
+     * so that other cores are never interrupted while the lock is held.
+     */
+    template<typename MonzaR>
+    class ShootdownRange
+    {
+    public:
+      template<typename ParentRange = EmptyRange<>>
+      class Type : public ContainsParent<ParentRange>
+      {
+        using ContainsParent<ParentRange>::parent;
+
+        void complete_pending()
+        {
+          parent.template ancestor<MonzaR>()->complete_pending();
+        }
+
+      public:
+        static constexpr bool Aligned = ParentRange::Aligned;
+
+        static constexpr bool ConcurrencySafe = ParentRange::ConcurrencySafe;
+
+        using ChunkBounds = typename ParentRange::ChunkBounds;
+
+        constexpr Type() = default;
+
+        CapPtr<void, ChunkBounds> alloc_range(size_t size)
+        {
+          auto range = parent.alloc_range(size);
+          complete_pending();
+          return range;
+        }
+
+        void dealloc_range(CapPtr<void, ChunkBounds> base, size_t size)
+        {
+          parent.dealloc_range(base, size);
+          complete_pending();
+        }
+      };
+    };
   };
 
   /**
@@ -573,6 +1172,8 @@ namespace snmalloc
 
       // Source for object allocations and metadata
       // Use buddy allocators to cache locally.
+      // Locked as compartments can allocate from several cores concurrently.
+      // TLB shootdowns for memory they free happen after the lock is released.
       using ObjectRange = Pipe<
         MonzaR,
         LargeBuddyRange<
@@ -580,7 +1181,9 @@ namespace snmalloc
           LOCAL_CACHE_BITS,
           Pagemap,
           monza::MIN_OWNERSHIP_BITS>,
-        SmallBuddyRange>;
+        SmallBuddyRange,
+        LockRange,
+        MonzaCompartmentOwnership::ShootdownRange<MonzaR>>;
 
       ObjectRange object_range;
 
@@ -600,10 +1203,14 @@ namespace snmalloc
 
       LocalState() {}
 
-      LocalState(monza::CompartmentOwner owner, void* root)
+      LocalState(monza::CompartmentOwner owner, void* root, bool concurrent)
       {
-        auto monza_r = object_range.ancestor<LocalState::MonzaR>();
-        monza_r->set_owner(owner, root);
+        get_monza_range()->set_owner(owner, root, concurrent);
+      }
+
+      MonzaR* get_monza_range()
+      {
+        return object_range.ancestor<LocalState::MonzaR>();
       }
     };
 
@@ -661,6 +1268,16 @@ namespace snmalloc
         }
       }
 
+      /**
+       * Allocate a chunk from Monza core, leaving running out of memory to be
+       * handled by the caller.
+       */
+      static std::pair<capptr::Chunk<void>, SlabMetadata*>
+      try_alloc_chunk(LocalState& local_state, size_t size, uintptr_t ras)
+      {
+        return BackendInner::alloc_chunk(local_state, size, ras);
+      }
+
       static void dealloc_chunk(
         LocalState& local_state,
         SlabMetadata& slab_metadata,
@@ -785,12 +1402,24 @@ namespace snmalloc
       // flowing into the first hole.
       // The first hole is at initial_length.
 
+      auto heap_base = address_cast(base);
+      auto heap_length = max_length;
+
       // Create the compartment map and remove from the initial range.
       auto [new_base1, _1] =
         MonzaCompartmentOwnership::concreteCompartmentPagemap.init(
           base, max_length);
       consume_init_range(base, max_length, initial_length, new_base1);
 
+      // Create the ownership summaries covering the same range.
+      auto summary_end = MonzaCompartmentOwnership::init_summaries(
+        base, heap_base, heap_length);
+      consume_init_range(
+        base,
+        max_length,
+        initial_length,
+        pointer_align_up(summary_end, MIN_CHUNK_SIZE));
+
       // Create the pagemap and remove from the initial range.
       auto [new_base2, _2] = Pagemap::concretePagemap.init(base, max_length);
       consume_init_range(base, max_length, initial_length, new_base2);
@@ -4,6 +4,7 @@
 #pragma once
 
 #include <cstdint>
+#include <thread.h>
 
 namespace monza
 {
@@ -32,7 +33,7 @@ namespace monza
     }
 
     /**
-     * Used in Debug to print error messages.
+     * Used in Debug to print error messages and to summarise ownership.
      */
     uintptr_t as_uintptr_t()
     {
@@ -64,6 +65,12 @@ namespace monza
     void* stack_limit_low;
     void* stack_limit_high;
     CompartmentOwner compartment;
+    /**
+     * Thread (and thus core) currently executing with this TLS.
+     * Only maintained for compartments, where it is refreshed on every
+     * invocation since a compartment can be invoked from any core.
+     */
+    monza_thread_t thread_id;
   };
 
   TCB* get_tcb();
@@ -20,6 +20,8 @@ namespace monza
   void join_thread(monza_thread_t id);
   void sleep_thread();
   void wake_thread(monza_thread_t id);
+  void wait_for_write(
+    const volatile uint64_t* address, uint64_t value, uint64_t timeout_ns);
   bool allocate_tls_slot(uint16_t* key);
   void* get_tls_slot(uint16_t key);
   bool set_tls_slot(uint16_t key, void* data);
@@ -0,0 +1,87 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <vector>
+
+/**
+ * Sample counts for benchmarks reporting distributions.
+ * Reduced counts on Debug builds only used on CI.
+ */
+#ifdef NDEBUG
+constexpr size_t BENCH_SAMPLE_COUNT = 10000;
+constexpr size_t BENCH_WARMUP_COUNT = 1000;
+#else
+constexpr size_t BENCH_SAMPLE_COUNT = 1000;
+constexpr size_t BENCH_WARMUP_COUNT = 100;
+#endif
+
+/**
+ * Measure the cycles taken by a single execution of f.
+ * Usable both in the kernel and inside compartments.
+ */
+template<typename F>
+inline uint64_t bench_cycles(F f)
+{
+  unsigned int aux;
+  auto start_time = __builtin_ia32_rdtsc();
+  f();
+  auto end_time = __builtin_ia32_rdtscp(&aux);
+  return end_time - start_time;
+}
+
+/**
+ * Print the header of the CSV output produced by bench_report.
+ */
+inline void bench_print_header()
+{
+  std::cout << "benchmark,payload,samples,min,median,p99,max" << std::endl;
+}
+
+/**
+ * Print the distribution of cycle samples as one CSV row.
+ * Reorders the samples.
+ */
+inline void
+bench_report(const char* name, size_t payload, std::span<uint64_t> samples)
+{
+  if (samples.empty())
+  {
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  auto count = samples.size();
+  std::cout << name << "," << payload << "," << count << "," << samples[0]
+            << "," << samples[count / 2] << "," << samples[(count * 99) / 100]
+            << "," << samples[count - 1] << std::endl;
+}
+
+/**
+ * Run sample, which returns the cycles of one measurement, for the warmup
+ * count followed by count times and report the distribution of the latter.
+ */
+template<typename F>
+inline void bench_run(
+  const char* name,
+  size_t payload,
+  F sample,
+  size_t count = BENCH_SAMPLE_COUNT,
+  size_t warmup = BENCH_WARMUP_COUNT)
+{
+  for (size_t i = 0; i < warmup; ++i)
+  {
+    sample();
+  }
+  std::vector<uint64_t> samples(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    samples[i] = sample();
+  }
+  bench_report(name, payload, samples);
+}
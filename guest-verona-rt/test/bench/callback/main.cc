@@ -0,0 +1,95 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <compartment.h>
+#include <iostream>
+#include <test.h>
+
+using namespace monza;
+
+/**
+ * Reduced iteration count on Debug builds only used on CI.
+ */
+#ifdef NDEBUG
+constexpr size_t ITERATION_COUNT = 10000;
+#else
+constexpr size_t ITERATION_COUNT = 1000;
+#endif
+
+/**
+ * Argument type which does not qualify for the register-only path, but
+ * carries the same information as the scalar arguments.
+ */
+struct Arguments
+{
+  size_t a;
+  size_t b;
+};
+
+static_assert(is_fast_callback_v<size_t, std::tuple<size_t, size_t>>);
+static_assert(!is_fast_callback_v<size_t, std::tuple<Arguments>>);
+
+template<typename F>
+uint64_t benchmark_compartment(Compartment<size_t>& compartment, F lambda)
+{
+  unsigned int aux;
+
+  compartment.get_data() = 0;
+  auto start_time = __builtin_ia32_rdtsc();
+  auto return_value = compartment.invoke(lambda);
+  auto end_time = __builtin_ia32_rdtscp(&aux);
+  test_check(
+    compartment.check_valid() && return_value.get_success() &&
+    compartment.get_data() == ITERATION_COUNT * (ITERATION_COUNT + 1) / 2);
+
+  return end_time - start_time;
+}
+
+void bench_callbacks()
+{
+  Compartment<size_t> compartment;
+
+  auto fast_callback = compartment.register_callback(
+    [](size_t a, size_t b) -> size_t { return a + b; });
+  auto slow_callback = compartment.register_callback(
+    [](Arguments arguments) -> size_t { return arguments.a + arguments.b; });
+
+  auto fast_lambda = [fast_callback](size_t* sum) {
+    for (size_t i = 1; i <= ITERATION_COUNT; ++i)
+    {
+      *sum = fast_callback(*sum, i);
+    }
+    return true;
+  };
+  auto slow_lambda = [slow_callback](size_t* sum) {
+    for (size_t i = 1; i <= ITERATION_COUNT; ++i)
+    {
+      *sum = slow_callback(Arguments{*sum, i});
+    }
+    return true;
+  };
+
+  // Warm up the compartment stack and heap mappings.
+  benchmark_compartment(compartment, fast_lambda);
+  benchmark_compartment(compartment, slow_lambda);
+
+  auto fast_duration = benchmark_compartment(compartment, fast_lambda);
+  auto slow_duration = benchmark_compartment(compartment, slow_lambda);
+
+  std::cout << ITERATION_COUNT << " register-only callbacks took "
+            << fast_duration << " cycles" << std::endl;
+  std::cout << ITERATION_COUNT << " memory-based callbacks took "
+            << slow_duration << " cycles" << std::endl;
+  std::cout << "Mean cost of register-only callback was "
+            << fast_duration / ITERATION_COUNT << " cycles" << std::endl;
+  std::cout << "Mean cost of memory-based callback was "
+            << slow_duration / ITERATION_COUNT << " cycles" << std::endl;
+
+  std::cout << "SUCCESS: bench_callbacks" << std::endl;
+}
+
+int main()
+{
+  bench_callbacks();
+  return 0;
+}
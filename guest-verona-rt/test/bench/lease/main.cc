@@ -0,0 +1,78 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <compartment.h>
+#include <cstdlib>
+#include <iostream>
+#include <test.h>
+
+using namespace monza;
+
+#ifdef NDEBUG
+constexpr size_t ROUNDS = 16;
+#else
+constexpr size_t ROUNDS = 2;
+#endif
+constexpr size_t ROUND_ALLOCATIONS = 64 * 1024;
+constexpr size_t ALLOCATIONS = ROUNDS * ROUND_ALLOCATIONS;
+
+struct Pointers
+{
+  void* allocations[ROUND_ALLOCATIONS];
+};
+
+/**
+ * Measure the requests to Monza core made by the allocator of a compartment
+ * performing allocations of mixed small sizes, which keep needing new slabs,
+ * with chunks leased at most lease_limit at a time.
+ */
+uint64_t benchmark_allocations(size_t lease_limit)
+{
+  unsigned int aux;
+
+  Compartment<Pointers> compartment;
+  compartment.set_chunk_lease_limit(lease_limit);
+  auto initial_calls = compartment.get_usage().allocator_calls;
+
+  auto start_time = __builtin_ia32_rdtsc();
+  auto return_value = compartment.invoke([](Pointers* pointers) {
+    for (size_t round = 0; round < ROUNDS; ++round)
+    {
+      for (size_t i = 0; i < ROUND_ALLOCATIONS; ++i)
+      {
+        pointers->allocations[i] = malloc(16 + (i % 16) * 16);
+        if (pointers->allocations[i] == nullptr)
+        {
+          return false;
+        }
+      }
+      for (size_t i = 0; i < ROUND_ALLOCATIONS; ++i)
+      {
+        free(pointers->allocations[i]);
+      }
+    }
+    return true;
+  });
+  auto end_time = __builtin_ia32_rdtscp(&aux);
+  test_check(return_value.get_success() && return_value);
+
+  auto calls = compartment.get_usage().allocator_calls - initial_calls;
+  std::cout << "Lease limit " << lease_limit << ": " << calls
+            << " allocator calls for " << ALLOCATIONS << " allocations ("
+            << calls * 1000000 / ALLOCATIONS << " per million), "
+            << end_time - start_time << " cycles" << std::endl;
+  return calls;
+}
+
+int main()
+{
+  // Warm up the global range.
+  benchmark_allocations(MAX_LEASE_CHUNKS);
+
+  auto single_calls = benchmark_allocations(1);
+  auto leased_calls = benchmark_allocations(MAX_LEASE_CHUNKS);
+  test_check(leased_calls < single_calls);
+
+  std::cout << "SUCCESS: bench_lease" << std::endl;
+  return 0;
+}
@@ -0,0 +1,88 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <compartment.h>
+#include <iostream>
+#include <snmalloc.h>
+#include <test.h>
+
+using namespace monza;
+
+/**
+ * Reduced iteration count on Debug builds only used on CI.
+ */
+#ifdef NDEBUG
+constexpr size_t ITERATION_COUNT = 1000;
+#else
+constexpr size_t ITERATION_COUNT = 100;
+#endif
+constexpr size_t MIN_RANGE_SIZE = 64;
+constexpr size_t MAX_RANGE_SIZE = 64 * 1024 * 1024;
+
+/**
+ * Reference implementation checking every ownership entry individually.
+ */
+bool validate_owner_linear(
+  CompartmentOwner owner, snmalloc::address_t p, size_t size)
+{
+  for (snmalloc::address_t a =
+         snmalloc::address_align_down<MIN_OWNERSHIP_SIZE>(p);
+       a < p + size;
+       a += MIN_OWNERSHIP_SIZE)
+  {
+    if (
+      snmalloc::MonzaCompartmentOwnership::get_monza_owner<true>(a) != owner)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+template<typename F>
+uint64_t benchmark_validation(F validate)
+{
+  size_t result = 0;
+  unsigned int aux;
+
+  auto start_time = __builtin_ia32_rdtsc();
+  for (size_t i = 0; i < ITERATION_COUNT; ++i)
+  {
+    result += validate();
+  }
+  auto end_time = __builtin_ia32_rdtscp(&aux);
+  test_check(result == ITERATION_COUNT);
+
+  return (end_time - start_time) / ITERATION_COUNT;
+}
+
+void bench_ownership()
+{
+  Compartment compartment;
+  auto owner = compartment.get_owner();
+
+  for (size_t size = MIN_RANGE_SIZE; size <= MAX_RANGE_SIZE; size *= 4)
+  {
+    auto memory = compartment.alloc_compartment_memory<uint8_t>(size);
+    auto p = snmalloc::address_cast(memory.span().data());
+
+    auto linear = benchmark_validation(
+      [&]() { return validate_owner_linear(owner, p, size); });
+    auto summarised = benchmark_validation([&]() {
+      return snmalloc::MonzaCompartmentOwnership::validate_owner_range(
+        owner, p, size);
+    });
+
+    std::cout << "Validating ownership of " << size << " bytes took " << linear
+              << " cycles per entry walk and " << summarised
+              << " cycles using summaries" << std::endl;
+  }
+
+  std::cout << "SUCCESS: bench_ownership" << std::endl;
+}
+
+int main()
+{
+  bench_ownership();
+  return 0;
+}
@@ -0,0 +1,167 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <bench.h>
+#include <compartment.h>
+#include <compartment_portal.h>
+#include <cstdlib>
+#include <cstring>
+#include <span>
+#include <test.h>
+
+using namespace monza;
+
+/**
+ * Three stage pipeline of isolated compartments: decode produces a buffer,
+ * validate checks it and produces a transformed copy, and transform reduces
+ * that copy to a checksum. Compares running the stages as separate invocations
+ * from Monza core, copying the buffers in between, with chaining them through
+ * portals.
+ *
+ * Both variants copy each buffer once between the stages, the portals from
+ * within Monza core as part of the call. Portals take more transitions, as
+ * each portal call is a callback out of its source wrapping a nested
+ * invocation of its target, so the difference is the cost of the nesting
+ * against that of returning to Monza core between the stages.
+ */
+
+struct Stage
+{
+  uint8_t* buffer;
+  size_t size;
+};
+
+using StageCompartment = Compartment<Stage>;
+
+static void decode(Stage* stage, size_t request)
+{
+  for (size_t i = 0; i < stage->size; ++i)
+  {
+    stage->buffer[i] = static_cast<uint8_t>(i + request);
+  }
+}
+
+static bool validate(std::span<const uint8_t> input, Stage* stage)
+{
+  for (size_t i = 0; i < input.size(); ++i)
+  {
+    stage->buffer[i] = static_cast<uint8_t>(input[i] ^ 0x5a);
+  }
+  return input.size() == stage->size;
+}
+
+static size_t transform(std::span<const uint8_t> input)
+{
+  size_t sum = 0;
+  for (auto value : input)
+  {
+    sum += value;
+  }
+  return sum;
+}
+
+static size_t reference(size_t size, size_t request)
+{
+  size_t sum = 0;
+  for (size_t i = 0; i < size; ++i)
+  {
+    sum += static_cast<uint8_t>(static_cast<uint8_t>(i + request) ^ 0x5a);
+  }
+  return sum;
+}
+
+static void allocate_stage(StageCompartment& compartment, size_t size)
+{
+  auto return_value = compartment.invoke([size](Stage* stage) {
+    stage->buffer = static_cast<uint8_t*>(malloc(size));
+    stage->size = size;
+    return stage->buffer != nullptr;
+  });
+  test_check(return_value.get_success() && return_value);
+}
+
+template<size_t N>
+void bench_pipeline()
+{
+  StageCompartment decoder;
+  StageCompartment validator;
+  StageCompartment transformer;
+  allocate_stage(decoder, N);
+  allocate_stage(validator, N);
+  allocate_stage(transformer, N);
+
+  size_t request = 0;
+  bench_run("pipeline_invoke", N, [&]() {
+    ++request;
+    size_t result = 0;
+    auto cycles = bench_cycles([&]() {
+      auto decoded = decoder.invoke([request](Stage* stage) {
+        decode(stage, request);
+        return true;
+      });
+      test_check(decoded.get_success());
+      memcpy(validator.get_data().buffer, decoder.get_data().buffer, N);
+
+      auto validated = validator.invoke([](Stage* stage) {
+        return validate(std::span<const uint8_t>(stage->buffer, N), stage);
+      });
+      test_check(validated.get_success() && validated);
+      memcpy(transformer.get_data().buffer, validator.get_data().buffer, N);
+
+      auto transformed = transformer.invoke([](Stage* stage) {
+        return transform(std::span<const uint8_t>(stage->buffer, N));
+      });
+      test_check(transformed.get_success());
+      result = static_cast<size_t>(transformed);
+    });
+    test_check(result == reference(N, request));
+    return cycles;
+  });
+
+  auto to_transformer = register_portal(
+    validator, transformer, N, [](std::span<const uint8_t> input, Stage*) {
+      return transform(input);
+    });
+  auto to_validator = register_portal(
+    decoder,
+    validator,
+    N,
+    [to_transformer](std::span<const uint8_t> input, Stage* stage) {
+      if (!validate(input, stage))
+      {
+        return static_cast<size_t>(0);
+      }
+      auto result =
+        to_transformer(std::span<const uint8_t>(stage->buffer, stage->size));
+      return result.get_success() ? static_cast<size_t>(result) : 0;
+    });
+
+  bench_run("pipeline_portal", N, [&]() {
+    ++request;
+    size_t result = 0;
+    auto cycles = bench_cycles([&]() {
+      auto transformed =
+        decoder.invoke([request, to_validator](Stage* stage) {
+          decode(stage, request);
+          auto result =
+            to_validator(std::span<const uint8_t>(stage->buffer, stage->size));
+          return result.get_success() ? static_cast<size_t>(result) : 0;
+        });
+      test_check(transformed.get_success());
+      result = static_cast<size_t>(transformed);
+    });
+    test_check(result == reference(N, request));
+    return cycles;
+  });
+}
+
+int main()
+{
+  bench_print_header();
+  bench_pipeline<64>();
+  bench_pipeline<4096>();
+  bench_pipeline<64 * 1024>();
+
+  std::cout << "SUCCESS: bench_pipeline" << std::endl;
+  return 0;
+}
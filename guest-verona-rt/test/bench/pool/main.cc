@@ -0,0 +1,137 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <compartment.h>
+#include <compartment_pool.h>
+#include <cstdlib>
+#include <iostream>
+#include <test.h>
+
+using namespace monza;
+
+/**
+ * Reduced iteration count on Debug builds only used on CI.
+ */
+#ifdef NDEBUG
+constexpr size_t ITERATION_COUNT = 100;
+#else
+constexpr size_t ITERATION_COUNT = 10;
+#endif
+
+constexpr size_t TABLE_SIZE = 64 * 1024;
+
+struct State
+{
+  size_t* table;
+};
+
+/**
+ * Representative setup work: allocate and initialise a lookup table.
+ */
+auto setup = [](State* state) {
+  state->table = static_cast<size_t*>(malloc(TABLE_SIZE * sizeof(size_t)));
+  if (state->table == nullptr)
+  {
+    return false;
+  }
+  for (size_t i = 0; i < TABLE_SIZE; ++i)
+  {
+    state->table[i] = i;
+  }
+  return true;
+};
+
+/**
+ * Handle a request by consuming the table, then check that the compartment
+ * started from the state after setup.
+ */
+template<typename C>
+void handle_request(C& compartment)
+{
+  auto return_value = compartment.invoke([](State* state) {
+    size_t sum = 0;
+    for (size_t i = 0; i < TABLE_SIZE; ++i)
+    {
+      sum += state->table[i];
+      state->table[i] = 0;
+    }
+    return sum;
+  });
+  test_check(
+    compartment.check_valid() && return_value.get_success() &&
+    static_cast<size_t>(return_value) == TABLE_SIZE * (TABLE_SIZE - 1) / 2);
+}
+
+void bench_pool()
+{
+  unsigned int aux;
+
+  CompartmentPool<State, decltype(setup)> pool(setup, ITERATION_COUNT);
+  test_check(pool.available() == ITERATION_COUNT);
+
+  uint64_t fresh_duration = 0;
+  for (size_t i = 0; i < ITERATION_COUNT; ++i)
+  {
+    auto start_time = __builtin_ia32_rdtsc();
+    Compartment<State> compartment;
+    auto return_value = compartment.invoke(setup);
+    auto end_time = __builtin_ia32_rdtscp(&aux);
+    test_check(return_value.get_success() && return_value);
+    fresh_duration += end_time - start_time;
+
+    handle_request(compartment);
+  }
+
+  // Drain the pool filled by the constructor, then measure the replenish()
+  // that constructs the compartments handed out by the next round.
+  for (size_t i = 0; i < ITERATION_COUNT; ++i)
+  {
+    auto compartment = pool.acquire();
+    test_check(compartment != nullptr);
+    handle_request(*compartment);
+  }
+  test_check(pool.available() == 0);
+
+  auto replenish_start_time = __builtin_ia32_rdtsc();
+  pool.replenish();
+  auto replenish_end_time = __builtin_ia32_rdtscp(&aux);
+  test_check(pool.available() == ITERATION_COUNT);
+  uint64_t replenish_duration = replenish_end_time - replenish_start_time;
+
+  uint64_t acquire_duration = 0;
+  for (size_t i = 0; i < ITERATION_COUNT; ++i)
+  {
+    auto start_time = __builtin_ia32_rdtsc();
+    auto compartment = pool.acquire();
+    auto end_time = __builtin_ia32_rdtscp(&aux);
+    test_check(compartment != nullptr);
+    acquire_duration += end_time - start_time;
+
+    // Every pooled compartment sees the state after setup, regardless of what
+    // previously acquired ones did with theirs.
+    handle_request(*compartment);
+  }
+
+  // Compartments are still handed out once the pool runs dry.
+  test_check(pool.available() == 0);
+  auto compartment = pool.acquire();
+  test_check(compartment != nullptr);
+  handle_request(*compartment);
+
+  std::cout << "Mean cost of fresh compartment with setup was "
+            << fresh_duration / ITERATION_COUNT << " cycles" << std::endl;
+  std::cout << "Mean cost of acquire() from the pool was "
+            << acquire_duration / ITERATION_COUNT << " cycles" << std::endl;
+  std::cout << "Mean cost of replenish() and acquire() per pooled compartment "
+            << "was "
+            << (replenish_duration + acquire_duration) / ITERATION_COUNT
+            << " cycles" << std::endl;
+
+  std::cout << "SUCCESS: bench_pool" << std::endl;
+}
+
+int main()
+{
+  bench_pool();
+  return 0;
+}
@@ -0,0 +1,74 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <compartment.h>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <test.h>
+
+using namespace monza;
+
+constexpr size_t BLOCK_SIZE = 256 * 1024;
+
+/**
+ * Measure the destruction of a compartment whose heap was grown to roughly
+ * heap_size bytes by allocations which are never freed.
+ */
+uint64_t benchmark_teardown(size_t heap_size)
+{
+  unsigned int aux;
+
+  auto compartment = std::make_unique<Compartment<>>();
+  auto return_value = compartment->invoke([heap_size]() {
+    for (size_t allocated = 0; allocated < heap_size; allocated += BLOCK_SIZE)
+    {
+      auto p = static_cast<uint8_t*>(malloc(BLOCK_SIZE));
+      if (p == nullptr)
+      {
+        return false;
+      }
+      p[0] = 1;
+    }
+    return true;
+  });
+  test_check(return_value.get_success() && return_value);
+  auto bytes_owned = compartment->get_usage().bytes_owned;
+  test_check(bytes_owned >= heap_size);
+
+  auto start_time = __builtin_ia32_rdtsc();
+  compartment.reset();
+  auto end_time = __builtin_ia32_rdtscp(&aux);
+
+  std::cout << "Teardown of compartment owning " << bytes_owned
+            << " bytes took " << end_time - start_time << " cycles"
+            << std::endl;
+
+  return end_time - start_time;
+}
+
+void bench_teardown()
+{
+  // Warm up the global range.
+  benchmark_teardown(1024 * 1024);
+
+  for (size_t heap_size = 1024 * 1024; heap_size <= 64 * 1024 * 1024;
+       heap_size *= 4)
+  {
+    benchmark_teardown(heap_size);
+  }
+
+  // Memory returned on teardown can be reused by further compartments.
+  for (size_t i = 0; i < 4; ++i)
+  {
+    benchmark_teardown(64 * 1024 * 1024);
+  }
+
+  std::cout << "SUCCESS: bench_teardown" << std::endl;
+}
+
+int main()
+{
+  bench_teardown();
+  return 0;
+}
@@ -0,0 +1,216 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <array>
+#include <bench.h>
+#include <compartment.h>
+#include <cstdlib>
+#include <memory>
+#include <test.h>
+
+using namespace monza;
+
+/**
+ * Breakdown of the cost of transitions between Monza core and compartments.
+ *
+ * Parts of the transition executed by Monza core are measured from the
+ * kernel. Round trips initiated by the compartment are measured from inside
+ * the compartment, which stores its samples in the compartment data for the
+ * kernel to report.
+ */
+
+constexpr size_t PAGE_BYTES = 4096;
+
+struct Samples
+{
+  uint64_t cycles[BENCH_WARMUP_COUNT + BENCH_SAMPLE_COUNT];
+};
+
+using BenchCompartment = Compartment<Samples>;
+
+/**
+ * Run sample inside the compartment for the warmup and sample counts, then
+ * report the distribution of the latter. sample receives the index of the
+ * measurement and returns its cycles. Results are checked from the kernel,
+ * as sample executes in the compartment.
+ */
+template<typename F>
+void bench_in_compartment(
+  BenchCompartment& compartment, const char* name, size_t payload, F sample)
+{
+  auto return_value = compartment.invoke([sample](Samples* samples) {
+    for (size_t i = 0; i < BENCH_WARMUP_COUNT + BENCH_SAMPLE_COUNT; ++i)
+    {
+      samples->cycles[i] = sample(i);
+    }
+    return true;
+  });
+  test_check(
+    compartment.check_valid() && return_value.get_success() && return_value);
+
+  bench_report(
+    name,
+    payload,
+    std::span<uint64_t>(
+      &compartment.get_data().cycles[BENCH_WARMUP_COUNT], BENCH_SAMPLE_COUNT));
+}
+
+void bench_kernel_parts()
+{
+  bench_run("cr3_reload", 0, []() {
+    uint64_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    return bench_cycles(
+      [cr3]() { asm volatile("mov %0, %%cr3" : : "r"(cr3)); });
+  });
+
+  bench_run("fsbase_write", 0, []() {
+    uintptr_t fs_base;
+    asm volatile("rdfsbase %0" : "=r"(fs_base));
+    return bench_cycles(
+      [fs_base]() { asm volatile("wrfsbase %0" : : "r"(fs_base)); });
+  });
+
+  BenchCompartment compartment;
+
+  bench_run("stack_initial", 0, [&compartment]() {
+    return bench_cycles([&compartment]() {
+      compartment.get_stack();
+      compartment.release_stack();
+    });
+  });
+
+  bench_run("stack_nested", 0, [&compartment]() {
+    compartment.get_stack();
+    auto cycles = bench_cycles([&compartment]() {
+      compartment.get_stack();
+      compartment.release_stack();
+    });
+    compartment.release_stack();
+    return cycles;
+  });
+
+  bench_run("invoke", 0, [&compartment]() {
+    return bench_cycles([&compartment]() {
+      auto return_value = compartment.invoke([](Samples*) { return true; });
+      test_check(return_value.get_success());
+    });
+  });
+}
+
+template<size_t N>
+void bench_callback(BenchCompartment& compartment)
+{
+  auto callback = compartment.register_callback(
+    [](std::array<uint8_t, N> payload) -> uint8_t { return payload[0]; });
+  bench_in_compartment(compartment, "callback", N, [callback](size_t i) {
+    std::array<uint8_t, N> payload{};
+    payload[0] = static_cast<uint8_t>(i);
+    return bench_cycles([&]() { payload[0] = callback(payload); });
+  });
+}
+
+/**
+ * Forward a chunk allocation to Monza core directly, as the compartment
+ * allocator does for large allocations, bypassing both the chunk leases and
+ * the slab caching of the compartment allocator which would otherwise serve
+ * all but the first request.
+ */
+template<size_t N>
+void bench_alloc_chunk(BenchCompartment& compartment)
+{
+  bench_in_compartment(compartment, "alloc_chunk", N, [](size_t) {
+    auto ras =
+      snmalloc::FrontendMetaEntry<snmalloc::FrontendSlabMetadata>::encode(
+        nullptr, snmalloc::size_to_sizeclass_full(N));
+    snmalloc::LeasedChunk* leased = nullptr;
+    auto cycles = bench_cycles([&leased, ras]() {
+      leased = static_cast<snmalloc::LeasedChunk*>(
+        compartment_alloc_chunk(N, ras));
+    });
+    test_check(leased != nullptr);
+    compartment_dealloc_chunk(leased->chunk.unsafe_ptr(), N);
+    return cycles;
+  });
+}
+
+void bench_compartment_round_trips()
+{
+  BenchCompartment compartment;
+
+  auto empty_callback =
+    compartment.register_callback([]() -> size_t { return 0; });
+  bench_in_compartment(compartment, "syscall", 0, [empty_callback](size_t) {
+    return bench_cycles([empty_callback]() { empty_callback(); });
+  });
+
+  bench_callback<16>(compartment);
+  bench_callback<256>(compartment);
+  bench_callback<2048>(compartment);
+
+  bench_alloc_chunk<64 * 1024>(compartment);
+  bench_alloc_chunk<256 * 1024>(compartment);
+  bench_alloc_chunk<1024 * 1024>(compartment);
+}
+
+void bench_page_fault()
+{
+  // Every measurement reads a distinct page of kernel memory for the first
+  // time, so it takes the page-fault path which maps it read-only. Disable
+  // fault-around so that each of them faults.
+  constexpr size_t page_count = BENCH_WARMUP_COUNT + BENCH_SAMPLE_COUNT;
+  auto buffer = std::make_unique<uint8_t[]>((page_count + 1) * PAGE_BYTES);
+  auto pages = reinterpret_cast<uint8_t*>(snmalloc::pointer_align_up(
+    static_cast<void*>(buffer.get()), PAGE_BYTES));
+  for (size_t i = 0; i < page_count; ++i)
+  {
+    pages[i * PAGE_BYTES] = 1;
+  }
+
+  BenchCompartment compartment;
+  compartment.set_fault_around_pages(1);
+  bench_in_compartment(compartment, "page_fault", 0, [pages](size_t i) {
+    volatile uint8_t* page = &pages[i * PAGE_BYTES];
+    return bench_cycles([page]() { *page; });
+  });
+}
+
+void bench_abort_recovery()
+{
+  // Aborting invalidates the compartment, so each measurement needs a fresh
+  // one. Use fewer samples to keep the construction cost bounded.
+  bench_run(
+    "abort_recovery",
+    0,
+    []() {
+      BenchCompartment compartment;
+      uint64_t abort_start = 0;
+      auto callback = compartment.register_callback([&abort_start]() {
+        abort_start = __builtin_ia32_rdtsc();
+        abort_kernel_callback(-1);
+        return true;
+      });
+
+      auto return_value =
+        compartment.invoke([callback](Samples*) { return callback(); });
+      unsigned int aux;
+      auto end_time = __builtin_ia32_rdtscp(&aux);
+      test_check(!return_value.get_success() && !compartment.check_valid());
+
+      return end_time - abort_start;
+    },
+    BENCH_SAMPLE_COUNT / 10,
+    BENCH_WARMUP_COUNT / 10);
+}
+
+int main()
+{
+  bench_print_header();
+  bench_kernel_parts();
+  bench_compartment_round_trips();
+  bench_page_fault();
+  bench_abort_recovery();
+
+  std::cout << "SUCCESS: bench_transition" << std::endl;
+  return 0;
+}
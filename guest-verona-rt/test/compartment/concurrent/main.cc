@@ -0,0 +1,89 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <atomic>
+#include <compartment.h>
+#include <cstdio>
+#include <cstdlib>
+#include <test.h>
+#include <thread.h>
+
+using namespace monza;
+
+constexpr size_t INVOCATION_COUNT = 256;
+constexpr size_t ALLOCATION_SIZE = 64 * 1024;
+
+using ConcurrentCompartment = Compartment<std::atomic<size_t>, true>;
+
+thread_local size_t per_core_invocations = 0;
+
+std::atomic<size_t> finished_threads;
+
+void invoke_repeatedly(void* arg)
+{
+  auto compartment = static_cast<ConcurrentCompartment*>(arg);
+  auto thread_id = get_thread_id();
+
+  for (size_t i = 0; i < INVOCATION_COUNT; ++i)
+  {
+    auto return_value =
+      compartment->invoke([thread_id](std::atomic<size_t>* total) {
+        // Allocate and touch memory to exercise the shared allocator range
+        // and the page-fault handler from several cores at once.
+        auto p = static_cast<uint8_t*>(malloc(ALLOCATION_SIZE));
+        if (p == nullptr)
+        {
+          return false;
+        }
+        p[0] = 1;
+        p[ALLOCATION_SIZE - 1] = 1;
+        free(p);
+
+        total->fetch_add(1);
+        per_core_invocations++;
+        return get_thread_id() == thread_id;
+      });
+    test_check(return_value.get_success() && return_value);
+  }
+
+  // Thread-local state in the compartment is private to the core.
+  auto return_value = compartment->invoke(
+    [](std::atomic<size_t>*) { return per_core_invocations; });
+  test_check(
+    return_value.get_success() &&
+    static_cast<size_t>(return_value) == INVOCATION_COUNT);
+
+  finished_threads.fetch_add(1);
+}
+
+void test_concurrent(size_t num_cores)
+{
+  ConcurrentCompartment compartment;
+  finished_threads.store(0);
+
+  for (size_t i = 1; i < num_cores; ++i)
+  {
+    test_check(add_thread(invoke_repeatedly, &compartment) != 0);
+  }
+  invoke_repeatedly(&compartment);
+
+  while (finished_threads.load() != num_cores)
+    ;
+
+  test_check(
+    compartment.check_valid() &&
+    compartment.get_data().load() == num_cores * INVOCATION_COUNT &&
+    compartment.get_usage().stacks == num_cores);
+
+  puts("SUCCESS: test_concurrent");
+}
+
+int main()
+{
+  size_t num_cores = initialize_threads();
+  test_check(num_cores > 1);
+
+  test_concurrent(num_cores);
+
+  return 0;
+}
@@ -0,0 +1,61 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <compartment_cown.h>
+#include <cpp/when.h>
+#include <cstddef>
+#include <cstdio>
+#include <monza_harness.h>
+#include <test.h>
+#include <test/harness.h>
+#include <thread.h>
+
+using namespace monza;
+using namespace verona::cpp;
+
+constexpr size_t COMPARTMENT_COUNT = 4;
+constexpr size_t INVOCATION_COUNT = 16;
+
+/**
+ * Schedule a number of invocations on each compartment cown and check that
+ * they are serialized, observe the thread id of the core they run on and all
+ * operate on the same compartment state.
+ */
+void test_compartment_cown()
+{
+  for (size_t i = 0; i < COMPARTMENT_COUNT; ++i)
+  {
+    auto compartment = make_compartment_cown<size_t>();
+    for (size_t j = 0; j < INVOCATION_COUNT; ++j)
+    {
+      when(compartment) << [](AcquiredCompartment<size_t> acquired) {
+        auto kernel_thread = get_thread_id();
+        auto ret = acquired->invoke([](size_t* counter) {
+          ++(*counter);
+          return get_thread_id();
+        });
+        test_check(
+          ret.get_success() &&
+          static_cast<monza_thread_t>(ret) == kernel_thread);
+      };
+    }
+    when_invoke(
+      compartment,
+      [](size_t* counter) { return *counter; },
+      [](CompartmentErrorOr<size_t> ret) {
+        test_check(
+          ret.get_success() && static_cast<size_t>(ret) == INVOCATION_COUNT);
+      });
+  }
+}
+
+int main()
+{
+  SystematicTestHarness harness(MONZA_ARGC, MONZA_ARGV);
+
+  harness.run(test_compartment_cown);
+
+  puts("SUCCESS: test_compartment_cown");
+
+  return 0;
+}
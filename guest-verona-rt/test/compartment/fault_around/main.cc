@@ -0,0 +1,115 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <compartment.h>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <span>
+#include <test.h>
+
+using namespace monza;
+
+constexpr size_t WINDOW_PAGES =
+  ArchitecturalCompartmentBase::DEFAULT_FAULT_AROUND_PAGES;
+constexpr size_t BUFFER_PAGES = 4 * WINDOW_PAGES;
+constexpr size_t BUFFER_SIZE = BUFFER_PAGES * PAGE_SIZE;
+
+static uint8_t* allocate_kernel_buffer()
+{
+  auto buffer = static_cast<uint8_t*>(
+    aligned_alloc(WINDOW_PAGES * PAGE_SIZE, BUFFER_SIZE));
+  test_check(buffer != nullptr);
+  for (size_t i = 0; i < BUFFER_PAGES; ++i)
+  {
+    buffer[i * PAGE_SIZE] = static_cast<uint8_t>(i);
+  }
+  return buffer;
+}
+
+/**
+ * Read every page of the buffer from the compartment and return the number
+ * of page faults this took.
+ */
+static size_t scan_buffer(Compartment<>& compartment, const uint8_t* buffer)
+{
+  auto initial_faults = compartment.get_usage().page_faults;
+  auto return_value = compartment.invoke([buffer]() {
+    size_t sum = 0;
+    for (size_t i = 0; i < BUFFER_PAGES; ++i)
+    {
+      sum += buffer[i * PAGE_SIZE];
+    }
+    return sum;
+  });
+
+  size_t expected = 0;
+  for (size_t i = 0; i < BUFFER_PAGES; ++i)
+  {
+    expected += static_cast<uint8_t>(i);
+  }
+  test_check(
+    return_value.get_success() &&
+    static_cast<size_t>(return_value) == expected);
+
+  return compartment.get_usage().page_faults - initial_faults;
+}
+
+void test_fault_around()
+{
+  auto buffer = allocate_kernel_buffer();
+
+  Compartment single_page;
+  single_page.set_fault_around_pages(1);
+  auto single_page_faults = scan_buffer(single_page, buffer);
+
+  Compartment fault_around;
+  auto fault_around_faults = scan_buffer(fault_around, buffer);
+
+  // Allow for faults on memory other than the buffer, such as the lambda.
+  test_check(single_page_faults >= BUFFER_PAGES);
+  test_check(fault_around_faults <= BUFFER_PAGES / WINDOW_PAGES + 2);
+  test_check(
+    fault_around.get_usage().fault_mapped_pages >=
+    fault_around.get_usage().page_faults);
+
+  free(buffer);
+
+  puts("SUCCESS: test_fault_around");
+}
+
+void test_fault_around_keeps_grants()
+{
+  auto buffer = allocate_kernel_buffer();
+  Compartment compartment;
+
+  // A writable grant in the middle of a window must remain writable when a
+  // read of a neighbouring page maps the rest of the window.
+  auto granted = buffer + PAGE_SIZE;
+  auto grant = compartment.grant(
+    std::span<uint8_t>(granted, PAGE_SIZE), GrantPermission::ReadWrite);
+  test_check(grant.is_granted());
+
+  auto return_value = compartment.invoke([buffer, granted]() {
+    size_t value = buffer[0];
+    granted[0] = 42;
+    return value;
+  });
+
+  test_check(
+    compartment.check_valid() && return_value.get_success() &&
+    static_cast<size_t>(return_value) == 0 && granted[0] == 42);
+
+  grant.revoke();
+  free(buffer);
+
+  puts("SUCCESS: test_fault_around_keeps_grants");
+}
+
+int main()
+{
+  test_fault_around();
+  test_fault_around_keeps_grants();
+
+  return 0;
+}
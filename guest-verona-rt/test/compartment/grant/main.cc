@@ -0,0 +1,185 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <compartment.h>
+#include <compartment_ringbuffer.h>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <span>
+#include <test.h>
+
+using namespace monza;
+
+constexpr size_t BUFFER_SIZE = 16 * PAGE_SIZE;
+constexpr size_t RINGBUFFER_CAPACITY = PAGE_SIZE;
+constexpr size_t STREAM_SIZE = 8 * RINGBUFFER_CAPACITY + 123;
+
+static uint8_t* allocate_kernel_buffer()
+{
+  auto buffer = static_cast<uint8_t*>(aligned_alloc(PAGE_SIZE, BUFFER_SIZE));
+  test_check(buffer != nullptr);
+  for (size_t i = 0; i < BUFFER_SIZE; ++i)
+  {
+    buffer[i] = static_cast<uint8_t>(i);
+  }
+  return buffer;
+}
+
+static size_t reference_sum(size_t count)
+{
+  size_t sum = 0;
+  for (size_t i = 0; i < count; ++i)
+  {
+    sum += static_cast<uint8_t>(i);
+  }
+  return sum;
+}
+
+/**
+ * Read every page of the buffer from the compartment and return the number
+ * of page faults this took.
+ */
+static size_t scan_buffer(Compartment<>& compartment, const uint8_t* buffer)
+{
+  auto initial_faults = compartment.get_usage().page_faults;
+  auto return_value = compartment.invoke([buffer]() {
+    size_t sum = 0;
+    for (size_t i = 0; i < BUFFER_SIZE; ++i)
+    {
+      sum += buffer[i];
+    }
+    return sum;
+  });
+
+  test_check(
+    return_value.get_success() &&
+    static_cast<size_t>(return_value) == reference_sum(BUFFER_SIZE));
+
+  return compartment.get_usage().page_faults - initial_faults;
+}
+
+void test_read_grant()
+{
+  Compartment compartment;
+  // Fault in single pages, so that every page read without the grant faults.
+  compartment.set_fault_around_pages(1);
+  auto buffer = allocate_kernel_buffer();
+
+  auto grant = compartment.grant(
+    std::span<const uint8_t>(buffer, BUFFER_SIZE), GrantPermission::Read);
+  test_check(grant.is_granted());
+
+  // The grant maps the buffer up front. Allow for faults on memory other than
+  // the buffer, such as the lambda.
+  test_check(scan_buffer(compartment, buffer) <= 2);
+
+  // Reads fault again once the mapping is removed.
+  grant.revoke();
+  test_check(!grant.is_granted());
+  test_check(scan_buffer(compartment, buffer) >= BUFFER_SIZE / PAGE_SIZE);
+
+  free(buffer);
+  puts("SUCCESS: test_read_grant");
+}
+
+void test_write_grant()
+{
+  Compartment compartment;
+  auto buffer = allocate_kernel_buffer();
+
+  {
+    auto grant = compartment.grant(
+      std::span<uint8_t>(buffer, BUFFER_SIZE), GrantPermission::ReadWrite);
+    test_check(grant.is_granted());
+
+    auto return_value = compartment.invoke([buffer]() {
+      for (size_t i = 0; i < BUFFER_SIZE; ++i)
+      {
+        buffer[i] = 0xAB;
+      }
+      return true;
+    });
+
+    test_check(return_value.get_success() && return_value);
+  }
+
+  for (size_t i = 0; i < BUFFER_SIZE; ++i)
+  {
+    test_check(buffer[i] == 0xAB);
+  }
+
+  free(buffer);
+  puts("SUCCESS: test_write_grant");
+}
+
+void test_invalid_grants()
+{
+  Compartment compartment;
+  auto buffer = allocate_kernel_buffer();
+
+  // Writable grants must cover entire pages.
+  auto unaligned = compartment.grant(
+    std::span<uint8_t>(buffer + 1, PAGE_SIZE), GrantPermission::ReadWrite);
+  test_check(!unaligned.is_granted());
+
+  // Memory owned by a compartment cannot be granted to another one.
+  Compartment other;
+  auto other_memory = other.alloc_compartment_memory<uint8_t>(PAGE_SIZE);
+  auto foreign = compartment.grant(other_memory.span(), GrantPermission::Read);
+  test_check(!foreign.is_granted());
+
+  free(buffer);
+  puts("SUCCESS: test_invalid_grants");
+}
+
+void test_ringbuffer()
+{
+  Compartment<size_t> compartment;
+  CompartmentRingbuffer ringbuffer(compartment, RINGBUFFER_CAPACITY);
+  auto reader = ringbuffer.get_reader();
+
+  uint8_t source[STREAM_SIZE];
+  for (size_t i = 0; i < STREAM_SIZE; ++i)
+  {
+    source[i] = static_cast<uint8_t>(i);
+  }
+
+  // Stream the data through a ringbuffer smaller than the data, having the
+  // compartment consume and accumulate it in a series of invocations.
+  size_t written = 0;
+  while (written < STREAM_SIZE)
+  {
+    written += ringbuffer.write(
+      std::span<const uint8_t>(source + written, STREAM_SIZE - written));
+
+    auto return_value = compartment.invoke([reader](size_t* sum) {
+      uint8_t chunk[256];
+      size_t count;
+      while ((count = reader.read(chunk)) > 0)
+      {
+        for (size_t i = 0; i < count; ++i)
+        {
+          *sum += chunk[i];
+        }
+      }
+      return true;
+    });
+    test_check(return_value.get_success() && return_value);
+  }
+
+  test_check(
+    compartment.check_valid() &&
+    compartment.get_data() == reference_sum(STREAM_SIZE));
+  puts("SUCCESS: test_ringbuffer");
+}
+
+int main()
+{
+  test_read_grant();
+  test_write_grant();
+  test_invalid_grants();
+  test_ringbuffer();
+
+  return 0;
+}
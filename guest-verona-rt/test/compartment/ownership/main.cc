@@ -0,0 +1,209 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <atomic>
+#include <compartment.h>
+#include <cstdio>
+#include <cstdlib>
+#include <snmalloc.h>
+#include <test.h>
+#include <thread.h>
+
+using namespace monza;
+
+using Ownership = snmalloc::MonzaCompartmentOwnership;
+
+/**
+ * Size of a block of the first summary level.
+ */
+constexpr size_t BLOCK_SIZE = 64 * MIN_OWNERSHIP_SIZE;
+constexpr size_t REGION_SIZE = 2 * BLOCK_SIZE;
+constexpr size_t UPDATE_COUNT = 1000;
+
+/**
+ * Reference implementation checking every ownership entry individually.
+ */
+static bool validate_owner_linear(
+  CompartmentOwner owner, snmalloc::address_t p, size_t size)
+{
+  for (snmalloc::address_t a =
+         snmalloc::address_align_down<MIN_OWNERSHIP_SIZE>(p);
+       a < p + size;
+       a += MIN_OWNERSHIP_SIZE)
+  {
+    if (Ownership::get_monza_owner<true>(a) != owner)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Check the result of validating [p, p + size) against the expected one and
+ * against the reference implementation.
+ */
+static void check_owner(
+  CompartmentOwner owner, snmalloc::address_t p, size_t size, bool expected)
+{
+  test_check(Ownership::validate_owner_range(owner, p, size) == expected);
+  test_check(validate_owner_linear(owner, p, size) == expected);
+}
+
+/**
+ * Region of kernel memory aligned to a summary block, so that its ownership
+ * can be set up entry by entry.
+ */
+static snmalloc::address_t allocate_region()
+{
+  auto region = aligned_alloc(BLOCK_SIZE, REGION_SIZE);
+  test_check(region != nullptr);
+  return snmalloc::address_cast(region);
+}
+
+void test_revoked_owner()
+{
+  Compartment compartment;
+  auto owner = compartment.get_owner();
+  auto region = allocate_region();
+
+  Ownership::add_monza_owner(region, BLOCK_SIZE, owner);
+  check_owner(owner, region, BLOCK_SIZE, true);
+  check_owner(CompartmentOwner::null(), region, BLOCK_SIZE, false);
+
+  // Once ownership is removed, neither the full block nor any part of it
+  // validates for the previous owner.
+  Ownership::remove_monza_owner(region, BLOCK_SIZE, owner);
+  check_owner(owner, region, BLOCK_SIZE, false);
+  check_owner(owner, region + BLOCK_SIZE / 2, MIN_OWNERSHIP_SIZE, false);
+  check_owner(CompartmentOwner::null(), region, REGION_SIZE, true);
+
+  free(reinterpret_cast<void*>(region));
+  puts("SUCCESS: test_revoked_owner");
+}
+
+void test_mixed_owners()
+{
+  Compartment first;
+  Compartment second;
+  auto first_owner = first.get_owner();
+  auto second_owner = second.get_owner();
+  auto region = allocate_region();
+
+  // First block owned by the first compartment, except for one entry owned
+  // by the second, and the second block partially owned by the second.
+  auto foreign = region + BLOCK_SIZE / 2;
+  Ownership::add_monza_owner(region, BLOCK_SIZE / 2, first_owner);
+  Ownership::add_monza_owner(foreign, MIN_OWNERSHIP_SIZE, second_owner);
+  Ownership::add_monza_owner(
+    foreign + MIN_OWNERSHIP_SIZE,
+    BLOCK_SIZE / 2 - MIN_OWNERSHIP_SIZE,
+    first_owner);
+  Ownership::add_monza_owner(region + BLOCK_SIZE, BLOCK_SIZE / 2, second_owner);
+
+  check_owner(first_owner, region, BLOCK_SIZE / 2, true);
+  check_owner(first_owner, region, BLOCK_SIZE, false);
+  check_owner(second_owner, region, BLOCK_SIZE, false);
+  check_owner(second_owner, foreign, MIN_OWNERSHIP_SIZE, true);
+  check_owner(first_owner, foreign - 1, 2, false);
+  check_owner(second_owner, region + BLOCK_SIZE, BLOCK_SIZE / 2, true);
+  check_owner(second_owner, region + BLOCK_SIZE, BLOCK_SIZE, false);
+  check_owner(
+    CompartmentOwner::null(),
+    region + BLOCK_SIZE * 3 / 2,
+    BLOCK_SIZE / 2,
+    true);
+  check_owner(CompartmentOwner::null(), region, REGION_SIZE, false);
+
+  // The owner added first to a block leaving it does not make the remaining
+  // owner of the block validate.
+  Ownership::remove_monza_owner(region, BLOCK_SIZE / 2, first_owner);
+  Ownership::remove_monza_owner(
+    foreign + MIN_OWNERSHIP_SIZE,
+    BLOCK_SIZE / 2 - MIN_OWNERSHIP_SIZE,
+    first_owner);
+  check_owner(first_owner, region, BLOCK_SIZE, false);
+  check_owner(second_owner, region, BLOCK_SIZE, false);
+  check_owner(second_owner, foreign, MIN_OWNERSHIP_SIZE, true);
+
+  Ownership::remove_monza_owner(foreign, MIN_OWNERSHIP_SIZE, second_owner);
+  Ownership::remove_monza_owner(
+    region + BLOCK_SIZE, BLOCK_SIZE / 2, second_owner);
+  check_owner(CompartmentOwner::null(), region, REGION_SIZE, true);
+
+  free(reinterpret_cast<void*>(region));
+  puts("SUCCESS: test_mixed_owners");
+}
+
+struct ConcurrentUpdates
+{
+  CompartmentOwner owner;
+  snmalloc::address_t region;
+  size_t thread_count;
+  std::atomic<size_t> finished{0};
+};
+
+/**
+ * Repeatedly add and remove ownership of the entries of the region assigned
+ * to the calling thread, interleaved with the other threads in the same
+ * summary blocks.
+ */
+static void update_repeatedly(ConcurrentUpdates& updates, size_t index)
+{
+  for (size_t i = 0; i < UPDATE_COUNT; ++i)
+  {
+    for (auto a = updates.region + index * MIN_OWNERSHIP_SIZE;
+         a < updates.region + REGION_SIZE;
+         a += updates.thread_count * MIN_OWNERSHIP_SIZE)
+    {
+      Ownership::add_monza_owner(a, MIN_OWNERSHIP_SIZE, updates.owner);
+      test_check(Ownership::validate_owner_range(
+        updates.owner, a, MIN_OWNERSHIP_SIZE));
+      Ownership::remove_monza_owner(a, MIN_OWNERSHIP_SIZE, updates.owner);
+    }
+  }
+  updates.finished.fetch_add(1);
+}
+
+static std::atomic<size_t> next_index;
+
+void test_concurrent_updates(size_t num_cores)
+{
+  Compartment compartment;
+  ConcurrentUpdates updates{
+    compartment.get_owner(), allocate_region(), num_cores};
+  next_index.store(1);
+
+  for (size_t i = 1; i < num_cores; ++i)
+  {
+    test_check(
+      add_thread(
+        [](void* arg) {
+          update_repeatedly(
+            *static_cast<ConcurrentUpdates*>(arg), next_index.fetch_add(1));
+        },
+        &updates) != 0);
+  }
+  update_repeatedly(updates, 0);
+
+  while (updates.finished.load() != num_cores)
+    ;
+
+  // Every update was accounted for in the summaries.
+  check_owner(CompartmentOwner::null(), updates.region, REGION_SIZE, true);
+  check_owner(updates.owner, updates.region, MIN_OWNERSHIP_SIZE, false);
+
+  free(reinterpret_cast<void*>(updates.region));
+  puts("SUCCESS: test_concurrent_updates");
+}
+
+int main()
+{
+  size_t num_cores = initialize_threads();
+
+  test_revoked_owner();
+  test_mixed_owners();
+  test_concurrent_updates(num_cores);
+
+  return 0;
+}
@@ -0,0 +1,157 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <compartment.h>
+#include <compartment_portal.h>
+#include <cstdio>
+#include <cstdlib>
+#include <span>
+#include <test.h>
+
+using namespace monza;
+
+constexpr size_t PAYLOAD_SIZE = 3 * PAGE_SIZE + 17;
+
+static size_t reference_sum()
+{
+  size_t sum = 0;
+  for (size_t i = 0; i < PAYLOAD_SIZE; ++i)
+  {
+    sum += static_cast<uint8_t>(i);
+  }
+  return sum;
+}
+
+auto sum_payload = [](std::span<const uint8_t> payload, size_t* total) {
+  size_t sum = 0;
+  for (auto value : payload)
+  {
+    sum += value;
+  }
+  *total += sum;
+  return sum;
+};
+
+void test_portal()
+{
+  Compartment source;
+  Compartment<size_t> target;
+  target.get_data() = 0;
+
+  auto portal = register_portal(source, target, PAYLOAD_SIZE, sum_payload);
+
+  auto return_value = source.invoke([portal]() {
+    auto payload = static_cast<uint8_t*>(malloc(PAYLOAD_SIZE));
+    if (payload == nullptr)
+    {
+      return static_cast<size_t>(0);
+    }
+    for (size_t i = 0; i < PAYLOAD_SIZE; ++i)
+    {
+      payload[i] = static_cast<uint8_t>(i);
+    }
+    auto result = portal(std::span<const uint8_t>(payload, PAYLOAD_SIZE));
+    free(payload);
+    return result.get_success() ? static_cast<size_t>(result) : 0;
+  });
+
+  test_check(
+    source.check_valid() && target.check_valid() &&
+    return_value.get_success() &&
+    static_cast<size_t>(return_value) == reference_sum() &&
+    target.get_data() == reference_sum());
+
+  puts("SUCCESS: test_portal");
+}
+
+void test_portal_foreign_payload()
+{
+  Compartment source;
+  Compartment<size_t> target;
+  target.get_data() = 0;
+
+  auto portal = register_portal(source, target, PAYLOAD_SIZE, sum_payload);
+
+  // Memory of Monza core is readable by the source, but cannot be passed on.
+  auto kernel_buffer = static_cast<uint8_t*>(calloc(PAYLOAD_SIZE, 1));
+  test_check(kernel_buffer != nullptr);
+
+  auto return_value = source.invoke([portal, kernel_buffer]() {
+    auto result =
+      portal(std::span<const uint8_t>(kernel_buffer, PAYLOAD_SIZE));
+    return result.get_success();
+  });
+
+  test_check(
+    !source.check_valid() && !return_value.get_success() &&
+    target.check_valid() && target.get_data() == 0);
+
+  free(kernel_buffer);
+
+  puts("SUCCESS: test_portal_foreign_payload");
+}
+
+void test_portal_target_failure()
+{
+  Compartment source;
+  Compartment target;
+
+  auto fail = target.register_callback([]() {
+    abort_kernel_callback(-1);
+    return true;
+  });
+  auto portal =
+    register_portal(source, target, 16, [fail](std::span<const uint8_t>) {
+      return fail();
+    });
+
+  auto return_value = source.invoke([portal]() {
+    uint8_t payload[16] = {};
+    auto result = portal(std::span<const uint8_t>(payload, sizeof(payload)));
+    return result.get_success();
+  });
+
+  // The failure of the target is reported to the source, which continues.
+  test_check(
+    source.check_valid() && !target.check_valid() &&
+    return_value.get_success() && !return_value);
+
+  puts("SUCCESS: test_portal_target_failure");
+}
+
+void test_portal_oversized_payload()
+{
+  Compartment source;
+  Compartment<size_t> target;
+  target.get_data() = 0;
+
+  auto portal = register_portal(source, target, PAYLOAD_SIZE - 1, sum_payload);
+
+  auto return_value = source.invoke([portal]() {
+    auto payload = static_cast<uint8_t*>(calloc(PAYLOAD_SIZE, 1));
+    if (payload == nullptr)
+    {
+      return true;
+    }
+    auto result = portal(std::span<const uint8_t>(payload, PAYLOAD_SIZE));
+    free(payload);
+    return result.get_success();
+  });
+
+  // The call is refused without invoking the target or failing the source.
+  test_check(
+    source.check_valid() && target.check_valid() &&
+    return_value.get_success() && !return_value && target.get_data() == 0);
+
+  puts("SUCCESS: test_portal_oversized_payload");
+}
+
+int main()
+{
+  test_portal();
+  test_portal_foreign_payload();
+  test_portal_target_failure();
+  test_portal_oversized_payload();
+
+  return 0;
+}
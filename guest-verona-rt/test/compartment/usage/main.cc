@@ -0,0 +1,123 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <compartment.h>
+#include <cstdio>
+#include <cstdlib>
+#include <test.h>
+
+using namespace monza;
+
+constexpr size_t LARGE_ALLOCATION_SIZE = 1024 * 1024;
+
+void test_usage()
+{
+  Compartment compartment;
+
+  auto initial_usage = compartment.get_usage();
+  test_check(
+    initial_usage.invocations > 0 && initial_usage.bytes_owned > 0 &&
+    initial_usage.pagetable_pages > 0 && initial_usage.stacks == 1);
+
+  auto return_value = compartment.invoke([]() {
+    auto p = malloc(LARGE_ALLOCATION_SIZE);
+    auto success = p != nullptr;
+    free(p);
+    return success;
+  });
+  test_check(return_value.get_success() && return_value);
+
+  auto usage = compartment.get_usage();
+  test_check(
+    usage.invocations == initial_usage.invocations + 1 &&
+    usage.total_cycles > initial_usage.total_cycles &&
+    usage.kernel_cycles > initial_usage.kernel_cycles &&
+    usage.total_cycles >= usage.kernel_cycles &&
+    usage.allocator_calls > initial_usage.allocator_calls &&
+    usage.peak_bytes_owned >=
+      initial_usage.bytes_owned + LARGE_ALLOCATION_SIZE);
+
+  puts("SUCCESS: test_usage");
+}
+
+void test_memory_quota_fail()
+{
+  Compartment compartment;
+  auto quota = compartment.get_quota();
+  quota.max_bytes =
+    compartment.get_usage().bytes_owned + LARGE_ALLOCATION_SIZE / 2;
+  compartment.set_quota(quota);
+
+  auto return_value =
+    compartment.invoke([]() { return malloc(LARGE_ALLOCATION_SIZE); });
+
+  test_check(
+    compartment.check_valid() && return_value.get_success() &&
+    static_cast<void*>(return_value) == nullptr);
+
+  puts("SUCCESS: test_memory_quota_fail");
+}
+
+void test_memory_quota_invalidate()
+{
+  Compartment compartment;
+  auto quota = compartment.get_quota();
+  quota.max_bytes =
+    compartment.get_usage().bytes_owned + LARGE_ALLOCATION_SIZE / 2;
+  quota.on_memory_exceeded = QuotaAction::Invalidate;
+  compartment.set_quota(quota);
+
+  auto return_value =
+    compartment.invoke([]() { return malloc(LARGE_ALLOCATION_SIZE); });
+
+  test_check(!compartment.check_valid() && !return_value.get_success());
+
+  puts("SUCCESS: test_memory_quota_invalidate");
+}
+
+void test_cycle_quota()
+{
+  Compartment compartment;
+  auto quota = compartment.get_quota();
+  quota.max_cycles = compartment.get_usage().compartment_cycles();
+  compartment.set_quota(quota);
+
+  auto return_value = compartment.invoke([]() { return true; });
+
+  test_check(!compartment.check_valid() && !return_value.get_success());
+
+  puts("SUCCESS: test_cycle_quota");
+}
+
+void test_stack_quota()
+{
+  Compartment compartment;
+  auto quota = compartment.get_quota();
+  quota.max_stacks = 1;
+  compartment.set_quota(quota);
+
+  auto callback = compartment.register_callback([&compartment]() {
+    auto nested = compartment.invoke([]() { return true; });
+    return nested.get_success();
+  });
+
+  auto return_value =
+    compartment.invoke([callback]() { return callback(); });
+
+  test_check(
+    compartment.check_valid() && return_value.get_success() &&
+    !return_value);
+
+  puts("SUCCESS: test_stack_quota");
+}
+
+int main()
+{
+  test_usage();
+  test_memory_quota_fail();
+  test_memory_quota_invalidate();
+  test_cycle_quota();
+  test_stack_quota();
+
+  return 0;
+}
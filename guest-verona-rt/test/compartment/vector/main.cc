@@ -0,0 +1,231 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <compartment.h>
+#include <cpuid.h>
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+#include <iostream>
+#include <test.h>
+
+using namespace monza;
+
+constexpr uint64_t SECRET = 0x5ec2e75ec2e75ec2;
+constexpr size_t XMM_COUNT = 16;
+
+/**
+ * Fill all XMM registers with value, leaving it in the registers when the
+ * compartment returns.
+ */
+static void fill_xmm(uint64_t value)
+{
+  asm volatile("movq %0, %%xmm0\n"
+               "punpcklqdq %%xmm0, %%xmm0\n"
+               "movdqa %%xmm0, %%xmm1\n"
+               "movdqa %%xmm0, %%xmm2\n"
+               "movdqa %%xmm0, %%xmm3\n"
+               "movdqa %%xmm0, %%xmm4\n"
+               "movdqa %%xmm0, %%xmm5\n"
+               "movdqa %%xmm0, %%xmm6\n"
+               "movdqa %%xmm0, %%xmm7\n"
+               "movdqa %%xmm0, %%xmm8\n"
+               "movdqa %%xmm0, %%xmm9\n"
+               "movdqa %%xmm0, %%xmm10\n"
+               "movdqa %%xmm0, %%xmm11\n"
+               "movdqa %%xmm0, %%xmm12\n"
+               "movdqa %%xmm0, %%xmm13\n"
+               "movdqa %%xmm0, %%xmm14\n"
+               "movdqa %%xmm0, %%xmm15\n"
+               :
+               : "r"(value)
+               : "xmm0",
+                 "xmm1",
+                 "xmm2",
+                 "xmm3",
+                 "xmm4",
+                 "xmm5",
+                 "xmm6",
+                 "xmm7",
+                 "xmm8",
+                 "xmm9",
+                 "xmm10",
+                 "xmm11",
+                 "xmm12",
+                 "xmm13",
+                 "xmm14",
+                 "xmm15");
+}
+
+/**
+ * Check whether any XMM register currently holds value.
+ */
+static bool xmm_hold(uint64_t value)
+{
+  uint64_t contents[XMM_COUNT * 2];
+  asm volatile("movdqu %%xmm0, 0x0(%0)\n"
+               "movdqu %%xmm1, 0x10(%0)\n"
+               "movdqu %%xmm2, 0x20(%0)\n"
+               "movdqu %%xmm3, 0x30(%0)\n"
+               "movdqu %%xmm4, 0x40(%0)\n"
+               "movdqu %%xmm5, 0x50(%0)\n"
+               "movdqu %%xmm6, 0x60(%0)\n"
+               "movdqu %%xmm7, 0x70(%0)\n"
+               "movdqu %%xmm8, 0x80(%0)\n"
+               "movdqu %%xmm9, 0x90(%0)\n"
+               "movdqu %%xmm10, 0xa0(%0)\n"
+               "movdqu %%xmm11, 0xb0(%0)\n"
+               "movdqu %%xmm12, 0xc0(%0)\n"
+               "movdqu %%xmm13, 0xd0(%0)\n"
+               "movdqu %%xmm14, 0xe0(%0)\n"
+               "movdqu %%xmm15, 0xf0(%0)\n"
+               :
+               : "r"(contents)
+               : "memory");
+  for (auto content : contents)
+  {
+    if (content == value)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool avx_enabled()
+{
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (ecx & bit_AVX) == 0)
+  {
+    return false;
+  }
+  uint32_t xcr0_low;
+  uint32_t xcr0_high;
+  asm volatile("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+  return (xcr0_low & 0x6) == 0x6;
+}
+
+/**
+ * Fill the upper half of YMM0 with value. Only XMM0 is declared as clobbered,
+ * so that the compiler does not clear the upper halves on return.
+ */
+__attribute__((target("avx"))) static void fill_ymm_upper(uint64_t value)
+{
+  asm volatile("vmovq %0, %%xmm0\n"
+               "vpunpcklqdq %%xmm0, %%xmm0, %%xmm0\n"
+               "vinsertf128 $1, %%xmm0, %%ymm0, %%ymm0\n"
+               :
+               : "r"(value)
+               : "xmm0");
+}
+
+__attribute__((target("avx"))) static uint64_t read_ymm_upper()
+{
+  uint64_t value;
+  asm volatile("vextractf128 $1, %%ymm0, %%xmm1\n"
+               "vmovq %%xmm1, %0\n"
+               : "=r"(value)
+               :
+               : "xmm1");
+  return value;
+}
+
+__attribute__((target("avx"))) static float avx_sum(const float* values)
+{
+  auto sum = _mm256_add_ps(_mm256_loadu_ps(values), _mm256_loadu_ps(values));
+  float lanes[8];
+  _mm256_storeu_ps(lanes, sum);
+  float total = 0;
+  for (auto lane : lanes)
+  {
+    total += lane;
+  }
+  return total;
+}
+
+void test_xmm_isolation()
+{
+  Compartment<> writer;
+  Compartment<> reader;
+
+  auto write_value = writer.invoke([]() {
+    fill_xmm(SECRET);
+    return true;
+  });
+  test_check(write_value.get_success() && write_value);
+
+  auto read_value = reader.invoke([]() { return xmm_hold(SECRET); });
+  test_check(read_value.get_success() && !read_value);
+
+  // The compartment owning the registers does not trap and can use them.
+  auto owned_value = reader.invoke([]() {
+    fill_xmm(SECRET);
+    return xmm_hold(SECRET);
+  });
+  test_check(owned_value.get_success() && owned_value);
+
+  // Compartments which do not use extended state can be interleaved.
+  auto idle_value = writer.invoke([]() { return true; });
+  test_check(idle_value.get_success() && idle_value);
+  read_value = writer.invoke([]() { return xmm_hold(SECRET); });
+  test_check(read_value.get_success() && !read_value);
+}
+
+void test_destroyed_owner()
+{
+  {
+    Compartment<> writer;
+    auto write_value = writer.invoke([]() {
+      fill_xmm(SECRET);
+      return true;
+    });
+    test_check(write_value.get_success() && write_value);
+  }
+
+  // Likely allocated at the address of the destroyed compartment.
+  Compartment<> reader;
+  auto read_value = reader.invoke([]() { return xmm_hold(SECRET); });
+  test_check(read_value.get_success() && !read_value);
+}
+
+void test_avx()
+{
+  if (!avx_enabled())
+  {
+    std::cout << "AVX not available, skipping." << std::endl;
+    return;
+  }
+
+  Compartment<> writer;
+  Compartment<> reader;
+
+  auto sum = writer.invoke([]() {
+    float values[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    return avx_sum(values);
+  });
+  test_check(sum.get_success() && static_cast<float>(sum) == 72.0f);
+
+  auto write_value = writer.invoke([]() {
+    fill_ymm_upper(SECRET);
+    return true;
+  });
+  test_check(write_value.get_success() && write_value);
+
+  auto read_value = reader.invoke([]() { return read_ymm_upper(); });
+  test_check(
+    read_value.get_success() && static_cast<uint64_t>(read_value) != SECRET);
+}
+
+int main()
+{
+  test_xmm_isolation();
+  test_destroyed_owner();
+  test_avx();
+
+  // The kernel keeps using extended state after the compartments.
+  volatile double value = 1.5;
+  test_check(value * 4.0 == 6.0);
+
+  std::cout << "SUCCESS: test_compartment_vector" << std::endl;
+  return 0;
+}
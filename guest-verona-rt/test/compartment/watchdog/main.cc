@@ -0,0 +1,129 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <compartment.h>
+#include <cstdio>
+#include <test.h>
+
+using namespace monza;
+
+constexpr uint64_t BUDGET = 50'000'000;
+
+static void set_budget(Compartment<>& compartment)
+{
+  auto quota = compartment.get_quota();
+  quota.max_invoke_cycles = BUDGET;
+  compartment.set_quota(quota);
+}
+
+void test_runaway_aborted()
+{
+  Compartment compartment;
+  set_budget(compartment);
+
+  auto return_value = compartment.invoke([]() {
+    volatile bool spin = true;
+    while (spin)
+    {}
+    return true;
+  });
+  test_check(!return_value.get_success() && !compartment.check_valid());
+
+  // The core is available for further work.
+  Compartment other;
+  auto other_value = other.invoke([]() { return true; });
+  test_check(other_value.get_success() && other_value);
+
+  puts("SUCCESS: test_runaway_aborted");
+}
+
+void test_within_budget()
+{
+  Compartment compartment;
+  set_budget(compartment);
+
+  for (size_t i = 0; i < 16; ++i)
+  {
+    auto return_value = compartment.invoke([]() { return true; });
+    test_check(return_value.get_success() && return_value);
+  }
+  test_check(compartment.check_valid());
+
+  puts("SUCCESS: test_within_budget");
+}
+
+void test_deferred_in_kernel()
+{
+  Compartment compartment;
+  set_budget(compartment);
+
+  // Monza core is not interrupted while it services the compartment, which
+  // is aborted once it resumes past its deadline.
+  auto callback = compartment.register_callback([]() {
+    auto start = snmalloc::Aal::tick();
+    while (snmalloc::Aal::tick() - start < 2 * BUDGET)
+    {}
+    return true;
+  });
+  auto return_value = compartment.invoke([callback]() {
+    callback();
+    volatile bool spin = true;
+    while (spin)
+    {}
+    return true;
+  });
+  test_check(!return_value.get_success() && !compartment.check_valid());
+
+  puts("SUCCESS: test_deferred_in_kernel");
+}
+
+void test_nested_outer_expired()
+{
+  Compartment outer;
+  Compartment inner;
+  set_budget(outer);
+
+  // The inner invocation has no budget of its own, so the deadline of the
+  // outer one expiring unwinds it without invalidating it, and the outer
+  // compartment is aborted once it resumes.
+  bool inner_success = true;
+  auto callback = outer.register_callback([&inner, &inner_success]() {
+    auto return_value = inner.invoke([]() {
+      volatile bool spin = true;
+      while (spin)
+      {}
+      return true;
+    });
+    inner_success = return_value.get_success();
+    return true;
+  });
+  auto return_value = outer.invoke([callback]() {
+    callback();
+    volatile bool spin = true;
+    while (spin)
+    {}
+    return true;
+  });
+  test_check(!return_value.get_success() && !outer.check_valid());
+  test_check(!inner_success && inner.check_valid());
+
+  auto inner_value = inner.invoke([]() { return true; });
+  test_check(inner_value.get_success() && inner_value);
+
+  puts("SUCCESS: test_nested_outer_expired");
+}
+
+int main()
+{
+  if (!watchdog_supported())
+  {
+    puts("Watchdog not supported, skipping.");
+    return 0;
+  }
+
+  test_runaway_aborted();
+  test_within_budget();
+  test_deferred_in_kernel();
+  test_nested_outer_expired();
+  return 0;
+}
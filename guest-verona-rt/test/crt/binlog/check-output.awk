@@ -0,0 +1,20 @@
+# Copyright Microsoft and Project Monza Contributors.
+# SPDX-License-Identifier: MIT
+
+# Check that every line "EXPECT: <text>" in the output of the crt-binlog test
+# is followed by a line "<text>", and that the guest finished successfully.
+# Lines are printed as they are checked.
+
+BEGIN { not_found = 1; }
+{ sub(/\r$/, ""); print $0; }
+index($0, "EXPECT: ") == 1 { expected[substr($0, 9)] = 1; next; }
+($0 in expected) { delete expected[$0]; }
+index($0, "CRITICAL: Execution finished with 0.") > 0 { not_found = 0; }
+END {
+  missing = 0;
+  for (line in expected) {
+    print "Missing log entry: " line;
+    missing = 1;
+  }
+  exit not_found || missing;
+}
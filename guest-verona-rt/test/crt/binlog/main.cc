@@ -0,0 +1,54 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <cstdint>
+#include <cstdio>
+#include <logging.h>
+#include <test.h>
+
+/**
+ * Emit log entries covering every kind of argument, each preceded by the text
+ * expected from it. With MONZA_BINARY_LOGGING the entries are binary records,
+ * which the test decodes on the host with utils/decode_binary_log.py before
+ * comparing them to the expected text, see check-output.awk.
+ */
+
+void test_integers()
+{
+  puts(
+    "EXPECT: CRITICAL: integers 0 42 18446744073709551615 -7 "
+    "-1099511627776");
+  LOG(CRITICAL) << "integers " << static_cast<uint64_t>(0) << " "
+                << static_cast<uint8_t>(42) << " " << UINT64_MAX << " " << -7
+                << " " << -(static_cast<int64_t>(1) << 40) << LOG_ENDL;
+  puts("SUCCESS: test_integers");
+}
+
+void test_pointers()
+{
+  puts("EXPECT: CRITICAL: pointers 0x0 0xdeadbeef");
+  LOG(CRITICAL) << "pointers " << static_cast<const void*>(nullptr) << " "
+                << reinterpret_cast<const void*>(0xdeadbeef) << LOG_ENDL;
+  puts("SUCCESS: test_pointers");
+}
+
+void test_strings()
+{
+  // Not in the read-only data of the image, so written inline.
+  char dynamic[] = "dynamic string";
+  test_check(dynamic[0] == 'd');
+
+  puts("EXPECT: CRITICAL: strings static string, dynamic string");
+  LOG(CRITICAL) << "strings " << "static string, " << dynamic << LOG_ENDL;
+  puts("EXPECT: CRITICAL: BINLOG: with module");
+  LOG_MOD(CRITICAL, BINLOG) << "with module" << LOG_ENDL;
+  puts("SUCCESS: test_strings");
+}
+
+int main()
+{
+  test_integers();
+  test_pointers();
+  test_strings();
+  return 0;
+}
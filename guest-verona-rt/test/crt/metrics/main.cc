@@ -0,0 +1,75 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <cores.h>
+#include <cstdio>
+#include <metrics.h>
+#include <output.h>
+#include <snmalloc.h>
+#include <test.h>
+#include <thread.h>
+
+using namespace monza;
+
+static uint64_t total(abi::Metric metric)
+{
+  uint64_t sum = 0;
+  for (size_t i = 0; i < get_core_count(); ++i)
+  {
+    sum += metrics_cores[i].counters[static_cast<size_t>(metric)].load();
+  }
+  return sum;
+}
+
+void test_ipi()
+{
+  auto sent = total(abi::Metric::IpiSent);
+  auto received = total(abi::Metric::IpiReceived);
+
+  ping_core_sync(1);
+  test_check(total(abi::Metric::IpiSent) > sent);
+  // The receiver counts after notifying the sender.
+  while (total(abi::Metric::IpiReceived) == received)
+  {
+    snmalloc::Aal::pause();
+  }
+
+  puts("SUCCESS: test_ipi");
+}
+
+void test_thread_submission()
+{
+  auto submitted = total(abi::Metric::ThreadSubmit);
+
+  monza_thread_t thread = add_thread([](void*) {}, nullptr);
+  test_check(thread != 0);
+  while (!is_thread_done(thread))
+    ;
+  test_check(total(abi::Metric::ThreadSubmit) == submitted + 1);
+
+  puts("SUCCESS: test_thread_submission");
+}
+
+void test_log_bytes()
+{
+  constexpr unsigned char LINE[] = "Counted output.\n";
+  auto logged = total(abi::Metric::LogBytes);
+
+  auto data = {std::span<const unsigned char>(LINE, sizeof(LINE) - 1)};
+  test_check(kwritev_stdout(data) == sizeof(LINE) - 1);
+  test_check(total(abi::Metric::LogBytes) == logged + sizeof(LINE) - 1);
+
+  puts("SUCCESS: test_log_bytes");
+}
+
+int main()
+{
+  size_t num_cores = initialize_threads();
+  test_check(num_cores > 1);
+  test_check(metrics_cores != nullptr);
+
+  test_ipi();
+  test_thread_submission();
+  test_log_bytes();
+  return 0;
+}
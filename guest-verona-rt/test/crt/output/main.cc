@@ -0,0 +1,220 @@
+// Copyright Microsoft and Project Monza Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <output.h>
+#include <set>
+#include <test.h>
+#include <thread.h>
+#include <vector>
+
+using namespace monza;
+
+constexpr size_t LINES_PER_CORE = 1000;
+constexpr unsigned char LINE[] = "Logging from a secondary core.\n";
+
+std::atomic<size_t> finished_count;
+std::atomic<bool> start_flag;
+
+void log_lines(void*)
+{
+  while (!start_flag.load())
+    ;
+  for (size_t i = 0; i < LINES_PER_CORE; ++i)
+  {
+    auto data = {std::span<const unsigned char>(LINE, sizeof(LINE) - 1)};
+    test_check(kwritev_stdout(data) == sizeof(LINE) - 1);
+  }
+  finished_count.fetch_add(1);
+}
+
+void test_concurrent_output(size_t num_cores)
+{
+  std::set<monza_thread_t> active_threads;
+  finished_count.store(0);
+  start_flag.store(false);
+
+  for (size_t i = 1; i < num_cores; ++i)
+  {
+    monza_thread_t thread = add_thread(log_lines, nullptr);
+    test_check(thread != 0);
+    active_threads.insert(thread);
+  }
+
+  start_flag.store(true);
+  for (size_t i = 0; i < LINES_PER_CORE; ++i)
+  {
+    printf("Logging from the main core %zu.\n", i);
+  }
+
+  for (auto thread : active_threads)
+  {
+    while (!is_thread_done(thread))
+      ;
+  }
+  test_check(finished_count.load() == num_cores - 1);
+
+  printf("Dropped %zu writes.\n", get_output_dropped());
+  puts("SUCCESS: test_concurrent_output");
+}
+
+/**
+ * Writers of numbered lines whose output is checked for order and
+ * completeness by observing the console. The observer runs with the output
+ * lock held, so it needs no synchronization of its own.
+ */
+constexpr size_t MAX_WRITERS = 64;
+constexpr char ORDERED_PREFIX[] = "Ordered ";
+
+struct OrderedState
+{
+  size_t next_index[MAX_WRITERS];
+  size_t observed;
+  bool in_order;
+  char line[64];
+  size_t line_length;
+};
+
+OrderedState ordered_state;
+std::atomic<size_t> next_writer;
+
+static size_t parse_number(const char*& p, const char* end)
+{
+  size_t value = 0;
+  while (p != end && *p >= '0' && *p <= '9')
+  {
+    value = value * 10 + static_cast<size_t>(*p++ - '0');
+  }
+  return value;
+}
+
+/**
+ * Check a line of the form "Ordered <writer> <index>" against the last index
+ * observed from the writer. Indices skipped by dropped writes are allowed,
+ * and accounted for through the drop counters.
+ */
+static void check_ordered_line(const char* line, size_t length)
+{
+  constexpr size_t prefix_length = sizeof(ORDERED_PREFIX) - 1;
+  if (length < prefix_length || memcmp(line, ORDERED_PREFIX, prefix_length))
+  {
+    return;
+  }
+  const char* p = line + prefix_length;
+  const char* end = line + length;
+  auto writer = parse_number(p, end);
+  ++p;
+  auto index = parse_number(p, end);
+  if (writer >= MAX_WRITERS || index < ordered_state.next_index[writer])
+  {
+    ordered_state.in_order = false;
+    return;
+  }
+  ordered_state.next_index[writer] = index + 1;
+  ordered_state.observed++;
+}
+
+static void observe_ordered(std::span<const unsigned char> buffer)
+{
+  for (auto c : buffer)
+  {
+    if (c == '\n')
+    {
+      check_ordered_line(ordered_state.line, ordered_state.line_length);
+      ordered_state.line_length = 0;
+    }
+    else if (ordered_state.line_length < sizeof(ordered_state.line))
+    {
+      ordered_state.line[ordered_state.line_length++] = static_cast<char>(c);
+    }
+  }
+}
+
+void write_ordered_lines(size_t writer)
+{
+  while (!start_flag.load())
+    ;
+  for (size_t i = 0; i < LINES_PER_CORE; ++i)
+  {
+    char line[64];
+    auto length = snprintf(
+      line, sizeof(line), "%s%zu %zu\n", ORDERED_PREFIX, writer, i);
+    auto data = {std::span<const unsigned char>(
+      reinterpret_cast<const unsigned char*>(line), length)};
+    test_check(kwritev_stdout(data) == static_cast<size_t>(length));
+  }
+  finished_count.fetch_add(1);
+}
+
+void test_ordered_output(size_t num_cores)
+{
+  test_check(num_cores <= MAX_WRITERS);
+  std::set<monza_thread_t> active_threads;
+  finished_count.store(0);
+  start_flag.store(false);
+  next_writer.store(1);
+  ordered_state = {};
+  ordered_state.in_order = true;
+  set_output_observer(observe_ordered);
+  auto dropped_before = get_output_dropped();
+
+  for (size_t i = 1; i < num_cores; ++i)
+  {
+    monza_thread_t thread = add_thread(
+      [](void*) { write_ordered_lines(next_writer.fetch_add(1)); }, nullptr);
+    test_check(thread != 0);
+    active_threads.insert(thread);
+  }
+
+  start_flag.store(true);
+  write_ordered_lines(0);
+
+  for (auto thread : active_threads)
+  {
+    while (!is_thread_done(thread))
+      ;
+  }
+  test_check(finished_count.load() == num_cores);
+
+  // Everything buffered is written out, so every line was either observed in
+  // order or dropped as its ring was full.
+  flush_output();
+  set_output_observer(nullptr);
+  auto dropped = get_output_dropped() - dropped_before;
+  test_check(ordered_state.in_order);
+  test_check(ordered_state.observed + dropped == num_cores * LINES_PER_CORE);
+  test_check(ordered_state.observed > 0);
+
+  puts("SUCCESS: test_ordered_output");
+}
+
+void test_large_output()
+{
+  // Larger than a log ring, so written synchronously.
+  std::vector<unsigned char> buffer(64 * 1024, '.');
+  buffer.back() = '\n';
+  auto data = {std::span<const unsigned char>(buffer)};
+  test_check(kwritev_stdout(data) == buffer.size());
+
+  puts("SUCCESS: test_large_output");
+}
+
+int main()
+{
+  size_t num_cores = initialize_threads();
+  test_check(num_cores > 1);
+
+  test_concurrent_output(num_cores);
+  test_ordered_output(num_cores);
+  test_large_output();
+
+  // Buffered output is flushed on exit.
+  for (size_t i = 0; i < 16; ++i)
+  {
+    puts("Flushed on exit.");
+  }
+
+  return 0;
+}
@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+# Copyright Microsoft and Project Monza Contributors.
+# SPDX-License-Identifier: MIT
+
+"""
+Decode the output of a guest built with MONZA_BINARY_LOGGING.
+
+Binary log records are replaced by the text the guest would have logged,
+using the logging sites and strings in the guest ELF image. All other output
+is passed through unchanged. See BinaryLoggerStream in logging.h for the
+record layout.
+
+Usage: decode_binary_log.py [--timestamps] [--locations] GUEST_ELF [LOG_FILE]
+"""
+
+import argparse
+import struct
+import sys
+
+RECORD_MARKER = b"\x1eML"
+RECORD_HEADER = struct.Struct("<3sH")
+SITE = struct.Struct("<QQQ")
+
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+
+TAG_UNSIGNED = 1
+TAG_SIGNED = 2
+TAG_POINTER = 3
+TAG_STATIC_STRING = 4
+TAG_STRING = 5
+
+
+class ElfImage:
+    """Loaded contents of a statically linked ELF64 image, by address."""
+
+    def __init__(self, path):
+        with open(path, "rb") as elf_file:
+            self.data = elf_file.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 2:
+            raise ValueError(f"{path} is not an ELF64 image")
+
+        (shoff,) = struct.unpack_from("<Q", self.data, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from("<HHH", self.data, 0x3A)
+        headers = [
+            struct.unpack_from("<IIQQQQ", self.data, shoff + i * shentsize)
+            for i in range(shnum)
+        ]
+        names_offset = headers[shstrndx][4]
+
+        self.sections = []
+        self.sites = None
+        for name_index, section_type, flags, address, offset, size in headers:
+            if not flags & SHF_ALLOC or section_type == SHT_NOBITS:
+                continue
+            self.sections.append((address, size, offset))
+            if self.cstring_at(names_offset + name_index) == ".monza_log_sites":
+                self.sites = (address, size)
+        if self.sites is None:
+            raise ValueError(f"{path} has no binary logging sites")
+
+    def cstring_at(self, offset):
+        end = self.data.index(b"\0", offset)
+        return self.data[offset:end].decode("utf-8", "replace")
+
+    def offset_of(self, address, length=1):
+        for start, size, offset in self.sections:
+            if start <= address and address + length <= start + size:
+                return offset + address - start
+        raise ValueError(f"address {address:#x} is not in the image")
+
+    def read(self, address, length):
+        offset = self.offset_of(address, length)
+        return self.data[offset : offset + length]
+
+    def cstring(self, address):
+        return self.cstring_at(self.offset_of(address))
+
+    def site(self, address):
+        start, size = self.sites
+        if not start <= address < start + size:
+            raise ValueError(f"address {address:#x} is not a logging site")
+        file, line, prefix = SITE.unpack(self.read(address, SITE.size))
+        return self.cstring(file), line, self.cstring(prefix)
+
+
+def read_leb128(payload, position):
+    value = 0
+    shift = 0
+    while True:
+        byte = payload[position]
+        position += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, position
+
+
+def decode_payload(image, payload, arguments):
+    site_address, timestamp = struct.unpack_from("<QQ", payload, 0)
+    file, line, prefix = image.site(site_address)
+
+    text = [prefix]
+    position = 16
+    while position < len(payload):
+        tag = payload[position]
+        position += 1
+        if tag == TAG_UNSIGNED:
+            value, position = read_leb128(payload, position)
+            text.append(str(value))
+        elif tag == TAG_SIGNED:
+            value, position = read_leb128(payload, position)
+            text.append(str((value >> 1) ^ -(value & 1)))
+        elif tag == TAG_POINTER:
+            (value,) = struct.unpack_from("<Q", payload, position)
+            position += 8
+            text.append(f"0x{value:x}")
+        elif tag == TAG_STATIC_STRING:
+            value, position = read_leb128(payload, position)
+            text.append(image.cstring(value))
+        elif tag == TAG_STRING:
+            length, position = read_leb128(payload, position)
+            text.append(
+                payload[position : position + length].decode("utf-8", "replace")
+            )
+            position += length
+        else:
+            raise ValueError(f"unknown argument tag {tag}")
+
+    if arguments.locations:
+        text.insert(0, f"{file}:{line}: ")
+    if arguments.timestamps:
+        text.insert(0, f"[{timestamp}] ")
+    return "".join(text).encode("utf-8")
+
+
+def decode(image, data, output, arguments):
+    position = 0
+    while True:
+        start = data.find(RECORD_MARKER, position)
+        if start == -1 or start + RECORD_HEADER.size > len(data):
+            output.write(data[position:])
+            return
+        output.write(data[position:start])
+
+        _, length = RECORD_HEADER.unpack_from(data, start)
+        payload_start = start + RECORD_HEADER.size
+        payload = data[payload_start : payload_start + length]
+        try:
+            if len(payload) != length:
+                raise ValueError("truncated record")
+            output.write(decode_payload(image, payload, arguments))
+            position = payload_start + length
+        except (IndexError, ValueError, struct.error) as error:
+            output.write(f"<undecodable log record: {error}>".encode("utf-8"))
+            position = start + len(RECORD_MARKER)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split("\n")[0])
+    parser.add_argument("--timestamps", action="store_true")
+    parser.add_argument("--locations", action="store_true")
+    parser.add_argument("image")
+    parser.add_argument("log", nargs="?")
+    arguments = parser.parse_args()
+
+    image = ElfImage(arguments.image)
+    if arguments.log is None:
+        data = sys.stdin.buffer.read()
+    else:
+        with open(arguments.log, "rb") as log_file:
+            data = log_file.read()
+    decode(image, data, sys.stdout.buffer, arguments)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+# Copyright Microsoft and Project Monza Contributors.
+# SPDX-License-Identifier: MIT
+
+"""
+Convert the samples of the guest profiler into folded stacks, the input
+format of flamegraph.pl, inferno and speedscope.
+
+The input is the raw profile region written by the host to MONZA_PROFILE_FILE.
+See profile_abi.h for its layout. Addresses are symbolised against the ELF of
+the same guest build. Call stacks are only recorded in Monza core of guests
+built with MONZA_FRAME_POINTERS, otherwise each sample is attributed to the
+interrupted function alone. Every stack is rooted at the compartment which was executing,
+or at "monza" for Monza core.
+
+Usage: profile_to_folded.py [--per-core] [--no-demangle] GUEST_ELF PROFILE_FILE
+"""
+
+import argparse
+import bisect
+import collections
+import shutil
+import struct
+import subprocess
+import sys
+
+PROFILE_MAGIC = 0x3130666F72504D4D
+PROFILE_HEADER_SIZE = 4096
+PROFILE_CORE_HEADER_SIZE = 64
+PROFILE_MAX_FRAMES = 28
+
+PROFILE_IN_COMPARTMENT = 1
+PROFILE_TRUNCATED = 2
+
+HEADER = struct.Struct("<QQQQQQQ")
+SAMPLE = struct.Struct(f"<QQIIQ{PROFILE_MAX_FRAMES}Q")
+
+SHT_SYMTAB = 2
+STT_FUNC = 2
+SYMBOL = struct.Struct("<IBBHQQ")
+
+
+class SymbolTable:
+    """Function symbols of an ELF64 image, looked up by address."""
+
+    def __init__(self, path):
+        with open(path, "rb") as elf_file:
+            data = elf_file.read()
+        if data[:4] != b"\x7fELF" or data[4] != 2:
+            raise ValueError(f"{path} is not an ELF64 image")
+
+        (shoff,) = struct.unpack_from("<Q", data, 0x28)
+        shentsize, shnum = struct.unpack_from("<HH", data, 0x3A)
+        headers = [
+            struct.unpack_from("<IIQQQQI", data, shoff + i * shentsize)
+            for i in range(shnum)
+        ]
+
+        symbols = []
+        for _, section_type, _, _, offset, size, link in headers:
+            if section_type != SHT_SYMTAB:
+                continue
+            names_offset = headers[link][4]
+            for position in range(offset, offset + size, SYMBOL.size):
+                name, info, _, _, value, symbol_size = SYMBOL.unpack_from(
+                    data, position
+                )
+                if info & 0xF != STT_FUNC or value == 0:
+                    continue
+                start = names_offset + name
+                end = data.index(b"\0", start)
+                symbols.append(
+                    (value, symbol_size, data[start:end].decode("utf-8", "replace"))
+                )
+        if not symbols:
+            raise ValueError(f"{path} has no function symbols")
+
+        symbols.sort()
+        self.starts = [symbol[0] for symbol in symbols]
+        self.symbols = symbols
+
+    def lookup(self, address):
+        index = bisect.bisect_right(self.starts, address) - 1
+        if index >= 0:
+            start, size, name = self.symbols[index]
+            if address < start + max(size, 1):
+                return name
+        return f"0x{address:x}"
+
+
+def read_samples(data):
+    """Yield the samples of each core as (core, sample), oldest first."""
+    magic, _, _, core_count, stride, samples_per_core, ready = (
+        HEADER.unpack_from(data, 0)
+    )
+    if magic != PROFILE_MAGIC:
+        raise ValueError("not a Monza profile")
+    if not ready:
+        raise ValueError("the guest did not enable profiling")
+    if (
+        samples_per_core == 0
+        or stride < PROFILE_CORE_HEADER_SIZE + samples_per_core * SAMPLE.size
+        or PROFILE_HEADER_SIZE + core_count * stride > len(data)
+    ):
+        raise ValueError("inconsistent profile header")
+
+    for core in range(core_count):
+        offset = PROFILE_HEADER_SIZE + core * stride
+        (write_position,) = struct.unpack_from("<Q", data, offset)
+        samples_offset = offset + PROFILE_CORE_HEADER_SIZE
+        first = max(0, write_position - samples_per_core)
+        for position in range(first, write_position):
+            index = position % samples_per_core
+            sample_offset = samples_offset + index * SAMPLE.size
+            yield core, SAMPLE.unpack_from(data, sample_offset)
+
+
+def fold(symbols, data, per_core):
+    stacks = collections.Counter()
+    for core, sample in read_samples(data):
+        _, owner, flags, frame_count, rip = sample[:5]
+        frames = sample[5 : 5 + min(frame_count, PROFILE_MAX_FRAMES)]
+
+        # Return addresses point after the call, so look up the call itself.
+        names = [symbols.lookup(rip)]
+        names.extend(symbols.lookup(address - 1) for address in frames)
+        if flags & PROFILE_TRUNCATED:
+            names.append("[truncated]")
+        if flags & PROFILE_IN_COMPARTMENT:
+            names.append(f"compartment 0x{owner:x}")
+        else:
+            names.append("monza")
+        if per_core:
+            names.append(f"core {core}")
+        stacks[tuple(reversed(names))] += 1
+    return stacks
+
+
+def demangle(stacks):
+    names = sorted({name for stack in stacks for name in stack})
+    process = subprocess.run(
+        ["c++filt"], input="\n".join(names), capture_output=True, text=True
+    )
+    demangled = process.stdout.split("\n")
+    if process.returncode != 0 or len(demangled) < len(names):
+        return stacks
+    mapping = dict(zip(names, demangled))
+    result = collections.Counter()
+    for stack, count in stacks.items():
+        result[tuple(mapping[name] for name in stack)] += count
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split("\n")[0])
+    parser.add_argument("--per-core", action="store_true")
+    parser.add_argument("--no-demangle", action="store_true")
+    parser.add_argument("image")
+    parser.add_argument("profile")
+    arguments = parser.parse_args()
+
+    symbols = SymbolTable(arguments.image)
+    with open(arguments.profile, "rb") as profile_file:
+        stacks = fold(symbols, profile_file.read(), arguments.per_core)
+    if not arguments.no_demangle and shutil.which("c++filt") is not None:
+        stacks = demangle(stacks)
+
+    for stack, count in sorted(stacks.items()):
+        # Semicolons separate frames in the folded format.
+        names = (name.replace(";", ":") for name in stack)
+        sys.stdout.write(f"{';'.join(names)} {count}\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+# Copyright Microsoft and Project Monza Contributors.
+# SPDX-License-Identifier: MIT
+
+"""
+Convert the kernel trace of a guest built with MONZA_TRACING into the Chrome
+trace event JSON format, which can be opened in chrome://tracing or the
+Perfetto UI.
+
+The input is the raw trace region written by the host to MONZA_TRACE_FILE.
+See trace_abi.h for its layout. Each core becomes a thread of a single process.
+Compartment invocations are shown as durations and other events as instants.
+
+Usage: trace_to_chrome.py TRACE_FILE [OUTPUT_FILE]
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+TRACE_MAGIC = 0x3165636172746D4D
+TRACE_HEADER_SIZE = 4096
+TRACE_CORE_HEADER_SIZE = 64
+
+HEADER = struct.Struct("<QQQQQQ")
+RECORD = struct.Struct("<QIIQQ")
+
+EVENTS = {
+    1: ("compartment", "B", ("compartment",)),
+    2: ("compartment", "E", ("compartment", "success")),
+    3: ("ipi_send", "i", ("core", "vector")),
+    4: ("semaphore_sleep", "i", ("thread",)),
+    5: ("semaphore_wake", "i", ("thread",)),
+    6: ("page_fault", "i", ("address", "error")),
+    7: ("alloc_chunk", "i", ("compartment", "size")),
+    8: ("lease_chunks", "i", ("compartment", "size")),
+}
+HEX_ARGUMENTS = {"compartment", "address"}
+
+
+def read_core(data, offset, records_per_core):
+    """Records of a core, oldest first."""
+    (write_position,) = struct.unpack_from("<Q", data, offset)
+    first = max(0, write_position - records_per_core)
+    records_offset = offset + TRACE_CORE_HEADER_SIZE
+    for position in range(first, write_position):
+        index = position % records_per_core
+        yield RECORD.unpack_from(data, records_offset + index * RECORD.size)
+
+
+def convert(data):
+    magic, tsc_frequency, core_count, stride, records_per_core, ready = (
+        HEADER.unpack_from(data, 0)
+    )
+    if magic != TRACE_MAGIC:
+        raise ValueError("not a Monza trace")
+    if not ready:
+        raise ValueError("the guest did not enable tracing")
+    if (
+        tsc_frequency == 0
+        or records_per_core == 0
+        or stride < TRACE_CORE_HEADER_SIZE + records_per_core * RECORD.size
+        or TRACE_HEADER_SIZE + core_count * stride > len(data)
+    ):
+        raise ValueError("inconsistent trace header")
+
+    cores = [
+        list(read_core(data, TRACE_HEADER_SIZE + core * stride, records_per_core))
+        for core in range(core_count)
+    ]
+    ticks = [record[0] for records in cores for record in records]
+    start = min(ticks, default=0)
+
+    events = []
+    for core, records in enumerate(cores):
+        events.append(
+            {
+                "name": "thread_name",
+                "ph": "M",
+                "pid": 0,
+                "tid": core,
+                "args": {"name": f"core {core}"},
+            }
+        )
+        for tick, event, _, argument0, argument1 in records:
+            name, phase, argument_names = EVENTS.get(
+                event, (f"event_{event}", "i", ("argument0", "argument1"))
+            )
+            arguments = {}
+            for argument_name, value in zip(argument_names, (argument0, argument1)):
+                arguments[argument_name] = (
+                    f"0x{value:x}" if argument_name in HEX_ARGUMENTS else value
+                )
+            entry = {
+                "name": name,
+                "ph": phase,
+                "ts": (tick - start) * 1_000_000 / tsc_frequency,
+                "pid": 0,
+                "tid": core,
+                "args": arguments,
+            }
+            if phase == "i":
+                entry["s"] = "t"
+            events.append(entry)
+
+    return {"traceEvents": events, "displayTimeUnit": "ns"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split("\n")[0])
+    parser.add_argument("trace")
+    parser.add_argument("output", nargs="?")
+    arguments = parser.parse_args()
+
+    with open(arguments.trace, "rb") as trace_file:
+        trace = convert(trace_file.read())
+    if arguments.output is None:
+        json.dump(trace, sys.stdout)
+    else:
+        with open(arguments.output, "w") as output_file:
+            json.dump(trace, output_file)
+
+
+if __name__ == "__main__":
+    main()